@@ -0,0 +1,1261 @@
+#include "libtcctl.h"
+#ifdef TCCTL_BAKED
+#include "tcctl_baked.h"
+#endif
+
+#ifdef TCCTL_BAKED
+// the conf is known at build time, with one zone the update folds it in
+#define ZONE_CONF(CTX, ID) (&tcctl_baked_set.zones[BAKED_ZONES_NUM == 1 ? 0 : (ID)])
+#else
+#define ZONE_CONF(CTX, ID) (&(CTX)->zones[ID].conf)
+#endif
+
+#define CONF_ENTRIES 18
+#define CONF_ENTRY(FIELD) #FIELD, offsetof(struct tcctl_conf, FIELD)
+#define CONF_FIELD(CONF, ENTRY) \
+	(union tcctl_conf_field *)((char *)(CONF) + (ENTRY).offset)
+
+#ifndef TCCTL_BAKED
+static const struct tcctl_conf_entry tcctl_conf_entries[] = 
+{	
+	{ CONF_ENTRY(low_temp),       tcctl_get_uint,    tcctl_put_uint },
+	{ CONF_ENTRY(trig_temp),      tcctl_get_uint,    tcctl_put_uint },
+	{ CONF_ENTRY(hyst_dec_temp),  tcctl_get_uint,    tcctl_put_uint },
+	{ CONF_ENTRY(update_delay),   tcctl_get_uint,    tcctl_put_uint },
+	{ CONF_ENTRY(output_pin),     tcctl_get_uint,    tcctl_put_uint },
+	{ CONF_ENTRY(output_bias),    tcctl_get_bias,    tcctl_put_bias },
+	{ CONF_ENTRY(output_drive),   tcctl_get_drive,   tcctl_put_drive },
+	{ CONF_ENTRY(reassert_delay), tcctl_get_uint,    tcctl_put_uint },
+	{ CONF_ENTRY(stay_on),        tcctl_get_boolean, tcctl_put_boolean },
+	{ CONF_ENTRY(stop),           tcctl_get_boolean, tcctl_put_boolean },
+	{ CONF_ENTRY(pin_invert),     tcctl_get_boolean, tcctl_put_boolean },
+	{ CONF_ENTRY(load_trig),      tcctl_get_uint,    tcctl_put_uint },
+	{ CONF_ENTRY(load_sustain),   tcctl_get_uint,    tcctl_put_uint },
+	{ CONF_ENTRY(policy),         tcctl_get_policy,  tcctl_put_policy },
+	{ CONF_ENTRY(sensor),         tcctl_get_sensor,  tcctl_put_sensor },
+	{ CONF_ENTRY(tach_pin),       tcctl_get_uint,    tcctl_put_uint },
+	{ CONF_ENTRY(tach_ppr),       tcctl_get_uint,    tcctl_put_uint },
+	{ CONF_ENTRY(stall_rpm),      tcctl_get_uint,    tcctl_put_uint }
+};
+#endif
+
+static const char *tcctl_phase_names[] = 
+{
+	"LOW_TEMP", "IDLE", "RUN", "HIGH_TEMP", "OVRD_IDLE", "OVRD_RUN", "FAIL"
+};
+
+void
+tcctl_ctx_init(struct tcctl_ctx *ctx, const struct tcctl_io *io)
+{
+	struct tcctl_ctx empty = { .zones_num = 0 };
+	*ctx = empty;
+	ctx->io = *io;
+	ctx->conf_errentid = -1;
+	ctx->conf_live = &ctx->conf_sets[0];
+	ctx->conf_stage = &ctx->conf_sets[1];
+}
+
+int
+tcctl_ctx_run(struct tcctl_ctx *ctx)
+{
+	struct timer next;
+	unsigned long long now = ctx->io.clock_ms(ctx->io.user);
+
+	// one cpu sample per tick, shared by the zones due
+	if (
+		ctx->io.load_read != NULL &&
+		timer_top(&ctx->timers, &next) && next.deadline <= now &&
+		tcctl_ctx_load_wanted(ctx)
+	)
+		ctx->load.ok = ctx->io.load_read(ctx->io.user, &ctx->load);
+
+	while (timer_top(&ctx->timers, &next) && next.deadline <= now)
+	{
+		// sensors that would not open on the last conf, once a tick
+		if (
+			ctx->zones_retry & 1U << next.id &&
+			tcctl_zone_sensors_open(ctx, next.id, &ctx->conf_live->zones[next.id])
+		)
+		{
+			ctx->zones_retry &= ~(1U << next.id);
+			LOG_INFO("zone ok: ", ctx->zones[next.id].conf.name);
+		}
+
+		if (!tcctl_update(ctx, next.id))
+			return 0;
+
+		// never starve the loop with a zero delay
+		unsigned long long delay = ZONE_CONF(ctx, next.id)->update_delay.uint * 1000ULL;
+		timer_set(&ctx->timers, next.id, now + (delay ? delay : 1));
+	}
+
+	return 1;
+}
+
+int
+tcctl_ctx_next(struct tcctl_ctx *ctx, unsigned long long *deadline)
+{
+	struct timer next;
+	if (!timer_top(&ctx->timers, &next))
+		return 0;
+
+	*deadline = next.deadline;
+	return 1;
+}
+
+void
+tcctl_ctx_kick(struct tcctl_ctx *ctx, unsigned int zone_id)
+{
+	timer_set(&ctx->timers, zone_id, ctx->io.clock_ms(ctx->io.user));
+}
+
+int
+tcctl_ctx_load_wanted(struct tcctl_ctx *ctx)
+{
+	for (unsigned int i = 0; i < ctx->zones_num; i++)
+	{
+		if (ZONE_CONF(ctx, i)->load_trig.uint != 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+void
+tcctl_ctx_prime(struct tcctl_ctx *ctx)
+{
+	// the first tick decides on a reading, not on 0, and a hot zone gets
+	// the fan right away instead of a tick later
+	for (unsigned int i = 0; i < ctx->zones_num; i++)
+		tcctl_zone_prime(ctx, i);
+}
+
+int
+tcctl_zone_prime(struct tcctl_ctx *ctx, unsigned int zone_id)
+{
+	struct tcctl_stat *stat = &ctx->zones[zone_id].stat;
+	if (!tcctl_zone_temp_read(ctx, zone_id, &stat->last_mtemp))
+	{
+		LOG_WARN("could not prime zone: ", ctx->zones[zone_id].conf.name);
+		return 0;
+	}
+
+	stat->last_temp = stat->last_mtemp / 1000;
+	if (stat->phase <= IDLE && stat->last_temp >= stat->trig_temp)
+		stat->phase = HIGH_TEMP;
+	return 1;
+}
+
+unsigned int
+tcctl_ctx_trip(struct tcctl_ctx *ctx, unsigned int tz)
+{
+	unsigned int tripped = 0;
+
+	// zones with a sensor in that thermal zone, the others never hear of it
+	for (unsigned int i = 0; i < ctx->zones_num; i++)
+	{
+		const struct tcctl_conf *conf = ZONE_CONF(ctx, i);
+		for (unsigned int s = 0; s < conf->sensor.uint; s++)
+		{
+			if (tcctl_sensor_tz(conf->sensor_path[s]) != (int)tz)
+				continue;
+			tcctl_zone_trip(ctx, i);
+			tripped++;
+			break;
+		}
+	}
+
+	return tripped;
+}
+
+void
+tcctl_zone_trip(struct tcctl_ctx *ctx, unsigned int zone_id)
+{
+	// decide now on a fresh reading, not at the next tick on the old one
+	LOG_INFO("trip point crossed, zone: ", ctx->zones[zone_id].conf.name);
+	tcctl_zone_prime(ctx, zone_id);
+	tcctl_ctx_kick(ctx, zone_id);
+}
+
+int
+tcctl_sensor_tz(const char *path)
+{
+	// .../thermal_zone<N>/temp, -1 - not a thermal zone
+	const char *p = str_find(path, THERMAL_ZONE_MARK, SENSOR_PATH_MAX_LEN);
+	unsigned int tz;
+	if (p == NULL)
+		return -1;
+
+	p += sizeof(THERMAL_ZONE_MARK) - 1;
+	int len = uint_scan(&tz, p);
+	if (len == 0 || p[len] != '/')
+		return -1;
+	return tz;
+}
+
+int
+tcctl_ctx_sync(struct tcctl_ctx *ctx)
+{
+	// runtime TRIG values hold until the next conf
+	if (ctx->zones_gen == ctx->conf_live->gen)
+		return 1;
+	return tcctl_zones_apply(ctx);
+}
+
+int
+tcctl_update(struct tcctl_ctx *ctx, unsigned int zone_id)
+{
+	int is_on;
+	struct tcctl_zone *zone = &ctx->zones[zone_id];
+	struct tcctl_stat *stat = &zone->stat;
+	const struct tcctl_conf *conf = ZONE_CONF(ctx, zone_id);
+	unsigned int temp = stat->last_temp;
+	enum tcctl_phase phase = stat->phase;
+	unsigned long long now = ctx->io.clock_ms(ctx->io.user);
+	int load_hot = tcctl_update_load(ctx, zone_id, now);
+
+	// an announced job counts as load from its lead time on
+	if (tcctl_update_hint(zone, now))
+		load_hot = 1;
+	tcctl_update_tach(ctx, zone_id, now);
+
+	switch (stat->phase)
+	{
+		case OVRD_IDLE:
+		case OVRD_RUN:
+			is_on = stat->phase == OVRD_RUN;
+			break;
+		case LOW_TEMP:
+			if (temp >= stat->low_temp)
+				stat->phase = IDLE;
+		case IDLE:
+			if (temp >= stat->trig_temp)
+				stat->phase = HIGH_TEMP;
+			// sustained load starts the fan ahead of the heat
+			else if (load_hot)
+				stat->phase = RUN;
+
+			is_on = 0;
+			break;
+		case HIGH_TEMP:
+			if (temp < stat->trig_temp)
+				stat->phase = RUN;
+		case RUN:
+			// switch to high temp mode
+			if (temp >= stat->trig_temp)
+				stat->phase = HIGH_TEMP;
+			if (temp <= stat->trig_temp - conf->hyst_dec_temp.uint && !load_hot)
+				stat->phase = LOW_TEMP;
+			
+			is_on = 1;
+			break;
+		case FAIL:
+		default:
+			// fail safe
+			is_on = 1;
+	}
+
+	// model may cut a run short, fixed policies still walk the phases for stats
+	if (conf->policy.uint == POLICY_MODEL)
+		is_on = tcctl_update_model(zone, is_on, now);
+	else if (stat->phase <= HIGH_TEMP && conf->policy.uint != POLICY_HYST)
+		is_on = conf->policy.uint == POLICY_ON;
+
+	int was_on = zone->is_on;
+	zone->is_on = is_on;
+	ctx->io.output_write(ctx->io.user, zone_id, is_on);
+	PROBE6(update, zone_id, temp, (int)phase, (int)stat->phase, is_on, was_on);
+	if (!tcctl_zone_temp_read(ctx, zone_id, &stat->last_mtemp))
+		return 0;
+
+	stat->last_temp = stat->last_mtemp / 1000;
+	tcctl_fit_update(
+			&zone->fit, 
+			conf->update_delay.uint * 1000ULL, 
+			now, 
+			stat->last_mtemp, 
+			was_on
+	);
+	return 1;
+}
+
+int
+tcctl_update_load(struct tcctl_ctx *ctx, unsigned int zone_id, unsigned long long now)
+{
+	struct tcctl_zone *zone = &ctx->zones[zone_id];
+	const struct tcctl_conf *conf = ZONE_CONF(ctx, zone_id);
+	unsigned int trig = conf->load_trig.uint;
+	int busy = trig != 0 && ctx->load.ok && ctx->load.util >= trig * 10;
+
+	if (!busy)
+	{
+		zone->load_busy = 0;
+		zone->throttled = 0;
+		return 0;
+	}
+	if (!zone->load_busy)
+	{
+		zone->load_busy = 1;
+		zone->load_since = now;
+	}
+
+	// busy and still not at full clock, something holds it back
+	int throttled = ctx->load.freq < LOAD_THROTTLE_FREQ;
+	if (throttled != zone->throttled)
+		LOG_WARN(throttled ? "cpu throttled, zone: " : "cpu back to full clock, zone: ",
+				zone->conf.name);
+	zone->throttled = throttled;
+
+	return now - zone->load_since >= conf->load_sustain.uint * 1000ULL;
+}
+
+int
+tcctl_update_hint(struct tcctl_zone *zone, unsigned long long now)
+{
+	zone->hinted = 0;
+	if (zone->hint_load == 0)
+		return 0;
+	if (now >= zone->hint_end)
+	{
+		LOG_INFO("heat hint expired, zone: ", zone->conf.name);
+		zone->hint_load = 0;
+		return 0;
+	}
+
+	// one fan on time constant at full load brings it most of the way down
+	unsigned long long lead = tcctl_fit_valid(&zone->fit, 1) ?
+		tcctl_fit_tau(&zone->fit, 1) : HINT_LEAD_DEFAULT;
+	if (lead > HINT_LEAD_MAX)
+		lead = HINT_LEAD_MAX;
+	lead = lead * 1000 * zone->hint_load / 100;
+
+	zone->hinted = now + lead >= zone->hint_start;
+	return zone->hinted;
+}
+
+void
+tcctl_update_tach(struct tcctl_ctx *ctx, unsigned int zone_id, unsigned long long now)
+{
+	struct tcctl_zone *zone = &ctx->zones[zone_id];
+	struct tcctl_stat *stat = &zone->stat;
+	const struct tcctl_conf *conf = ZONE_CONF(ctx, zone_id);
+	int stalled = zone->stalled;
+
+	if (!zone->is_on)
+		zone->spin_since = 0;
+	else if (zone->spin_since == 0)
+		zone->spin_since = now;
+
+	// a fan gets time to spin up, one that is off tells nothing
+	if (conf->tach_pin.uint == -1 || ctx->io.tach_read == NULL)
+	{
+		zone->rpm = 0;
+		stalled = 0;
+	}
+	else if (
+		ctx->io.tach_read(ctx->io.user, zone_id, &zone->rpm) &&
+		zone->is_on && now - zone->spin_since >= TACH_SPINUP_MS
+	)
+		stalled = zone->rpm < conf->stall_rpm.uint;
+
+	// automatic phases stay failed while stalled, an override holds
+	if (stalled && (!zone->stalled || stat->phase <= HIGH_TEMP))
+	{
+		if (!zone->stalled)
+		{
+			LOG_ERROR("fan stalled, fail safe on, zone: ", zone->conf.name);
+			zone->stalls++;
+		}
+		stat->phase = FAIL;
+	}
+	else if (!stalled && zone->stalled)
+	{
+		LOG_INFO("fan turns again, zone: ", zone->conf.name);
+		if (stat->phase == FAIL)
+			stat->phase = RUN;
+	}
+	zone->stalled = stalled;
+}
+
+void
+tcctl_zone_hint(
+		struct tcctl_ctx *ctx,
+		unsigned int zone_id,
+		unsigned int load,
+		unsigned int start,
+		unsigned int duration
+)
+{
+	struct tcctl_zone *zone = &ctx->zones[zone_id];
+	unsigned long long now = ctx->io.clock_ms(ctx->io.user);
+
+	if (load > 100)
+		load = 100;
+	if (start > HINT_TIME_MAX)
+		start = HINT_TIME_MAX;
+	if (duration > HINT_TIME_MAX)
+		duration = HINT_TIME_MAX;
+
+	// a later hint replaces the one before, load 0 drops it
+	zone->hint_load = duration ? load : 0;
+	zone->hint_start = now + start * 1000ULL;
+	zone->hint_end = zone->hint_start + duration * 1000ULL;
+}
+
+int
+tcctl_update_model(struct tcctl_zone *zone, int is_on, unsigned long long now)
+{
+	struct tcctl_stat *stat = &zone->stat;
+	unsigned int hyst = zone->conf.hyst_dec_temp.uint;
+	unsigned int target = stat->trig_temp > hyst ? (stat->trig_temp - hyst) * 1000 : 0;
+	unsigned long long run_ms;
+
+	// overrides and failures are not planned
+	if (stat->phase > HIGH_TEMP)
+		return is_on;
+	if (!is_on)
+	{
+		zone->run_until = 0;
+		return 0;
+	}
+
+	// plan the run as the fan comes on, again if still hot when it is up
+	if (!zone->is_on || (stat->phase == HIGH_TEMP && now >= zone->run_until))
+		zone->run_until = 
+			tcctl_fit_run_ms(&zone->fit, stat->last_mtemp, target, &run_ms) ? 
+			now + run_ms : 0;
+
+	// no usable fit, the hysteresis decides, a hinted job runs through
+	if (
+		stat->phase != RUN || zone->hinted ||
+		zone->run_until == 0 || now < zone->run_until
+	)
+		return 1;
+
+	stat->phase = LOW_TEMP;
+	zone->run_until = 0;
+	return 0;
+}
+
+const char *
+tcctl_phase_name(enum tcctl_phase phase)
+{
+	if (phase > FAIL)
+		return "?";
+	return tcctl_phase_names[phase];
+}
+
+size_t
+tcctl_rec_len(const char *buf, size_t len)
+{
+	// record size by the magic, 0 - not a capture
+	if (len < REC_MAGIC_LEN)
+		return 0;
+	if (str_eq(buf, REC_MAGIC, REC_MAGIC_LEN))
+		return sizeof(struct tcctl_rec);
+	if (str_eq(buf, REC_MAGIC_V1, REC_MAGIC_LEN))
+		return REC_V1_LEN;
+	return 0;
+}
+
+int
+tcctl_zone_temp_read(struct tcctl_ctx *ctx, unsigned int zone_id, unsigned int *val)
+{
+	unsigned int temp, max_temp = 0;
+	for (unsigned int i = 0; i < ZONE_CONF(ctx, zone_id)->sensor.uint; i++)
+	{
+		// hottest sensor of the set drives the zone
+		if (!ctx->io.sensor_read(ctx->io.user, zone_id, i, &temp))
+			return 0;
+		if (temp > max_temp)
+			max_temp = temp;
+	}
+
+	*val = max_temp;
+	return 1;
+}
+
+int
+tcctl_zone_sensors_open(struct tcctl_ctx *ctx, unsigned int zone_id, struct tcctl_conf *conf)
+{
+	struct tcctl_conf *run = &ctx->zones[zone_id].conf;
+	for (unsigned int i = 0; i < ZONE_SENSORS_MAX; i++)
+	{
+		if (
+			i < conf->sensor.uint && 
+			i < run->sensor.uint &&
+			str_eq(conf->sensor_path[i], run->sensor_path[i], SENSOR_PATH_MAX_LEN)
+		)
+			continue;
+
+		if (i < run->sensor.uint)
+			ctx->io.sensor_open(ctx->io.user, zone_id, i, NULL);
+		if (i >= conf->sensor.uint)
+			continue;
+
+		const char *path = conf->sensor_path[i];
+		if (!ctx->io.sensor_open(ctx->io.user, zone_id, i, path))
+		{
+			run->sensor.uint = i;
+			return 0;
+		}
+		run->sensor_path[i][str_copy(path, run->sensor_path[i], SENSOR_PATH_MAX_LEN)] = '\0';
+	}
+
+	run->sensor = conf->sensor;
+	run->name[str_copy(conf->name, run->name, ZONE_NAME_MAX_LEN)] = '\0';
+	return 1;
+}
+
+int
+tcctl_zones_apply(struct tcctl_ctx *ctx)
+{
+	unsigned long long now = ctx->io.clock_ms(ctx->io.user);
+	struct tcctl_conf_set *set = ctx->conf_live;
+
+	ctx->zones_retry = 0;
+	for (unsigned int i = set->num; i < ctx->zones_num; i++)
+	{
+		struct tcctl_zone *zone = &ctx->zones[i];
+		LOG_INFO("drop zone: ", zone->conf.name);
+		for (unsigned int s = 0; s < zone->conf.sensor.uint; s++)
+			ctx->io.sensor_open(ctx->io.user, i, s, NULL);
+		timer_del(&ctx->timers, i);
+	}
+
+	for (unsigned int i = 0; i < set->num; i++)
+	{
+		struct tcctl_zone *zone = &ctx->zones[i];
+		if (i >= ctx->zones_num)
+		{
+			struct tcctl_zone empty = { .is_on = 0 };
+			*zone = empty;
+		}
+
+		// TRIG values hold unless the conf moves the thresholds of their zone
+		struct tcctl_conf *conf = &set->zones[i];
+		int reset = 
+			i >= ctx->zones_num ||
+			!str_eq(zone->conf.name, conf->name, ZONE_NAME_MAX_LEN) ||
+			zone->conf.low_temp.uint != conf->low_temp.uint ||
+			zone->conf.trig_temp.uint != conf->trig_temp.uint;
+
+		// the rest of the conf applies anyway, the zone runs on the sensors
+		// that did open and tries the others again on its ticks
+		int opened = tcctl_zone_sensors_open(ctx, i, conf);
+		if (!opened)
+			ctx->zones_retry |= 1U << i;
+		tcctl_conf_apply(conf, &zone->conf);
+		if (reset)
+			tcctl_stat_update(&zone->stat, &zone->conf);
+		timer_set(&ctx->timers, i, now);
+		if (opened)
+			LOG_INFO("zone ok: ", zone->conf.name);
+	}
+
+	ctx->zones_num = set->num;
+	ctx->zones_gen = set->gen;
+	return ctx->zones_retry == 0;
+}
+
+unsigned int
+tcctl_stat_get(struct tcctl_ctx *ctx, unsigned int zone_id, unsigned int param_id)
+{
+	if (param_id == STAT_ZONES)
+		return ctx->zones_num;
+	if (zone_id >= ctx->zones_num)
+		return 0;
+
+	struct tcctl_zone *zone = &ctx->zones[zone_id];
+	switch (param_id)
+	{
+		case STAT_LAST_TEMP:
+			return zone->stat.last_temp;
+		case STAT_LOW_TEMP:
+			return zone->stat.low_temp;
+		case STAT_TRIG_TEMP:
+			return zone->stat.trig_temp;
+		case STAT_PHASE:
+			return zone->stat.phase;
+		case STAT_OUTPUT:
+			return zone->is_on;
+		case STAT_TAU_OFF:
+		case STAT_TAU_ON:
+			return tcctl_fit_tau(&zone->fit, param_id == STAT_TAU_ON) / 1000;
+		case STAT_EQ_OFF:
+		case STAT_EQ_ON:
+			return tcctl_fit_eq(&zone->fit, param_id == STAT_EQ_ON);
+		case STAT_RUN_TIME:
+			return tcctl_stat_run_time(zone);
+		case STAT_CPU_LOAD:
+			return ctx->load.util / 10;
+		case STAT_CPU_FREQ:
+			return ctx->load.khz / 1000;
+		case STAT_THROTTLED:
+			return zone->throttled;
+		case STAT_HINT:
+			return tcctl_stat_hint(ctx, zone);
+		case STAT_RPM:
+			return zone->rpm;
+		case STAT_STALLS:
+			return zone->stalls;
+		default:
+			return 0;
+	}
+}
+
+unsigned int
+tcctl_stat_run_time(struct tcctl_zone *zone)
+{
+	unsigned long long run_ms;
+	unsigned int hyst = zone->conf.hyst_dec_temp.uint;
+	unsigned int trig = zone->stat.trig_temp;
+	unsigned int target = trig > hyst ? (trig - hyst) * 1000 : 0;
+
+	if (!tcctl_fit_run_ms(&zone->fit, zone->stat.last_mtemp, target, &run_ms))
+		return 0;
+	return run_ms / 1000;
+}
+
+unsigned int
+tcctl_stat_hint(struct tcctl_ctx *ctx, struct tcctl_zone *zone)
+{
+	unsigned long long now = ctx->io.clock_ms(ctx->io.user);
+	if (zone->hint_load == 0 || now >= zone->hint_end)
+		return 0;
+	return (zone->hint_end - now + 999) / 1000;
+}
+
+void
+tcctl_stat_update(struct tcctl_stat *stat, struct tcctl_conf *conf)
+{
+	stat->low_temp = conf->low_temp.uint;
+	stat->trig_temp = conf->trig_temp.uint;
+}
+
+void
+tcctl_conf_reset(struct tcctl_conf *conf)
+{
+	conf->low_temp.uint = LOW_TEMP_DEFAULT;
+	conf->trig_temp.uint = TRIG_TEMP_DEFAULT;
+	conf->hyst_dec_temp.uint = HYST_DEC_TEMP_DEFAULT;
+
+	conf->update_delay.uint = UPDATE_DELAY_DEFAULT;
+	conf->output_pin.uint = OUTPUT_PIN_DEFAULT;
+	conf->output_bias.uint = OUTPUT_BIAS_DEFAULT;
+	conf->output_drive.uint = OUTPUT_DRIVE_DEFAULT;
+	conf->reassert_delay.uint = REASSERT_DELAY_DEFAULT;
+
+	conf->stay_on.boolean = 0;
+	conf->stop.boolean = 0;
+	conf->pin_invert.boolean = 0;
+
+	conf->load_trig.uint = LOAD_TRIG_DEFAULT;
+	conf->load_sustain.uint = LOAD_SUSTAIN_DEFAULT;
+
+	conf->policy.uint = POLICY_HYST;
+	conf->sensor.uint = 0;
+
+	conf->tach_pin.uint = TACH_PIN_DEFAULT;
+	conf->tach_ppr.uint = TACH_PPR_DEFAULT;
+	conf->stall_rpm.uint = STALL_RPM_DEFAULT;
+	conf->name[str_copy(ZONE_DEFAULT_NAME, conf->name, ZONE_NAME_MAX_LEN)] = '\0';
+}
+
+void
+tcctl_conf_apply(struct tcctl_conf *from, struct tcctl_conf *to)
+{
+	to->low_temp = from->low_temp;
+	to->trig_temp = from->trig_temp;
+	to->hyst_dec_temp = from->hyst_dec_temp;
+
+	to->update_delay = from->update_delay;
+	to->output_pin = from->output_pin;
+	to->output_bias = from->output_bias;
+	to->output_drive = from->output_drive;
+	to->reassert_delay = from->reassert_delay;
+
+	to->stay_on = from->stay_on;
+	to->stop = from->stop;
+	to->pin_invert = from->pin_invert;
+
+	to->load_trig = from->load_trig;
+	to->load_sustain = from->load_sustain;
+
+	to->policy = from->policy;
+
+	to->tach_pin = from->tach_pin;
+	to->tach_ppr = from->tach_ppr;
+	to->stall_rpm = from->stall_rpm;
+}
+
+#ifndef TCCTL_BAKED
+void
+tcctl_conf_log_error(struct tcctl_ctx *ctx, const char *msg, const char *entry)
+{
+	char error_loc[ENTRY_NAME_MAX_LEN+ENTRY_LINE_MAX_LEN] = ZERO_STR;
+	char *p = error_loc;
+
+	p += str_copy(entry, p, ENTRY_NAME_MAX_LEN);
+	p += str_copy(" in line ", p, ENTRY_LINE_MAX_LEN);
+	if (uint_write(ctx->conf_errline, p) <= 0)
+	{
+		p += str_copy("---", p, ENTRY_LINE_MAX_LEN);
+		LOG_ERROR(msg, error_loc);
+	}
+	else
+		LOG_ERROR(msg, error_loc);
+}
+
+void
+tcctl_conf_log_load(
+		const char *msg, 
+		const char *entry, 
+		const char *val_text, 
+		size_t val_len
+)
+{
+	char load_info[ENTRY_NAME_MAX_LEN+ENTRY_LINE_MAX_LEN] = ZERO_STR;
+	char *p = load_info;
+
+	p += str_copy(entry, p, ENTRY_NAME_MAX_LEN);
+	p += str_copy(" = ", p, ENTRY_LINE_MAX_LEN);
+	p += str_copy(val_text, p, val_len);
+	LOG_INFO(msg, load_info);
+}
+
+int
+tcctl_conf_set_write(const struct tcctl_conf_set *set, char *str, size_t max_len)
+{
+	size_t len = 0;
+
+	// with more zones every one gets its section, main too: without one
+	// its entries would land in the zone before it
+	for (unsigned int i = 0; i < set->num; i++)
+	{
+		int zone_len = tcctl_conf_write(&set->zones[i], set->num > 1, str + len, max_len - len);
+		if (zone_len == -1)
+			return -1;
+		len += zone_len;
+	}
+
+	return len;
+}
+
+int
+tcctl_conf_write(const struct tcctl_conf *conf, int section, char *str, size_t max_len)
+{
+	char *p = str;
+
+	// a lone zone needs a section only for an own name
+	if (section || !str_eq(conf->name, ZONE_DEFAULT_NAME, ZONE_NAME_MAX_LEN))
+	{
+		if (max_len < ZONE_NAME_MAX_LEN + ENTRY_LINE_MAX_LEN)
+			return -1;
+		p += str_copy("[" CONF_ZONE_SECTION " ", p, ENTRY_LINE_MAX_LEN);
+		p += str_copy(conf->name, p, ZONE_NAME_MAX_LEN);
+		p += str_copy("]\n", p, ENTRY_LINE_MAX_LEN);
+	}
+
+	for (size_t i = 0; i < CONF_ENTRIES; i++)
+	{
+		struct tcctl_conf_entry entry = tcctl_conf_entries[i];
+		const union tcctl_conf_field *field = (const union tcctl_conf_field *)
+			((const char *)conf + entry.offset);
+
+		// one line per value, sensor has one per path
+		for (unsigned int v = 0;; v++)
+		{
+			char val[SENSOR_PATH_MAX_LEN] = ZERO_STR;
+			int len = entry.write_fn(field, v, val);
+			if (len == -1)
+				break;
+
+			if (p - str + ENTRY_NAME_MAX_LEN + len + 2 > max_len)
+				return -1;
+			p += str_copy(entry.name, p, ENTRY_NAME_MAX_LEN);
+			*p++ = '\t';
+			p += str_copy(val, p, len + 1);
+			*p++ = '\n';
+		}
+	}
+
+	*p = '\0';
+	return p - str;
+}
+
+int
+tcctl_conf_parse(struct tcctl_ctx *ctx, const char *str)
+{
+	// top level entries are defaults for every zone
+	tcctl_conf_reset(&ctx->new_template);
+	ctx->new_conf = &ctx->new_template;
+	ctx->conf_stage->num = 0;
+
+	ctx->conf_errline = 0;
+	ctx->conf_errentid = -1;
+
+	for (;;)
+	{
+		str = tcctl_conf_read_next_line(ctx, str);
+		ctx->conf_errline++;
+		if (str == NULL)
+			return 0;
+
+		if (*str == '\0') break;
+	}
+
+	return tcctl_conf_zones_end(ctx);
+}
+
+int
+tcctl_conf_zones_end(struct tcctl_ctx *ctx)
+{
+	// no sections, the whole file is a single zone
+	if (ctx->conf_stage->num == 0)
+		ctx->conf_stage->zones[ctx->conf_stage->num++] = ctx->new_template;
+
+	for (unsigned int i = 0; i < ctx->conf_stage->num; i++)
+	{
+		struct tcctl_conf *conf = &ctx->conf_stage->zones[i];
+		if (conf->sensor.uint != 0)
+			continue;
+
+		conf->sensor = ctx->new_template.sensor;
+		for (unsigned int s = 0; s < conf->sensor.uint; s++)
+			path_read(
+					conf->sensor_path[s], 
+					ctx->new_template.sensor_path[s], 
+					SENSOR_PATH_MAX_LEN
+			);
+
+		if (conf->sensor.uint == 0)
+		{
+			conf->sensor.uint = 1;
+			path_read(conf->sensor_path[0], TEMP_PATH, SENSOR_PATH_MAX_LEN);
+		}
+	}
+
+	// all or nothing, the live conf stays on any bad zone
+	if (!tcctl_conf_set_check(ctx, ctx->conf_stage))
+		return 0;
+
+	tcctl_conf_publish(ctx);
+	return 1;
+}
+#else
+int
+tcctl_conf_baked(struct tcctl_ctx *ctx)
+{
+	LOG_INFO("conf baked in from: ", BAKED_CONF_PATH);
+	*ctx->conf_stage = tcctl_baked_set;
+	if (!tcctl_conf_set_check(ctx, ctx->conf_stage))
+		return 0;
+
+	tcctl_conf_publish(ctx);
+	return 1;
+}
+#endif
+
+int
+tcctl_conf_set_check(struct tcctl_ctx *ctx, const struct tcctl_conf_set *set)
+{
+	for (unsigned int i = 0; i < set->num; i++)
+	{
+		if (!tcctl_conf_check(ctx, &set->zones[i]) || !tcctl_conf_pins_check(ctx, set, i))
+			return 0;
+	}
+
+	return 1;
+}
+
+int
+tcctl_conf_pins_check(struct tcctl_ctx *ctx, const struct tcctl_conf_set *set, unsigned int zone_id)
+{
+	const struct tcctl_conf *conf = &set->zones[zone_id];
+	const char *err = NULL;
+
+	// one gpio commit drives all zones, two on a line undo each other every
+	// tick. zones may share a tach line, it is only read
+	for (unsigned int i = 0; i < set->num && err == NULL; i++)
+	{
+		const struct tcctl_conf *other = &set->zones[i];
+		if (i == zone_id)
+			continue;
+
+		if (conf->output_pin.uint != -1 && conf->output_pin.uint == other->output_pin.uint)
+		{
+			err = "output_pin of another zone too, zone: ";
+			ctx->conf_errentid = tcctl_conf_entry_id("output_pin");
+		}
+		else if (conf->tach_pin.uint != -1 && conf->tach_pin.uint == other->output_pin.uint)
+		{
+			err = "tach_pin is the output_pin of another zone, zone: ";
+			ctx->conf_errentid = tcctl_conf_entry_id("tach_pin");
+		}
+		else if (conf->output_pin.uint != -1 && conf->output_pin.uint == other->tach_pin.uint)
+		{
+			err = "output_pin is the tach_pin of another zone, zone: ";
+			ctx->conf_errentid = tcctl_conf_entry_id("output_pin");
+		}
+	}
+
+	if (err == NULL)
+		return 1;
+	ctx->conf_errline = 0;
+	LOG_ERROR(err, conf->name);
+	return 0;
+}
+
+int
+tcctl_conf_check(struct tcctl_ctx *ctx, const struct tcctl_conf *conf)
+{
+	const char *err = NULL;
+	ctx->conf_errline = 0;
+
+	if (conf->low_temp.uint > conf->trig_temp.uint)
+	{
+		err = "low_temp over trig_temp, zone: ";
+		ctx->conf_errentid = tcctl_conf_entry_id("low_temp");
+	}
+	else if (conf->hyst_dec_temp.uint >= conf->trig_temp.uint)
+	{
+		err = "hyst_dec_temp not under trig_temp, zone: ";
+		ctx->conf_errentid = tcctl_conf_entry_id("hyst_dec_temp");
+	}
+	else if (conf->load_trig.uint > 100)
+	{
+		err = "load_trig over 100, zone: ";
+		ctx->conf_errentid = tcctl_conf_entry_id("load_trig");
+	}
+	else if (conf->tach_pin.uint != -1 && conf->tach_pin.uint == conf->output_pin.uint)
+	{
+		err = "tach_pin is the output_pin, zone: ";
+		ctx->conf_errentid = tcctl_conf_entry_id("tach_pin");
+	}
+	else if (conf->tach_ppr.uint == 0)
+	{
+		err = "tach_ppr is 0, zone: ";
+		ctx->conf_errentid = tcctl_conf_entry_id("tach_ppr");
+	}
+	else if (ctx->io.conf_check != NULL && !ctx->io.conf_check(ctx->io.user, conf))
+	{
+		err = "gpio line not available, zone: ";
+		ctx->conf_errentid = tcctl_conf_entry_id("output_pin");
+	}
+
+	if (err == NULL)
+		return 1;
+	LOG_ERROR(err, conf->name);
+	return 0;
+}
+
+int
+tcctl_conf_entry_id(const char *name)
+{
+#ifndef TCCTL_BAKED
+	for (int i = 0; i < CONF_ENTRIES; i++)
+	{
+		if (str_eq(tcctl_conf_entries[i].name, name, ENTRY_NAME_MAX_LEN))
+			return i;
+	}
+#endif
+
+	// no names without the table
+	return -1;
+}
+
+void
+tcctl_conf_publish(struct tcctl_ctx *ctx)
+{
+	struct tcctl_conf_set *set = ctx->conf_stage;
+	set->gen = ++ctx->conf_gen;
+	ctx->conf_stage = ctx->conf_live;
+	ctx->conf_live = set;
+}
+
+#ifndef TCCTL_BAKED
+const char *
+tcctl_conf_entry_name(unsigned int id)
+{
+	return id < CONF_ENTRIES ? tcctl_conf_entries[id].name : NULL;
+}
+
+int
+tcctl_conf_field_get(const struct tcctl_conf *conf, unsigned int id, unsigned int *val)
+{
+	if (id >= CONF_ENTRIES)
+		return 0;
+
+	// sensor gives the path count
+	*val = (CONF_FIELD(conf, tcctl_conf_entries[id]))->uint;
+	return 1;
+}
+
+int
+tcctl_conf_field_set(struct tcctl_conf *conf, unsigned int id, unsigned int val)
+{
+	char str[SENSOR_PATH_MAX_LEN];
+
+	// paths do not fit a number
+	if (id >= CONF_ENTRIES || tcctl_conf_entries[id].read_fn == tcctl_get_sensor)
+		return 0;
+
+	struct tcctl_conf_entry entry = tcctl_conf_entries[id];
+	union tcctl_conf_field *field = CONF_FIELD(conf, entry);
+	union tcctl_conf_field old = *field;
+	field->uint = entry.read_fn == tcctl_get_boolean ? !!val : val;
+
+	// keywords take only what they can write back
+	if (entry.read_fn != tcctl_get_uint && entry.write_fn(field, 0, str) == -1)
+	{
+		*field = old;
+		return 0;
+	}
+
+	return 1;
+}
+
+int
+tcctl_conf_update(
+		struct tcctl_ctx *ctx,
+		unsigned int zone_id,
+		const struct tcctl_conf_update *updates,
+		unsigned int num
+)
+{
+	struct tcctl_conf_set *stage = ctx->conf_stage;
+	if (zone_id >= ctx->conf_live->num)
+		return 0;
+
+	// the live conf with the changes, checked and published like a parsed one
+	*stage = *ctx->conf_live;
+	ctx->conf_errline = 0;
+	for (unsigned int i = 0; i < num; i++)
+	{
+		if (!tcctl_conf_field_set(&stage->zones[zone_id], updates[i].id, updates[i].val))
+		{
+			ctx->conf_errentid = updates[i].id;
+			LOG_WARN("bad conf field update, zone: ", stage->zones[zone_id].name);
+			return 0;
+		}
+	}
+
+	if (
+		!tcctl_conf_check(ctx, &stage->zones[zone_id]) ||
+		!tcctl_conf_pins_check(ctx, stage, zone_id)
+	)
+		return 0;
+
+	tcctl_conf_publish(ctx);
+	return 1;
+}
+
+const char *
+tcctl_conf_read_section(struct tcctl_ctx *ctx, const char *conf_str)
+{
+	const char *p = conf_str + 1;
+	size_t len = str_len(CONF_ZONE_SECTION, ENTRY_NAME_MAX_LEN);
+	if (!str_eq(p, CONF_ZONE_SECTION, len) || !CONF_IS_WSPACE(p[len]))
+	{
+		tcctl_conf_log_error(ctx, "unknown conf section: ", "");
+		ctx->conf_errentid = CONF_ENTRIES;
+		return NULL;
+	}
+
+	if (ctx->conf_stage->num == ZONES_MAX)
+	{
+		tcctl_conf_log_error(ctx, "too many zones: ", "");
+		ctx->conf_errentid = CONF_ENTRIES;
+		return NULL;
+	}
+
+	p += len;
+	while (CONF_IS_WSPACE(*p))
+		p++;
+
+	// zone starts off the defaults read so far
+	struct tcctl_conf *conf = &ctx->conf_stage->zones[ctx->conf_stage->num++];
+	*conf = ctx->new_template;
+	conf->sensor.uint = 0;
+	ctx->new_conf = conf;
+
+	size_t name_len = 0;
+	while (p[name_len] != ']' && !CONF_IS_EOL(p[name_len]))
+		name_len++;
+	if (p[name_len] != ']' || name_len == 0 || name_len >= ZONE_NAME_MAX_LEN)
+	{
+		tcctl_conf_log_error(ctx, "malformed zone name: ", "");
+		ctx->conf_errentid = CONF_ENTRIES;
+		return NULL;
+	}
+
+	conf->name[str_copy(p, conf->name, name_len + 1)] = '\0';
+	LOG_INFO("conf load zone: ", conf->name);
+
+	p += name_len + 1;
+	while (CONF_IS_WSPACE(*p))
+		p++;
+	return *p == '\n' ? p + 1 : p;
+}
+
+const char *
+tcctl_conf_read_next_line(struct tcctl_ctx *ctx, const char *conf_str)
+{
+	const char *p = conf_str;
+	while (CONF_IS_WSPACE(*p))
+		p++;
+
+	if (*p == '\n')
+		return p + 1;
+
+	if (*p == '\0')
+		return p;
+
+	if (*p == '[')
+		return tcctl_conf_read_section(ctx, p);
+
+	for (size_t i = 0; i < CONF_ENTRIES; i++)
+	{
+		struct tcctl_conf_entry entry = tcctl_conf_entries[i];
+		size_t len = str_len(entry.name, ENTRY_NAME_MAX_LEN);
+		if (str_eq(p, entry.name, len))
+		{
+			p += len;
+			while (CONF_IS_WSPACE(*p)) 
+				p++;
+			int next = entry.read_fn(CONF_FIELD(ctx->new_conf, entry), p);
+			tcctl_conf_log_load(
+					"conf load entry: ", 
+					entry.name,
+					p,
+					next + 1
+			);
+			ctx->conf_errentid = i; // just in case
+			if (next == -1)
+			{
+				tcctl_conf_log_error(
+						ctx,
+						"malformed conf entry: ", 
+						entry.name
+				);
+				return NULL;
+			}
+
+			return p+next+1;
+		}
+	}
+
+	tcctl_conf_log_error(ctx, "unknown conf entry: ", "");
+	ctx->conf_errline = 0;
+	ctx->conf_errentid = CONF_ENTRIES;
+	return NULL;
+}
+
+int
+tcctl_get_uint(union tcctl_conf_field *field, const char *val)
+{
+	return uint_read(&field->uint, val);
+}
+
+int
+tcctl_get_boolean(union tcctl_conf_field *field, const char *val)
+{
+	return boolean_read(&field->boolean, val);
+}
+
+static const char *gpio_bias_words[] = { "none", "pull-down", "pull-up" };
+static const char *gpio_drive_words[] = 
+{ 
+	"push-pull", "open-drain", "open-source" 
+};
+
+static const char *policy_words[] = { "hyst", "on", "off", "model" };
+
+int
+tcctl_get_policy(union tcctl_conf_field *field, const char *val)
+{
+	return keyword_read(&field->uint, val, policy_words, 4);
+}
+
+int
+tcctl_get_sensor(union tcctl_conf_field *field, const char *val)
+{
+	// sensor count field, paths are kept alongside in the same conf
+	struct tcctl_conf *conf = (struct tcctl_conf *)
+		((char *)field - offsetof(struct tcctl_conf, sensor));
+
+	if (field->uint >= ZONE_SENSORS_MAX)
+	{
+		LOG_WARN("too many sensors: ", val);
+		return -1;
+	}
+
+	int len = path_read(conf->sensor_path[field->uint], val, SENSOR_PATH_MAX_LEN);
+	if (len > 0)
+		field->uint++;
+	return len;
+}
+
+int
+tcctl_put_uint(const union tcctl_conf_field *field, unsigned int i, char *val)
+{
+	// all ones is unset (output_pin)
+	if (i > 0 || field->uint == (unsigned int)-1)
+		return -1;
+	return uint_write(field->uint, val);
+}
+
+int
+tcctl_put_boolean(const union tcctl_conf_field *field, unsigned int i, char *val)
+{
+	return i > 0 ? -1 : boolean_write(field->boolean, val);
+}
+
+int
+tcctl_put_policy(const union tcctl_conf_field *field, unsigned int i, char *val)
+{
+	if (i > 0 || field->uint >= 4)
+		return -1;
+	return str_copy(policy_words[field->uint], val, ENTRY_NAME_MAX_LEN);
+}
+
+int
+tcctl_put_sensor(const union tcctl_conf_field *field, unsigned int i, char *val)
+{
+	const struct tcctl_conf *conf = (const struct tcctl_conf *)
+		((const char *)field - offsetof(struct tcctl_conf, sensor));
+
+	if (i >= field->uint)
+		return -1;
+	return str_copy(conf->sensor_path[i], val, SENSOR_PATH_MAX_LEN);
+}
+
+int
+tcctl_put_bias(const union tcctl_conf_field *field, unsigned int i, char *val)
+{
+	if (i > 0 || field->uint >= 3)
+		return -1;
+	return str_copy(gpio_bias_words[field->uint], val, ENTRY_NAME_MAX_LEN);
+}
+
+int
+tcctl_put_drive(const union tcctl_conf_field *field, unsigned int i, char *val)
+{
+	if (i > 0 || field->uint >= 3)
+		return -1;
+	return str_copy(gpio_drive_words[field->uint], val, ENTRY_NAME_MAX_LEN);
+}
+
+int
+tcctl_get_bias(union tcctl_conf_field *field, const char *val)
+{
+	return keyword_read(&field->uint, val, gpio_bias_words, 3);
+}
+
+int
+tcctl_get_drive(union tcctl_conf_field *field, const char *val)
+{
+	return keyword_read(&field->uint, val, gpio_drive_words, 3);
+}
+#endif
@@ -0,0 +1,806 @@
+#ifndef _LIBTCCTL_H_
+#define _LIBTCCTL_H_
+
+#include <stddef.h>
+#include <time.h>
+
+#include "tcctl_sdt.h"
+
+#define TEMP_PATH "/sys/class/thermal/thermal_zone0/temp"
+#define THERMAL_ZONE_MARK "thermal_zone"
+#define TEMP_BUF_MAX_LEN 64
+
+#define ENTRY_NAME_MAX_LEN 64
+#define ENTRY_LINE_MAX_LEN 16
+#define MSG_MAX_LEN 512
+#define TIME_BUF_LEN 16
+#define TEMP_BUF_LEN 8
+
+#define ZONES_MAX 4
+#define ZONE_NAME_MAX_LEN 16
+#define ZONE_SENSORS_MAX 4
+#define ZONE_DEFAULT_NAME "main"
+#define SENSOR_PATH_MAX_LEN 96
+#define CONF_ZONE_SECTION "zone"
+#define TIMERS_MAX 8
+
+#define SIM_MODEL "model"
+#define SIM_LOAD_PERIOD_MS 600000
+#define MODEL_STEP_MS 1000
+
+#define REC_MAGIC "tcctlrc2"
+#define REC_MAGIC_V1 "tcctlrec" // records end before rpm
+#define REC_MAGIC_LEN 8
+#define REPLAY_TEMP_MARK "current temperature: "
+#define REPLAY_TICK_MARK "tick> d"
+#define REPLAY_GAP_MS 60000
+
+#define LOAD_STAT_PATH "/proc/stat"
+#define LOAD_FREQ_PATH "/sys/devices/system/cpu/cpu"
+#define LOAD_CPUS_MAX 16
+#define LOAD_BUF_LEN 256
+#define LOAD_THROTTLE_FREQ 900 // permille of the max clock
+
+#define TACH_SPINUP_MS 5000 // fan on before a low speed counts as a stall
+
+#define FIT_FORGET 0.9995
+#define FIT_P_INIT 1000.0
+#define FIT_SAMPLES_MIN 30
+#define FIT_DT_JITTER 10 // % of the tick
+
+#define TUNE_PARAMS 3
+#define TUNE_JOBS_MAX 64
+
+#define RC_VERSION 2 // 2 - INFO and CERR back on 6 and 7, newer commands after
+#define RC_ABSTRACT '@' // socket names starting with it have no file
+#define RC_BATCH_MAX 16
+#define CLIENT_INFLIGHT_MAX 64
+#define CLIENT_RETRY_MS 250
+#define CLIENT_TRIES_MAX 4
+
+#define SNAP_MAGIC "tcctlsnp"
+#define SNAP_MAGIC_LEN 8
+#define SNAP_VERSION 1
+#define SNAP_COUNTERS 8
+#define SNAP_MAX_AGE_MS 300000 // older state is not worth restoring
+#define SNAP_SYNC_MS 60000
+
+#define ZERO_STR { '\0' }
+
+#define CONF_IS_WSPACE(C) (C == ' ' || C == '\t')
+#define CONF_IS_EOL(C) (C == '\n' || C == '\0')
+
+#define LSTR(V) _LSTR(V)
+#define _LSTR(V) #V
+#define LOG_INFO(MSG, VAL) tcctl_log_info(MSG, VAL, __FUNCTION__, 0)
+#define LOG_WARN(MSG, VAL) tcctl_log_info(MSG, VAL, __FUNCTION__, 1)
+#define LOG_ERROR(MSG, VAL) tcctl_log_error(MSG, VAL, __FUNCTION__, LSTR(__LINE__))
+#define STDOUT_PRINT(MSG) tcctl_stdout_write(MSG);
+
+enum tcctl_phase
+{
+	LOW_TEMP,  // temperature below threshold (always off)
+	IDLE,      // ready for cooling
+	RUN,       // cooling
+	HIGH_TEMP, // temperature above threshold (always on)
+	OVRD_IDLE, // start and stay idle
+	OVRD_RUN,  // start and stay running
+	FAIL       // failure
+};
+
+enum tcctl_policy
+{
+	POLICY_HYST, // follow the phases
+	POLICY_ON,   // always on
+	POLICY_OFF,  // always off
+	POLICY_MODEL // run as long as the fitted model says
+};
+
+enum tcctl_stat_param
+{
+	STAT_LAST_TEMP,
+	STAT_LOW_TEMP,
+	STAT_TRIG_TEMP,
+	STAT_PHASE,
+	STAT_ZONES,  // number of zones, any zone id
+	STAT_OUTPUT, // fan on
+	STAT_TAU_OFF, // fitted time constants, s
+	STAT_TAU_ON,
+	STAT_EQ_OFF,  // fitted equilibrium temperatures, mC
+	STAT_EQ_ON,
+	STAT_RUN_TIME, // fan on time to trig_temp - hyst_dec_temp, s
+	STAT_CPU_LOAD, // %, any zone id
+	STAT_CPU_FREQ, // average clock, MHz, any zone id
+	STAT_THROTTLED, // busy but below LOAD_THROTTLE_FREQ
+	STAT_HINT,      // s until the heat hint expires, 0 - none
+	STAT_RC_DROPPED, // messages over a client rate limit, any zone id
+	STAT_RC_DEFERRED, // passes that left messages queued for budget
+	STAT_TICKS,       // loop passes a zone was due, any zone id
+	STAT_TICK_LATE,   // us past the deadline summed over those passes
+	STAT_TICK_LATE_MAX,
+	STAT_RPM,         // fan speed from the tach, 0 - none or stopped
+	STAT_STALLS       // fan stalls seen since start
+};
+
+struct tcctl_stat
+{
+	unsigned int last_temp;
+	unsigned int last_mtemp; // mC
+	unsigned int low_temp;
+	unsigned int trig_temp;
+
+	enum tcctl_phase phase;
+};
+
+union tcctl_conf_field
+{
+	unsigned int uint;
+	int boolean;
+};
+
+struct tcctl_conf_entry
+{
+	const char *name;
+	size_t offset; // of the field in struct tcctl_conf
+	int (*read_fn)(union tcctl_conf_field *field, const char *val);
+	// i-th value of the entry, -1 past the last one
+	int (*write_fn)(const union tcctl_conf_field *field, unsigned int i, char *val);
+};
+
+struct tcctl_conf
+{
+	union tcctl_conf_field low_temp;       // never run below that temperature
+	union tcctl_conf_field trig_temp;      // start cooling when reached
+	union tcctl_conf_field hyst_dec_temp;  // minimal temp drop to stop
+
+	union tcctl_conf_field update_delay;   // time between updates
+	union tcctl_conf_field output_pin;     // output pin to the switch
+	union tcctl_conf_field output_bias;    // none, pull-down or pull-up
+	union tcctl_conf_field output_drive;   // push-pull, open-drain or open-source
+	union tcctl_conf_field reassert_delay; // rewrite unchanged pin after (0 - never)
+
+	union tcctl_conf_field stay_on;    	// fan on after exit
+	union tcctl_conf_field stop;       	// stop the temperature control
+	union tcctl_conf_field pin_invert; 	// invert pin (for p-mosfets)
+
+	union tcctl_conf_field load_trig;    // cpu load % that starts the fan (0 - off)
+	union tcctl_conf_field load_sustain; // for that long, s
+
+	union tcctl_conf_field policy;     	// hyst, on, off or model
+	union tcctl_conf_field sensor;     	// number of sensor paths
+
+	union tcctl_conf_field tach_pin;   	// fan tach input pin (-1 - none)
+	union tcctl_conf_field tach_ppr;   	// tach pulses per revolution
+	union tcctl_conf_field stall_rpm;  	// fan on and slower is a stall
+
+	char name[ZONE_NAME_MAX_LEN];
+	char sensor_path[ZONE_SENSORS_MAX][SENSOR_PATH_MAX_LEN];
+};
+
+// T[k+1] = a T[k] + b in C, a by recursive least squares on the
+// differences (b drops out, it follows the load), b averaged after it
+struct tcctl_rls
+{
+	double a;
+	double p;                   // variance of a
+	double b;
+	unsigned int samples;
+};
+
+// first order model of a zone, one fit per fan state
+struct tcctl_fit
+{
+	struct tcctl_rls rls[2];
+	unsigned long long dt;      // tick the fits hold for, ms
+	unsigned long long last_ms;
+	unsigned int last_mtemp;
+	double last_diff;           // T[k] - T[k-1]
+	int last_on;
+	int started;
+	int has_diff;
+};
+
+struct tcctl_zone
+{
+	struct tcctl_conf conf;
+	struct tcctl_stat stat;
+	int is_on;
+
+	struct tcctl_fit fit;
+	unsigned long long run_until; // model policy stop time, 0 - none
+
+	int load_busy;                // over load_trig since load_since
+	unsigned long long load_since;
+	int throttled;
+
+	unsigned int hint_load;       // expected load %, 0 - no hint
+	unsigned long long hint_start, hint_end;
+	int hinted;                   // inside the hint window this tick
+
+	unsigned int rpm;             // last tach reading
+	unsigned long long spin_since; // fan seen on since, 0 - off
+	int stalled;
+	unsigned int stalls;
+};
+
+// cpu feed-forward, read once per tick for all zones
+struct tcctl_load
+{
+	unsigned int util; // permille busy since the last read
+	unsigned int freq; // permille of the max clock
+	unsigned int khz;  // average clock
+	int ok;
+};
+
+struct timer
+{
+	unsigned long long deadline; // monotonic ms
+	unsigned int id;
+};
+
+struct timer_heap
+{
+	unsigned int num;
+	struct timer nodes[TIMERS_MAX];
+};
+
+// everything the engine does to the outside world
+struct tcctl_io
+{
+	void *user;
+	// attach a zone sensor to path, detach on NULL path
+	int (*sensor_open)(void *user, unsigned int zone, unsigned int sensor, const char *path);
+	// temperatures in mC, like sysfs
+	int (*sensor_read)(void *user, unsigned int zone, unsigned int sensor, unsigned int *temp);
+	int (*output_write)(void *user, unsigned int zone, int is_on);
+	unsigned long long (*clock_ms)(void *user);
+	// cpu load and clock, optional
+	int (*load_read)(void *user, struct tcctl_load *load);
+	// reject a parsed zone conf the outside can not serve, optional
+	int (*conf_check)(void *user, const struct tcctl_conf *conf);
+	// fan speed of a zone with a tach_pin, optional
+	int (*tach_read)(void *user, unsigned int zone, unsigned int *rpm);
+};
+
+// one field of a zone conf by tcctl_conf_entries index
+struct tcctl_conf_update
+{
+	unsigned int id;
+	unsigned int val;
+};
+
+// every zone of one conf file, swapped in as a whole
+struct tcctl_conf_set
+{
+	struct tcctl_conf zones[ZONES_MAX];
+	unsigned int num;
+	unsigned int gen;
+};
+
+struct tcctl_ctx
+{
+	struct tcctl_io io;
+
+	struct tcctl_zone zones[ZONES_MAX];
+	unsigned int zones_num;
+	struct timer_heap timers;
+	struct tcctl_load load;
+
+	// parser fills the stage, a valid stage is swapped live and gets
+	// a new generation, tcctl_zones_apply applies each generation once
+	struct tcctl_conf_set conf_sets[2], *conf_live, *conf_stage;
+	struct tcctl_conf new_template, *new_conf;
+	unsigned int conf_gen, zones_gen;
+	unsigned int zones_retry; // zones with sensors left to open, a bit each
+	int conf_errline, conf_errentid;
+};
+
+// first order thermal model, all temperatures in mC
+struct tcctl_model
+{
+	int temp;
+	int ambient;
+	int heat;              // rise over ambient at full load, fan off
+	unsigned int cool;     // permille of the rise left with fan on
+	unsigned int tau_off;  // time constants, ms
+	unsigned int tau_on;
+	unsigned int load;     // permille
+};
+
+struct tcctl_sim_zone
+{
+	struct tcctl_model model;
+	unsigned long long step_ms;   // model integrated up to
+	const char *script;           // current line of the script
+	unsigned int script_sec;
+
+	int fan;                      // in-memory output line
+	unsigned long long fan_since;
+	unsigned long long on_ms;
+	unsigned int switches;
+	unsigned int max_temp;
+};
+
+// fake sensors, outputs and clock for struct tcctl_io
+struct tcctl_sim
+{
+	struct tcctl_ctx *ctx;
+	unsigned long long now;       // virtual clock, ms
+	unsigned long long end;
+	unsigned int speed;           // times real time (0 - as fast as possible)
+	unsigned long long real_start;
+	unsigned int seed;
+	int trace;
+
+	// scripted source, one mC value per second, model if NULL
+	const char *script, *script_end;
+	// model load per second (permille), random if NULL
+	const unsigned short *loads;
+	size_t loads_num;
+	unsigned long long stall_at;  // fans stop turning, ms (0 - never)
+
+	struct tcctl_sim_zone zones[ZONES_MAX];
+};
+
+// one zone tick of a binary capture, after a REC_MAGIC header
+struct tcctl_rec
+{
+	unsigned long long ms;   // monotonic
+	unsigned int zone;
+	unsigned int temp;       // the one the decision was made on
+	unsigned int rpm;        // 0 - no tach
+};
+
+#define REC_V1_LEN offsetof(struct tcctl_rec, rpm)
+
+struct tcctl_replay_zone
+{
+	unsigned long long since;     // last sample, ms
+	int started;
+	unsigned long long total_ms;  // gaps over REPLAY_GAP_MS left out
+	unsigned long long on_ms;
+	unsigned long long above_ms;  // at or over trig_temp
+	unsigned int samples;
+	unsigned int transitions;
+	unsigned int switches;
+};
+
+// recorded samples pushed through tcctl_update
+struct tcctl_replay
+{
+	struct tcctl_ctx *ctx;
+	unsigned long long now;       // time of the current sample
+	unsigned int temp;            // the current sample itself
+	unsigned int rpm;             // of the current sample
+	int has_rpm;                  // the capture records fan speeds
+	unsigned long long day;       // wall clock wraps of a text log
+	unsigned long long last_wall;
+	int trace;
+
+	struct tcctl_replay_zone zones[ZONES_MAX];
+};
+
+struct tcctl_tune_cand
+{
+	unsigned int low_temp;
+	unsigned int trig_temp;
+	unsigned int hyst_dec_temp;
+};
+
+struct tcctl_tune_score
+{
+	struct tcctl_tune_cand cand;
+	int valid;
+	int front;              // not dominated by any other
+	unsigned int peak;      // all objectives are minimized
+	unsigned int over_s;    // time at or over the limit
+	unsigned int switches;
+	unsigned int duty;      // %
+};
+
+// load of one run, the random model if loads is NULL
+struct tcctl_tune_src
+{
+	const unsigned short *loads;
+	size_t loads_num;
+	unsigned long long end; // ms
+};
+
+struct tcctl_tune
+{
+	struct tcctl_conf base;
+	unsigned int limit;
+	unsigned int range[TUNE_PARAMS][2];  // low, trig, hyst: min and max
+	const struct tcctl_tune_src *srcs;
+	unsigned int srcs_num;
+
+	unsigned int cands_num;
+	unsigned int next;                   // shared by the workers
+	struct tcctl_tune_score *scores;     // cands_num of them
+};
+
+// everything one evaluation touches, one per thread
+struct tcctl_tune_work
+{
+	struct tcctl_tune *tune;
+	struct tcctl_ctx ctx;
+	struct tcctl_sim sim;
+};
+
+enum tcctl_rc_cmd
+{
+	// client commands, all but CONF and KILL are zone addressed
+	STAT, // get status     | p1 <- parameter id  | p2 <- n/a
+	OVRD, // force run/hold | p1 <- on/off        | p2 <- n/a
+	AUTO, // automatic mode | p1 <- n/a           | p2 <- n/a
+	TRIG, // trigger temps  | p1 <- low temp      | p2 <- trigger temp
+	CONF, // reload conf    | p1 <- n/a           | p2 <- n/a
+	KILL, // kill service   | p1 <- n/a           | p2 <- n/a
+	// service responses, one per request
+	INFO, // return status  | p1 <- parameter id  | p2 <- return value
+	CERR, // conf error     | p1 <- conf line     | p2 <- conf entry id
+	// added later, appended only so no value ever moves
+	HINT, // heat ahead     | p1 <- load %        | p2 <- start in s  | p3 <- duration s
+	GET,  // conf field     | p1 <- conf entry id | p2 <- n/a
+	SET,  // conf field     | p1 <- conf entry id | p2 <- value       | p3 <- write back
+	SETB, // conf fields    | struct tcctl_rc_batch, applied all or none
+	CVAL, // conf field     | p1 <- conf entry id | p2 <- value       (response)
+	ACK,  // done/refused   | p1 <- request cmd   | p2 <- n/a         (response)
+	UPGRADE // re-exec the binary at the same path, state and fds kept
+};
+
+enum tcctl_rc_status
+{
+	RC_OK,
+	RC_EMSG,     // malformed datagram
+	RC_EVERSION, // other protocol version, reply carries ours
+	RC_ECMD,     // unknown command
+	RC_EZONE,    // no such zone
+	RC_ECONF     // conf rejected, the reply is CERR
+};
+
+// starts every datagram, replies echo seq
+struct tcctl_rc_head
+{
+	unsigned short version;
+	unsigned short status; // replies only
+	unsigned int seq;
+	enum tcctl_rc_cmd cmd;
+	unsigned int zone;
+};
+
+union tcctl_rc_param
+{
+	unsigned int uint;
+	int sint;
+	int boolean;
+};
+
+struct tcctl_rc_msg
+{
+	struct tcctl_rc_head head;
+	union tcctl_rc_param p1, p2, p3;
+};
+
+// several SET in one datagram, sized by num
+struct tcctl_rc_batch
+{
+	struct tcctl_rc_head head;
+	unsigned int num;
+	int write_back;
+	struct tcctl_conf_update sets[RC_BATCH_MAX];
+};
+
+union tcctl_rc_buf
+{
+	struct tcctl_rc_head head;
+	struct tcctl_rc_msg msg;
+	struct tcctl_rc_batch batch;
+};
+
+enum tcctl_client_state
+{
+	REQ_FREE,
+	REQ_SENT, // waiting for the reply, resent on timeout
+	REQ_DONE,
+	REQ_LOST  // out of tries
+};
+
+struct tcctl_client_req
+{
+	enum tcctl_client_state state;
+	unsigned int tries;
+	unsigned long long sent_ms;
+	size_t len;
+	union tcctl_rc_buf buf;   // kept for resends
+	struct tcctl_rc_msg reply;
+};
+
+// requests in flight by seq, replies matched in any order
+struct tcctl_client
+{
+	int fd;
+	unsigned int seq;         // of the next request
+	unsigned int pending;
+	struct tcctl_client_req reqs[CLIENT_INFLIGHT_MAX];
+};
+
+// a trip point crossing as thermal netlink reports it, also the datagram
+// the daemon takes on its --trip-socket
+struct tcctl_trip
+{
+	unsigned int tz;     // thermal_zone<tz>
+	unsigned int trip;   // trip point id
+	int up;              // crossed on the way up
+	int temp;            // mC, 0 - not reported
+};
+
+// zone state worth keeping across a restart, times relative to the snapshot
+struct tcctl_snap_zone
+{
+	char name[ZONE_NAME_MAX_LEN];
+	unsigned int conf_low_temp;   // runtime TRIG values hold for this conf only
+	unsigned int conf_trig_temp;
+	struct tcctl_stat stat;
+	int is_on;
+	unsigned long long run_left;  // ms of the planned model run, 0 - none
+	unsigned int hint_load;
+	unsigned long long hint_start_in, hint_end_in;
+	unsigned long long fit_dt;
+	struct tcctl_rls rls[2];
+};
+
+// fixed size, mapped from a file and rewritten in place
+struct tcctl_snap
+{
+	char magic[SNAP_MAGIC_LEN];
+	unsigned int version;
+	unsigned long long hash;      // of everything after it, a torn write fails it
+	unsigned long long wall_ms;   // realtime the snapshot was taken at
+	unsigned int zones_num;
+	unsigned int counters[SNAP_COUNTERS]; // the user's own
+	struct tcctl_snap_zone zones[ZONES_MAX];
+};
+
+void tcctl_ctx_init(struct tcctl_ctx *, const struct tcctl_io *);
+int tcctl_ctx_run(struct tcctl_ctx *);
+int tcctl_ctx_next(struct tcctl_ctx *, unsigned long long *);
+void tcctl_ctx_kick(struct tcctl_ctx *, unsigned int);
+int tcctl_ctx_sync(struct tcctl_ctx *);
+void tcctl_ctx_prime(struct tcctl_ctx *);
+unsigned int tcctl_ctx_trip(struct tcctl_ctx *, unsigned int);
+int tcctl_ctx_load_wanted(struct tcctl_ctx *);
+
+int tcctl_update(struct tcctl_ctx *, unsigned int);
+int tcctl_update_model(struct tcctl_zone *, int, unsigned long long);
+int tcctl_update_load(struct tcctl_ctx *, unsigned int, unsigned long long);
+int tcctl_update_hint(struct tcctl_zone *, unsigned long long);
+void tcctl_update_tach(struct tcctl_ctx *, unsigned int, unsigned long long);
+void tcctl_zone_hint(struct tcctl_ctx *, unsigned int, unsigned int, unsigned int, unsigned int);
+const char *tcctl_phase_name(enum tcctl_phase);
+size_t tcctl_rec_len(const char *, size_t);
+
+int tcctl_zone_temp_read(struct tcctl_ctx *, unsigned int, unsigned int *);
+int tcctl_zone_prime(struct tcctl_ctx *, unsigned int);
+void tcctl_zone_trip(struct tcctl_ctx *, unsigned int);
+int tcctl_sensor_tz(const char *);
+int tcctl_zone_sensors_open(struct tcctl_ctx *, unsigned int, struct tcctl_conf *);
+int tcctl_zones_apply(struct tcctl_ctx *);
+
+unsigned int tcctl_stat_get(struct tcctl_ctx *, unsigned int, unsigned int);
+unsigned int tcctl_stat_run_time(struct tcctl_zone *);
+unsigned int tcctl_stat_hint(struct tcctl_ctx *, struct tcctl_zone *);
+void tcctl_stat_update(struct tcctl_stat *, struct tcctl_conf *);
+
+void tcctl_conf_reset(struct tcctl_conf *);
+void tcctl_conf_apply(struct tcctl_conf *, struct tcctl_conf *);
+void tcctl_conf_log_error(struct tcctl_ctx *, const char *msg, const char *entry);
+int tcctl_conf_set_write(const struct tcctl_conf_set *, char *, size_t);
+int tcctl_conf_write(const struct tcctl_conf *, int, char *, size_t);
+int tcctl_conf_parse(struct tcctl_ctx *, const char *);
+int tcctl_conf_zones_end(struct tcctl_ctx *);
+int tcctl_conf_set_check(struct tcctl_ctx *, const struct tcctl_conf_set *);
+int tcctl_conf_pins_check(struct tcctl_ctx *, const struct tcctl_conf_set *, unsigned int);
+int tcctl_conf_check(struct tcctl_ctx *, const struct tcctl_conf *);
+int tcctl_conf_entry_id(const char *);
+const char *tcctl_conf_entry_name(unsigned int);
+int tcctl_conf_baked(struct tcctl_ctx *);
+void tcctl_conf_publish(struct tcctl_ctx *);
+int tcctl_conf_field_get(const struct tcctl_conf *, unsigned int, unsigned int *);
+int tcctl_conf_field_set(struct tcctl_conf *, unsigned int, unsigned int);
+int tcctl_conf_update(
+		struct tcctl_ctx *,
+		unsigned int,
+		const struct tcctl_conf_update *,
+		unsigned int
+);
+const char * tcctl_conf_read_section(struct tcctl_ctx *, const char *);
+const char * tcctl_conf_read_next_line(struct tcctl_ctx *, const char *);
+
+int tcctl_get_uint(union tcctl_conf_field *, const char *);
+int tcctl_get_boolean(union tcctl_conf_field *, const char *);
+int tcctl_get_policy(union tcctl_conf_field *, const char *);
+int tcctl_get_sensor(union tcctl_conf_field *, const char *);
+int tcctl_get_bias(union tcctl_conf_field *, const char *);
+int tcctl_get_drive(union tcctl_conf_field *, const char *);
+int tcctl_put_uint(const union tcctl_conf_field *, unsigned int, char *);
+int tcctl_put_boolean(const union tcctl_conf_field *, unsigned int, char *);
+int tcctl_put_policy(const union tcctl_conf_field *, unsigned int, char *);
+int tcctl_put_sensor(const union tcctl_conf_field *, unsigned int, char *);
+int tcctl_put_bias(const union tcctl_conf_field *, unsigned int, char *);
+int tcctl_put_drive(const union tcctl_conf_field *, unsigned int, char *);
+
+void tcctl_fit_update(
+	struct tcctl_fit *,
+	unsigned long long,
+	unsigned long long,
+	unsigned int,
+	int
+);
+void tcctl_rls_reset(struct tcctl_rls *);
+void tcctl_rls_update(struct tcctl_rls *, double, double, double, double);
+int tcctl_fit_valid(const struct tcctl_fit *, int);
+unsigned int tcctl_fit_tau(const struct tcctl_fit *, int);
+unsigned int tcctl_fit_eq(const struct tcctl_fit *, int);
+int tcctl_fit_run_ms(const struct tcctl_fit *, unsigned int, unsigned int, unsigned long long *);
+double tcctl_ln(double);
+
+void tcctl_model_reset(struct tcctl_model *);
+void tcctl_model_step(struct tcctl_model *, int, unsigned int);
+
+void tcctl_sim_init(struct tcctl_sim *, struct tcctl_ctx *, unsigned int);
+void tcctl_sim_io(struct tcctl_sim *, struct tcctl_io *);
+void tcctl_sim_script(struct tcctl_sim *, const char *, size_t);
+int tcctl_sim_advance(struct tcctl_sim *, unsigned long long);
+unsigned long long tcctl_sim_clock_ms(void *);
+unsigned int tcctl_sim_rand(struct tcctl_sim *);
+int tcctl_sim_sensor_open(void *, unsigned int, unsigned int, const char *);
+int tcctl_sim_script_read(
+	struct tcctl_sim *,
+	struct tcctl_sim_zone *,
+	unsigned long long,
+	unsigned int *
+);
+void tcctl_sim_model_advance(struct tcctl_sim *, struct tcctl_sim_zone *, unsigned long long);
+int tcctl_sim_sensor_read(void *, unsigned int, unsigned int, unsigned int *);
+int tcctl_sim_load_read(void *, struct tcctl_load *);
+int tcctl_sim_output_write(void *, unsigned int, int);
+int tcctl_sim_tach_read(void *, unsigned int, unsigned int *);
+void tcctl_sim_trace(struct tcctl_sim *, unsigned int, unsigned long long);
+void tcctl_sim_report(struct tcctl_sim *);
+
+void tcctl_replay_init(struct tcctl_replay *, struct tcctl_ctx *);
+void tcctl_replay_io(struct tcctl_replay *, struct tcctl_io *);
+int tcctl_replay_sample(
+	struct tcctl_replay *,
+	unsigned int,
+	unsigned long long,
+	unsigned int
+);
+int tcctl_replay_parse(
+	struct tcctl_replay *,
+	const char *,
+	unsigned long long *,
+	unsigned int *,
+	int *
+);
+int tcctl_replay_line(struct tcctl_replay *, const char *);
+int tcctl_replay_text(struct tcctl_replay *, const char *, size_t);
+int tcctl_replay_bin(struct tcctl_replay *, const char *, size_t);
+unsigned long long tcctl_replay_clock_ms(void *);
+int tcctl_replay_sensor_open(void *, unsigned int, unsigned int, const char *);
+int tcctl_replay_sensor_read(void *, unsigned int, unsigned int, unsigned int *);
+int tcctl_replay_output_write(void *, unsigned int, int);
+int tcctl_replay_tach_read(void *, unsigned int, unsigned int *);
+void tcctl_replay_trace(struct tcctl_replay *, unsigned int);
+void tcctl_replay_report(struct tcctl_replay *);
+
+void tcctl_tune_init(struct tcctl_tune *, const struct tcctl_conf *);
+unsigned int tcctl_tune_cands(struct tcctl_tune *);
+int tcctl_tune_cand(struct tcctl_tune *, unsigned int, struct tcctl_tune_cand *);
+void tcctl_tune_eval(struct tcctl_tune_work *, unsigned int);
+void tcctl_tune_run(struct tcctl_tune_work *);
+int tcctl_tune_dominates(const struct tcctl_tune_score *, const struct tcctl_tune_score *);
+unsigned int tcctl_tune_front(struct tcctl_tune *);
+unsigned long long tcctl_tune_cost(const struct tcctl_tune_score *, unsigned long long);
+int tcctl_tune_pick(struct tcctl_tune *, unsigned int);
+unsigned short tcctl_tune_load(unsigned int);
+
+void tcctl_log_set(int, int);
+void tcctl_log_writeln(const char **, size_t);
+void tcctl_log_info(const char *, const char *, const char *, int);
+void tcctl_log_error(const char *, const char *,  const char *, const char *);
+void tcctl_stdout_write(const char *);
+
+int tcctl_client_open(struct tcctl_client *, const char *);
+void tcctl_client_close(struct tcctl_client *);
+int tcctl_client_send(struct tcctl_client *, union tcctl_rc_buf *, size_t, unsigned int *);
+int tcctl_client_msg(
+		struct tcctl_client *,
+		enum tcctl_rc_cmd,
+		unsigned int,
+		unsigned int,
+		unsigned int,
+		unsigned int,
+		unsigned int *
+);
+int tcctl_client_poll(struct tcctl_client *, unsigned int);
+void tcctl_client_recv(struct tcctl_client *);
+void tcctl_client_resend(struct tcctl_client *, unsigned long long);
+int tcctl_client_resendable(enum tcctl_rc_cmd);
+int tcctl_client_result(struct tcctl_client *, unsigned int, struct tcctl_rc_msg *);
+
+const struct tcctl_snap_zone *tcctl_snap_zone(const struct tcctl_snap *, const char *);
+unsigned long long tcctl_snap_left(unsigned long long, unsigned long long);
+void tcctl_snap_take(struct tcctl_ctx *, struct tcctl_snap *, unsigned long long);
+unsigned long long tcctl_snap_hash(const struct tcctl_snap *);
+int tcctl_snap_valid(const struct tcctl_snap *, unsigned long long);
+unsigned int tcctl_snap_restore(struct tcctl_ctx *, const struct tcctl_snap *, unsigned long long);
+
+int str_eq(const char *, const char *, size_t);
+size_t str_copy(const char *, char *, size_t);
+size_t str_set(char, char *, size_t);
+size_t str_len(const char *, size_t);
+size_t str_join(char *, char *, size_t);
+const char *str_find(const char *, const char *, size_t);
+unsigned long long str_hash(const char *, size_t);
+
+int uint_scan(unsigned int *, const char *);
+int uint_read(unsigned int *, const char *);
+int uint_write(unsigned int, char *);
+int uint_write_pad(unsigned int val, char *str, size_t len);
+int boolean_read(int *, const char *);
+int boolean_write(int, char *);
+int path_read(char *, const char *, size_t);
+int keyword_read(unsigned int *, const char *, const char **, size_t);
+
+int time_write(char *);
+int time_write_ms(unsigned long long, char *);
+int time_read_ms(unsigned long long *, const char *);
+time_t time_mono(void);
+unsigned long long time_mono_ms(void);
+unsigned long long time_mono_us(void);
+unsigned long long time_real_ms(void);
+
+int timer_set(struct timer_heap *, unsigned int, unsigned long long);
+int timer_del(struct timer_heap *, unsigned int);
+int timer_top(struct timer_heap *, struct timer *);
+
+const char *errno_msg(int);
+
+#define LOW_TEMP_DEFAULT 29
+#define TRIG_TEMP_DEFAULT 33
+#define HYST_DEC_TEMP_DEFAULT 2
+
+#define UPDATE_DELAY_DEFAULT 1
+#define OUTPUT_PIN_DEFAULT -1
+#define OUTPUT_BIAS_DEFAULT 1 // pull-down
+#define OUTPUT_DRIVE_DEFAULT 0 // push-pull
+#define REASSERT_DELAY_DEFAULT 60
+#define LOAD_TRIG_DEFAULT 0
+#define LOAD_SUSTAIN_DEFAULT 30
+#define TACH_PIN_DEFAULT -1
+#define TACH_PPR_DEFAULT 2 // most pc fans
+#define STALL_RPM_DEFAULT 300
+#define HINT_LEAD_DEFAULT 60 // s at full load, until the fit has a fan on time constant
+#define HINT_LEAD_MAX 900
+#define HINT_TIME_MAX 86400
+
+#define SIM_TIME_DEFAULT 86400
+#define SIM_SEED_DEFAULT 1
+#define MODEL_AMBIENT_DEFAULT 25000
+#define MODEL_HEAT_DEFAULT 35000
+#define MODEL_COOL_DEFAULT 400
+#define MODEL_TAU_OFF_DEFAULT 120000
+#define MODEL_TAU_ON_DEFAULT 40000
+#define SIM_FAN_RPM 2400
+
+#define TUNE_LOW_MIN_DEFAULT 25
+#define TUNE_LOW_MAX_DEFAULT 45
+#define TUNE_TRIG_MIN_DEFAULT 30
+#define TUNE_TRIG_MAX_DEFAULT 60
+#define TUNE_HYST_MIN_DEFAULT 1
+#define TUNE_HYST_MAX_DEFAULT 10
+#define TUNE_MAX_OVER_DEFAULT 1 // %
+
+#endif//_LIBTCCTL_H_
@@ -0,0 +1,140 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libtcctl.h"
+
+// tcctl-bake CONF OUT
+// parses CONF as the daemon does and writes it out as a C header for the
+// baked build (make baked), a struct tcctl_conf_set initializer
+
+#define BAKE_OUT_MAX_LEN 16384
+#define BAKE_PATH_MAX_LEN 256
+
+static struct tcctl_ctx ctx;
+
+const char *
+bake_map(const char *path, size_t *len)
+{
+	struct stat fs;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1 || fstat(fd, &fs) == -1)
+	{
+		LOG_ERROR("could not open file: ", errno_msg(errno));
+		return NULL;
+	}
+
+	*len = fs.st_size;
+	if (fs.st_size == 0)
+	{
+		close(fd);
+		return "";
+	}
+
+	char *memblk = mmap(NULL, fs.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (memblk == MAP_FAILED)
+	{
+		LOG_ERROR("mmap failed: ", errno_msg(errno));
+		return NULL;
+	}
+
+	return memblk;
+}
+
+char *
+bake_str(char *p, const char *str, size_t max_len)
+{
+	// a C string literal, quotes and backslashes escaped
+	*p++ = '"';
+	for (size_t i = 0; i < max_len && str[i] != '\0'; i++)
+	{
+		if (str[i] == '"' || str[i] == '\\')
+			*p++ = '\\';
+		*p++ = str[i];
+	}
+	*p++ = '"';
+	return p;
+}
+
+char *
+bake_zone(char *p, const struct tcctl_conf *conf)
+{
+	const char *name;
+	unsigned int val;
+
+	p += str_copy("\t\t{\n", p, ENTRY_NAME_MAX_LEN);
+	for (unsigned int id = 0; (name = tcctl_conf_entry_name(id)) != NULL; id++)
+	{
+		tcctl_conf_field_get(conf, id, &val);
+		p += str_copy("\t\t\t.", p, ENTRY_NAME_MAX_LEN);
+		p += str_copy(name, p, ENTRY_NAME_MAX_LEN);
+		p += str_copy(" = { ", p, ENTRY_NAME_MAX_LEN);
+		p += uint_write(val, p);
+		p += str_copy(" },\n", p, ENTRY_NAME_MAX_LEN);
+	}
+
+	p += str_copy("\t\t\t.name = ", p, ENTRY_NAME_MAX_LEN);
+	p = bake_str(p, conf->name, ZONE_NAME_MAX_LEN);
+	p += str_copy(",\n\t\t\t.sensor_path = {", p, ENTRY_NAME_MAX_LEN);
+	for (unsigned int i = 0; i < conf->sensor.uint; i++)
+	{
+		p += str_copy(i ? ", " : " ", p, ENTRY_NAME_MAX_LEN);
+		p = bake_str(p, conf->sensor_path[i], SENSOR_PATH_MAX_LEN);
+	}
+	p += str_copy(" }\n\t\t},\n", p, ENTRY_NAME_MAX_LEN);
+	return p;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static char out[BAKE_OUT_MAX_LEN];
+	struct tcctl_io io = { .user = NULL };
+	const char *conf;
+	size_t conf_len;
+
+	tcctl_log_set(0, STDOUT_FILENO);
+	if (argc != 3)
+	{
+		STDOUT_PRINT("usage: tcctl-bake <CONF> <OUT>\n");
+		return 1;
+	}
+
+	// the gpio check is left to the daemon, the board is not here
+	tcctl_ctx_init(&ctx, &io);
+	LOG_INFO("conf path: ", argv[1]);
+	if ((conf = bake_map(argv[1], &conf_len)) == NULL)
+		return 2;
+	if (!tcctl_conf_parse(&ctx, conf))
+		return 3;
+
+	struct tcctl_conf_set *set = ctx.conf_live;
+	char *p = out;
+	p += str_copy("// baked from ", p, ENTRY_NAME_MAX_LEN);
+	p += str_copy(argv[1], p, BAKE_PATH_MAX_LEN);
+	p += str_copy(" by tcctl-bake, do not edit\n"
+		"#ifndef _TCCTL_BAKED_H_\n#define _TCCTL_BAKED_H_\n\n"
+		"#define BAKED_CONF_PATH ", p, MSG_MAX_LEN);
+	p = bake_str(p, argv[1], BAKE_PATH_MAX_LEN);
+	p += str_copy("\n#define BAKED_ZONES_NUM ", p, ENTRY_NAME_MAX_LEN);
+	p += uint_write(set->num, p);
+	p += str_copy("\n\nstatic const struct tcctl_conf_set tcctl_baked_set =\n{\n"
+		"\t.num = BAKED_ZONES_NUM,\n\t.zones =\n\t{\n", p, MSG_MAX_LEN);
+	for (unsigned int i = 0; i < set->num; i++)
+		p = bake_zone(p, &set->zones[i]);
+	p += str_copy("\t}\n};\n\n#endif\n", p, ENTRY_NAME_MAX_LEN);
+
+	int fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1 || write(fd, out, p - out) != p - out)
+	{
+		LOG_ERROR("could not write header: ", errno_msg(errno));
+		return 4;
+	}
+	close(fd);
+
+	LOG_INFO("baked: ", argv[2]);
+	return 0;
+}
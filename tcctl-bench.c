@@ -0,0 +1,389 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "libtcctl.h"
+
+// tcctl-bench [OPTIONS]
+// load generator for the control socket: forked clients, each with its own
+// reply address and pid, send a mix of STAT, OVRD and TRIG at a fixed rate
+// and time every reply, the daemon reports its tick lateness before and under
+// the load
+
+#define BENCH_SOCKET_PATH "af_un_tcctl.serv"
+#define BENCH_CLIENTS_MAX 64
+#define BENCH_SAMPLES_MAX 65536 // per client
+#define BENCH_CLIENTS_DEFAULT 4
+#define BENCH_RATE_DEFAULT 200  // messages per s, all clients
+#define BENCH_TIME_DEFAULT 10
+#define BENCH_IDLE_DEFAULT 2
+#define BENCH_WAIT_MS 1000
+
+enum bench_counter
+{
+	BENCH_TICKS,
+	BENCH_TICK_LATE,
+	BENCH_TICK_LATE_MAX,
+	BENCH_DROPPED,
+	BENCH_DEFERRED,
+	BENCH_COUNTERS
+};
+
+struct bench_client
+{
+	unsigned int sent;
+	unsigned int replied;
+	unsigned int lost;    // no reply after every try
+	unsigned int stalled; // all slots in flight, send skipped
+	unsigned int errors;  // replied with a status
+	unsigned int samples_num;
+	unsigned int samples[BENCH_SAMPLES_MAX]; // us
+};
+
+struct bench_load
+{
+	const char *path;
+	unsigned int zone;
+	unsigned int rate; // per client
+	unsigned int mix[3];
+	unsigned int low_temp;
+	unsigned int trig_temp;
+	unsigned long long end_us;
+};
+
+static const enum bench_counter counter_stats[BENCH_COUNTERS] = { STAT_TICKS,
+	STAT_TICK_LATE, STAT_TICK_LATE_MAX, STAT_RC_DROPPED, STAT_RC_DEFERRED };
+
+int
+bench_wait(struct tcctl_client *cl, unsigned int seq, struct tcctl_rc_msg *reply)
+{
+	int res;
+	while ((res = tcctl_client_result(cl, seq, reply)) == 0)
+	{
+		if (tcctl_client_poll(cl, BENCH_WAIT_MS) == -1)
+			return 0;
+	}
+
+	if (res == -1 || reply->head.status != RC_OK)
+	{
+		LOG_ERROR("no reply from service", NULL);
+		return 0;
+	}
+	return 1;
+}
+
+int
+bench_stat(struct tcctl_client *cl, unsigned int zone, unsigned int param_id, unsigned int *val)
+{
+	struct tcctl_rc_msg reply;
+	unsigned int seq;
+	if (
+		!tcctl_client_msg(cl, STAT, zone, param_id, 0, 0, &seq) ||
+		!bench_wait(cl, seq, &reply)
+	)
+		return 0;
+
+	*val = reply.p2.uint;
+	return 1;
+}
+
+int
+bench_counters(struct tcctl_client *cl, unsigned int *vals)
+{
+	for (unsigned int i = 0; i < BENCH_COUNTERS; i++)
+	{
+		if (!bench_stat(cl, 0, counter_stats[i], &vals[i]))
+			return 0;
+	}
+	return 1;
+}
+
+void
+bench_collect(
+		struct tcctl_client *cl,
+		struct bench_client *res,
+		unsigned int *seqs,
+		unsigned long long *sent_us
+)
+{
+	struct tcctl_rc_msg reply;
+	unsigned long long now = time_mono_us();
+	for (unsigned int i = 0; i < CLIENT_INFLIGHT_MAX; i++)
+	{
+		if (seqs[i] == 0)
+			continue;
+
+		int done = tcctl_client_result(cl, seqs[i], &reply);
+		if (done == 0)
+			continue;
+		seqs[i] = 0;
+		if (done == -1)
+		{
+			res->lost++;
+			continue;
+		}
+
+		res->replied++;
+		if (reply.head.status != RC_OK)
+			res->errors++;
+		if (res->samples_num < BENCH_SAMPLES_MAX)
+			res->samples[res->samples_num++] = now - sent_us[i];
+	}
+}
+
+void
+bench_client_run(const struct bench_load *load, struct bench_client *res)
+{
+	struct tcctl_client cl;
+	unsigned int seqs[CLIENT_INFLIGHT_MAX] = { 0 };
+	unsigned long long sent_us[CLIENT_INFLIGHT_MAX];
+	unsigned int mix_sum = load->mix[0] + load->mix[1] + load->mix[2];
+	unsigned long long interval = 1000000 / load->rate;
+	unsigned long long next = time_mono_us(), now;
+	unsigned int n = 0;
+
+	if (!tcctl_client_open(&cl, load->path))
+		return;
+
+	// on schedule, however late the replies are
+	while ((now = time_mono_us()) < load->end_us || cl.pending > 0)
+	{
+		for (; now < load->end_us && next <= now; next += interval, n++)
+		{
+			unsigned int k = n % mix_sum, seq;
+			enum tcctl_rc_cmd cmd = k < load->mix[0] ? STAT :
+				k < load->mix[0] + load->mix[1] ? OVRD : TRIG;
+			unsigned int p1 = cmd == STAT ? STAT_LAST_TEMP :
+				cmd == OVRD ? n / mix_sum % 2 : load->low_temp;
+
+			if (!tcctl_client_msg(&cl, cmd, load->zone, p1, load->trig_temp, 0, &seq))
+			{
+				res->stalled++;
+				continue;
+			}
+			seqs[seq % CLIENT_INFLIGHT_MAX] = seq;
+			sent_us[seq % CLIENT_INFLIGHT_MAX] = now;
+			res->sent++;
+		}
+
+		unsigned long long wait = next > now ? (next - now) / 1000 : 0;
+		if (now >= load->end_us)
+			wait = BENCH_WAIT_MS;
+		if (tcctl_client_poll(&cl, wait) == -1)
+			break;
+		bench_collect(&cl, res, seqs, sent_us);
+	}
+
+	tcctl_client_close(&cl);
+}
+
+int
+bench_cmp(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+	return (x > y) - (x < y);
+}
+
+void
+bench_print(const char *header, const char **names, const unsigned int *vals, unsigned int num)
+{
+	char line[MSG_MAX_LEN];
+	char *p = line;
+
+	p += str_copy(header, p, ENTRY_NAME_MAX_LEN);
+	for (unsigned int i = 0; i < num; i++)
+	{
+		*p++ = ' ';
+		p += str_copy(names[i], p, ENTRY_NAME_MAX_LEN);
+		*p++ = ' ';
+		p += uint_write(vals[i], p);
+	}
+	*p++ = '\n';
+	*p = '\0';
+	tcctl_stdout_write(line);
+}
+
+unsigned int
+bench_late_avg(const unsigned int *from, const unsigned int *to)
+{
+	unsigned int ticks = to[BENCH_TICKS] - from[BENCH_TICKS];
+	return ticks ? (to[BENCH_TICK_LATE] - from[BENCH_TICK_LATE]) / ticks : 0;
+}
+
+int
+bench_mix(unsigned int *mix, const char *str)
+{
+	// STAT:OVRD:TRIG weights
+	const char *p = str;
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		int len = uint_scan(&mix[i], p);
+		if (len == 0 || p[len] != (i < 2 ? ':' : '\0'))
+			return 0;
+		p += len + 1;
+	}
+	return mix[0] + mix[1] + mix[2] > 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bench_load load = { .path = BENCH_SOCKET_PATH, .mix = { 8, 1, 1 } };
+	struct tcctl_client cl;
+	unsigned int clients = BENCH_CLIENTS_DEFAULT, rate = BENCH_RATE_DEFAULT;
+	unsigned int time_s = BENCH_TIME_DEFAULT, idle_s = BENCH_IDLE_DEFAULT;
+	unsigned int max_p99 = 0;
+
+	tcctl_log_set(0, STDOUT_FILENO);
+
+	for (int argi = 1; argi < argc; argi += 2)
+	{
+		const char *arg = argv[argi], *val = argi + 1 < argc ? argv[argi + 1] : NULL;
+		int ok = val != NULL;
+
+		if (ok && str_eq(arg, "--socket", ENTRY_NAME_MAX_LEN))
+			load.path = val;
+		else if (ok && str_eq(arg, "--clients", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&clients, val) > 0 && clients > 0 && clients <= BENCH_CLIENTS_MAX;
+		else if (ok && str_eq(arg, "--rate", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&rate, val) > 0;
+		else if (ok && str_eq(arg, "--time", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&time_s, val) > 0 && time_s > 0;
+		else if (ok && str_eq(arg, "--idle", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&idle_s, val) > 0;
+		else if (ok && str_eq(arg, "--zone", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&load.zone, val) > 0;
+		else if (ok && str_eq(arg, "--mix", ENTRY_NAME_MAX_LEN))
+			ok = bench_mix(load.mix, val);
+		else if (ok && str_eq(arg, "--max-p99", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&max_p99, val) > 0;
+		else
+			ok = 0;
+
+		if (!ok)
+		{
+			STDOUT_PRINT("usage: tcctl-bench [--socket PATH] [--clients N] [--rate N]\n"
+				"  [--time SECONDS] [--idle SECONDS] [--zone N] [--mix STAT:OVRD:TRIG]\n"
+				"  [--max-p99 US]\n");
+			return 1;
+		}
+	}
+
+	load.rate = rate / clients;
+	if (load.rate == 0)
+		load.rate = 1;
+
+	// TRIG sends back the thresholds the zone already has
+	unsigned int idle_from[BENCH_COUNTERS], idle_to[BENCH_COUNTERS], load_to[BENCH_COUNTERS];
+	if (
+		!tcctl_client_open(&cl, load.path) ||
+		!bench_stat(&cl, load.zone, STAT_LOW_TEMP, &load.low_temp) ||
+		!bench_stat(&cl, load.zone, STAT_TRIG_TEMP, &load.trig_temp) ||
+		!bench_counters(&cl, idle_from)
+	)
+		return 2;
+
+	sleep(idle_s);
+	if (!bench_counters(&cl, idle_to))
+		return 2;
+
+	// one process per client, the service rate limits by pid
+	struct bench_client *res = mmap(NULL, clients * sizeof(*res),
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (res == MAP_FAILED)
+	{
+		LOG_ERROR("mmap failed: ", errno_msg(errno));
+		return 3;
+	}
+
+	char buf[ENTRY_LINE_MAX_LEN];
+	buf[uint_write(clients, buf)] = '\0';
+	LOG_INFO("clients: ", buf);
+	buf[uint_write(load.rate * clients, buf)] = '\0';
+	LOG_INFO("target rate: ", buf);
+
+	unsigned long long start = time_mono_us();
+	load.end_us = start + time_s * 1000000ULL;
+	for (unsigned int i = 0; i < clients; i++)
+	{
+		pid_t pid = fork();
+		if (pid == -1)
+		{
+			LOG_ERROR("could not start client: ", errno_msg(errno));
+			kill(0, SIGTERM);
+			return 4;
+		}
+		if (pid == 0)
+		{
+			bench_client_run(&load, &res[i]);
+			_exit(0);
+		}
+	}
+	while (wait(NULL) != -1 || errno == EINTR)
+		;
+	unsigned long long took = time_mono_us() - start;
+
+	unsigned int seq;
+	struct tcctl_rc_msg reply;
+	if (
+		!bench_counters(&cl, load_to) ||
+		!tcctl_client_msg(&cl, AUTO, load.zone, 0, 0, 0, &seq) ||
+		!bench_wait(&cl, seq, &reply)
+	)
+		return 2;
+	tcctl_client_close(&cl);
+
+	// every sample of every client in one sorted run
+	struct bench_client sum = { 0 };
+	unsigned int *samples = malloc(clients * BENCH_SAMPLES_MAX * sizeof(*samples));
+	if (samples == NULL)
+	{
+		LOG_ERROR("out of memory for samples", NULL);
+		return 3;
+	}
+	for (unsigned int i = 0; i < clients; i++)
+	{
+		sum.sent += res[i].sent;
+		sum.replied += res[i].replied;
+		sum.lost += res[i].lost;
+		sum.stalled += res[i].stalled;
+		sum.errors += res[i].errors;
+		for (unsigned int j = 0; j < res[i].samples_num; j++)
+			samples[sum.samples_num++] = res[i].samples[j];
+	}
+	qsort(samples, sum.samples_num, sizeof(*samples), bench_cmp);
+
+	unsigned int pcts[4] = { 0 };
+	const unsigned int pcts_of[4] = { 500, 990, 999, 1000 };
+	for (unsigned int i = 0; i < 4 && sum.samples_num > 0; i++)
+		pcts[i] = samples[(sum.samples_num - 1) * pcts_of[i] / 1000];
+
+	const char *load_names[] = { "sent", "replied", "lost", "stalled", "errors", "per_s" };
+	unsigned int load_vals[] = { sum.sent, sum.replied, sum.lost, sum.stalled, sum.errors,
+		took ? sum.replied * 1000000ULL / took : 0 };
+	bench_print("load>", load_names, load_vals, 6);
+
+	const char *lat_names[] = { "p50", "p99", "p999", "max" };
+	bench_print("latency_us>", lat_names, pcts, 4);
+
+	const char *tick_names[] = { "idle_avg", "idle_max", "load_avg", "load_max" };
+	unsigned int tick_vals[] = { bench_late_avg(idle_from, idle_to),
+		idle_to[BENCH_TICK_LATE_MAX], bench_late_avg(idle_to, load_to),
+		load_to[BENCH_TICK_LATE_MAX] };
+	bench_print("tick_late_us>", tick_names, tick_vals, 4);
+
+	const char *svc_names[] = { "dropped", "deferred" };
+	unsigned int svc_vals[] = { load_to[BENCH_DROPPED] - idle_to[BENCH_DROPPED],
+		load_to[BENCH_DEFERRED] - idle_to[BENCH_DEFERRED] };
+	bench_print("service>", svc_names, svc_vals, 2);
+
+	if (max_p99 != 0 && pcts[1] > max_p99)
+	{
+		LOG_ERROR("p99 over the limit", NULL);
+		return 5;
+	}
+	return 0;
+}
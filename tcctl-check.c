@@ -0,0 +1,427 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include "libtcctl.h"
+
+// tcctl-check conf | rc SOCKET | trig SOCKET | save SOCKET CONF
+// regression checks for make check, the conf ones on their own, the others
+// against a daemon already running on SOCKET (and CONF). exits 0 if all of
+// them hold
+
+#define CHECK_CONF_MAX_LEN 8192
+#define CHECK_SAVE_WAIT_MS 3000
+#define CHECK_STAT_WAIT_MS 3000
+
+static struct tcctl_ctx ctx;
+
+// main not first, it still needs its section
+static const char check_conf_zones[] =
+	"low_temp\t33\n"
+	"[zone fan]\n"
+	"output_pin\t23\n"
+	"trig_temp\t50\n"
+	"sensor\t/sys/class/thermal/thermal_zone1/temp\n"
+	"[zone main]\n"
+	"output_pin\t24\n"
+	"hyst_dec_temp\t3\n";
+
+// keywords with a tail, each one refused
+static const char *check_conf_words[] =
+{
+	"output_bias\tpull-downXYZ\n",
+	"output_drive\topen-drainfoo\n",
+	"policy\tonly\n",
+	NULL
+};
+
+// each one puts two zones on one line
+static const char *check_conf_pins[] =
+{
+	"[zone a]\noutput_pin\t23\n[zone b]\noutput_pin\t23\n",
+	"[zone a]\noutput_pin\t23\n[zone b]\noutput_pin\t24\ntach_pin\t23\n",
+	"[zone a]\noutput_pin\t23\ntach_pin\t24\n[zone b]\noutput_pin\t24\n",
+	NULL
+};
+
+// a request and its reply, resends and all
+int
+check_call(
+		struct tcctl_client *cl,
+		enum tcctl_rc_cmd cmd,
+		unsigned int zone,
+		unsigned int p1,
+		unsigned int p2,
+		unsigned int p3,
+		struct tcctl_rc_msg *reply
+)
+{
+	unsigned int seq;
+	int ret;
+
+	if (!tcctl_client_msg(cl, cmd, zone, p1, p2, p3, &seq))
+		return 0;
+	while ((ret = tcctl_client_result(cl, seq, reply)) == 0)
+	{
+		if (tcctl_client_poll(cl, CLIENT_RETRY_MS) == -1)
+			return 0;
+	}
+
+	return ret == 1;
+}
+
+// empty and short datagrams are dropped, they do not stall the queue
+int
+check_rc_garbage(const char *path)
+{
+	struct tcctl_client cl;
+	struct tcctl_rc_msg before, after;
+
+	if (!tcctl_client_open(&cl, path))
+		return 0;
+	if (!check_call(&cl, STAT, 0, STAT_RC_DROPPED, 0, 0, &before))
+	{
+		LOG_ERROR("no reply from daemon: ", path);
+		tcctl_client_close(&cl);
+		return 0;
+	}
+
+	if (send(cl.fd, "", 0, 0) == -1 || send(cl.fd, "tcc", 3, 0) == -1)
+	{
+		LOG_ERROR("could not send message: ", errno_msg(errno));
+		tcctl_client_close(&cl);
+		return 0;
+	}
+
+	int ok = check_call(&cl, STAT, 0, STAT_RC_DROPPED, 0, 0, &after);
+	tcctl_client_close(&cl);
+	if (!ok)
+	{
+		LOG_ERROR("no reply after an empty datagram", NULL);
+		return 0;
+	}
+	if (after.p2.uint != before.p2.uint + 2)
+	{
+		LOG_ERROR("empty datagrams not counted as dropped", NULL);
+		return 0;
+	}
+
+	LOG_INFO("rc garbage ok", NULL);
+	return 1;
+}
+
+unsigned int
+check_entry_id(const char *name)
+{
+	const char *entry;
+	for (unsigned int id = 0; (entry = tcctl_conf_entry_name(id)) != NULL; id++)
+	{
+		if (str_eq(entry, name, ENTRY_NAME_MAX_LEN))
+			return id;
+	}
+
+	return -1;
+}
+
+// a conf entry of zone 0, -1 if it cannot be read
+unsigned int
+check_get(struct tcctl_client *cl, unsigned int id)
+{
+	struct tcctl_rc_msg reply;
+	if (!check_call(cl, GET, 0, id, 0, 0, &reply) || reply.head.status != RC_OK)
+		return -1;
+	return reply.p2.uint;
+}
+
+// a SET of zone 0, the daemon takes it on at the top of its next pass
+int
+check_set(struct tcctl_client *cl, unsigned int id, unsigned int val)
+{
+	struct tcctl_rc_msg reply;
+	return check_call(cl, SET, 0, id, val, 0, &reply) && reply.head.status == RC_OK;
+}
+
+// STAT of zone 0 until it reads val. with hold it must read val all along,
+// and is only asked again after the zone ticked once, past any pending conf
+int
+check_stat_wait(struct tcctl_client *cl, unsigned int param_id, unsigned int val, int hold)
+{
+	struct tcctl_rc_msg reply;
+	unsigned long long end = time_mono_ms() + CHECK_STAT_WAIT_MS;
+	unsigned int delay = check_get(cl, check_entry_id("update_delay"));
+
+	if (hold)
+	{
+		if (delay == -1)
+			return 0;
+		usleep(delay * 1000000 + 200000);
+	}
+
+	while (check_call(cl, STAT, 0, param_id, 0, 0, &reply))
+	{
+		if (reply.p2.uint == val)
+			return 1;
+		if (hold || time_mono_ms() >= end)
+			return 0;
+		usleep(10000);
+	}
+
+	return 0;
+}
+
+// TRIG values survive a SET of something else, not one of the thresholds.
+// every value differs from what the daemon has, all of it is put back
+int
+check_trig_hold(const char *path)
+{
+	struct tcctl_client cl;
+	struct tcctl_rc_msg reply;
+	unsigned int delay_id = check_entry_id("reassert_delay");
+	unsigned int trig_id = check_entry_id("trig_temp");
+
+	if (!tcctl_client_open(&cl, path))
+		return 0;
+
+	unsigned int delay = check_get(&cl, delay_id), trig = check_get(&cl, trig_id);
+	int ok =
+		delay != -1 && trig != -1 &&
+		check_call(&cl, STAT, 0, STAT_TRIG_TEMP, 0, 0, &reply);
+	unsigned int low = 0, trig_run = trig + 5;
+	if (ok)
+	{
+		if (trig_run == reply.p2.uint)
+			trig_run++;
+		ok = check_call(&cl, STAT, 0, STAT_LOW_TEMP, 0, 0, &reply);
+		low = reply.p2.uint;
+	}
+	if (!ok)
+	{
+		LOG_ERROR("no conf or stat from daemon: ", path);
+		tcctl_client_close(&cl);
+		return 0;
+	}
+
+	ok =
+		check_call(&cl, TRIG, 0, low, trig_run, 0, &reply) &&
+		check_stat_wait(&cl, STAT_TRIG_TEMP, trig_run, 0) &&
+		check_set(&cl, delay_id, delay + 1) &&
+		check_stat_wait(&cl, STAT_TRIG_TEMP, trig_run, 1);
+	if (!ok)
+	{
+		LOG_ERROR("TRIG value lost to a SET of another entry", NULL);
+		tcctl_client_close(&cl);
+		return 0;
+	}
+
+	ok =
+		check_set(&cl, trig_id, trig + 1) &&
+		check_stat_wait(&cl, STAT_TRIG_TEMP, trig + 1, 0);
+	if (!ok)
+	{
+		LOG_ERROR("SET of trig_temp did not replace the TRIG value", NULL);
+		tcctl_client_close(&cl);
+		return 0;
+	}
+
+	ok =
+		check_set(&cl, trig_id, trig) && check_set(&cl, delay_id, delay) &&
+		check_stat_wait(&cl, STAT_TRIG_TEMP, trig, 0);
+	tcctl_client_close(&cl);
+	if (!ok)
+	{
+		LOG_ERROR("could not put the conf back", NULL);
+		return 0;
+	}
+
+	LOG_INFO("trig hold ok", NULL);
+	return 1;
+}
+
+// the conf file as it is now, parsed into ctx
+int
+check_conf_read(const char *path)
+{
+	static char str[CHECK_CONF_MAX_LEN];
+	struct tcctl_io io = { .user = NULL };
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return 0;
+	ssize_t len = read(fd, str, CHECK_CONF_MAX_LEN - 1);
+	close(fd);
+	if (len == -1)
+		return 0;
+	str[len] = '\0';
+
+	tcctl_ctx_init(&ctx, &io);
+	return tcctl_conf_parse(&ctx, str);
+}
+
+// two write backs in a row, the file ends up with the second one
+int
+check_save_order(const char *path, const char *conf_path)
+{
+	struct tcctl_client cl;
+	struct tcctl_rc_msg reply;
+	unsigned int id = check_entry_id("low_temp"), val = -1;
+
+	if (!tcctl_client_open(&cl, path))
+		return 0;
+	int ok =
+		check_call(&cl, SET, 0, id, 30, 1, &reply) && reply.head.status == RC_OK &&
+		check_call(&cl, SET, 0, id, 31, 1, &reply) && reply.head.status == RC_OK;
+	tcctl_client_close(&cl);
+	if (!ok)
+	{
+		LOG_ERROR("SET with write back refused", NULL);
+		return 0;
+	}
+
+	unsigned long long end = time_mono_ms() + CHECK_SAVE_WAIT_MS;
+	while (time_mono_ms() < end)
+	{
+		// a half written file does not parse or has fewer entries
+		tcctl_log_set(0, -1);
+		ok = check_conf_read(conf_path);
+		tcctl_log_set(0, STDOUT_FILENO);
+		if (ok && tcctl_conf_field_get(&ctx.conf_live->zones[0], id, &val) && val == 31)
+		{
+			LOG_INFO("conf save order ok", NULL);
+			return 1;
+		}
+		usleep(10000);
+	}
+
+	LOG_ERROR("conf file does not hold the last SET: ", conf_path);
+	return 0;
+}
+
+// parsed, written and parsed again, the same zones with the same entries
+int
+check_conf_round_trip(void)
+{
+	static struct tcctl_conf_set first;
+	static char str[CHECK_CONF_MAX_LEN];
+	struct tcctl_io io = { .user = NULL };
+	unsigned int a, b;
+
+	tcctl_ctx_init(&ctx, &io);
+	if (!tcctl_conf_parse(&ctx, check_conf_zones))
+		return 0;
+	first = *ctx.conf_live;
+	if (tcctl_conf_set_write(&first, str, sizeof(str)) == -1)
+	{
+		LOG_ERROR("could not write conf", NULL);
+		return 0;
+	}
+
+	tcctl_ctx_init(&ctx, &io);
+	if (!tcctl_conf_parse(&ctx, str) || ctx.conf_live->num != first.num)
+	{
+		LOG_ERROR("written conf has other zones:\n", str);
+		return 0;
+	}
+	for (unsigned int i = 0; i < first.num; i++)
+	{
+		const struct tcctl_conf *want = &first.zones[i], *got = &ctx.conf_live->zones[i];
+		if (!str_eq(want->name, got->name, ZONE_NAME_MAX_LEN))
+		{
+			LOG_ERROR("zone moved: ", want->name);
+			return 0;
+		}
+		for (unsigned int id = 0; tcctl_conf_entry_name(id) != NULL; id++)
+		{
+			tcctl_conf_field_get(want, id, &a);
+			tcctl_conf_field_get(got, id, &b);
+			if (a != b)
+			{
+				LOG_ERROR("entry changed on the way: ", tcctl_conf_entry_name(id));
+				return 0;
+			}
+		}
+	}
+
+	LOG_INFO("conf round trip ok", NULL);
+	return 1;
+}
+
+// keywords match the whole value, trailing blanks are fine
+int
+check_conf_keywords(void)
+{
+	struct tcctl_io io = { .user = NULL };
+
+	for (unsigned int i = 0; check_conf_words[i] != NULL; i++)
+	{
+		tcctl_ctx_init(&ctx, &io);
+		if (tcctl_conf_parse(&ctx, check_conf_words[i]))
+		{
+			LOG_ERROR("keyword with a tail taken: ", check_conf_words[i]);
+			return 0;
+		}
+	}
+
+	tcctl_ctx_init(&ctx, &io);
+	if (!tcctl_conf_parse(&ctx, "output_bias\tpull-down  \npolicy\ton\n"))
+	{
+		LOG_ERROR("keyword refused", NULL);
+		return 0;
+	}
+
+	LOG_INFO("conf keywords ok", NULL);
+	return 1;
+}
+
+// a conf or a SET with two zones on one gpio line is refused
+int
+check_conf_pin_clash(void)
+{
+	struct tcctl_io io = { .user = NULL };
+	struct tcctl_conf_update update = { check_entry_id("output_pin"), 23 };
+
+	for (unsigned int i = 0; check_conf_pins[i] != NULL; i++)
+	{
+		tcctl_ctx_init(&ctx, &io);
+		if (tcctl_conf_parse(&ctx, check_conf_pins[i]))
+		{
+			LOG_ERROR("pin clash taken:\n", check_conf_pins[i]);
+			return 0;
+		}
+	}
+
+	// zone main of check_conf_zones moved onto the line of zone fan
+	tcctl_ctx_init(&ctx, &io);
+	if (!tcctl_conf_parse(&ctx, check_conf_zones))
+		return 0;
+	if (tcctl_conf_update(&ctx, 1, &update, 1) || ctx.conf_errentid != update.id)
+	{
+		LOG_ERROR("pin clash taken by SET", NULL);
+		return 0;
+	}
+
+	LOG_INFO("conf pin clash ok", NULL);
+	return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+	tcctl_log_set(0, STDOUT_FILENO);
+	if (argc == 2 && str_eq(argv[1], "conf", 5))
+		return
+			check_conf_round_trip() && check_conf_keywords() &&
+			check_conf_pin_clash() ? 0 : 2;
+	if (argc == 3 && str_eq(argv[1], "rc", 3))
+		return check_rc_garbage(argv[2]) ? 0 : 2;
+	if (argc == 3 && str_eq(argv[1], "trig", 5))
+		return check_trig_hold(argv[2]) ? 0 : 2;
+	if (argc == 4 && str_eq(argv[1], "save", 5))
+		return check_save_order(argv[2], argv[3]) ? 0 : 2;
+
+	STDOUT_PRINT("usage: tcctl-check conf\n"
+		"       tcctl-check rc <SOCKET|@NAME>\n"
+		"       tcctl-check trig <SOCKET|@NAME>\n"
+		"       tcctl-check save <SOCKET|@NAME> <CONF>\n");
+	return 1;
+}
@@ -0,0 +1,348 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "libtcctl.h"
+
+// tcctl-microbench [--rounds N] [--iters N] [--save PATH] [--check PATH]
+// cost per call of the helpers on the tick and log paths, in cpu cycles
+// (ns where perf events are not allowed), against a saved baseline
+
+#define MBENCH_ROUNDS_DEFAULT 7
+#define MBENCH_ITERS_DEFAULT 200000
+#define MBENCH_TOLERANCE_DEFAULT 15 // %
+#define MBENCH_BASE_MAX_LEN 2048
+
+struct mbench_case
+{
+	const char *name;
+	void (*fn)(unsigned int);
+};
+
+static struct tcctl_ctx ctx;
+static volatile unsigned int sink;
+static int cycles_fd = -1;
+
+// what the tick and the conf see
+static const char *temp_strs[] = { "48312\n", "51000\n", "39875\n", "62437\n" };
+static const char *conf_lines[] = { "low_temp      \t35\n", "trig_temp     \t45\n",
+	"hyst_dec_temp\t5\n", "update_delay  \t1\n", "output_pin    \t24\n",
+	"output_drive\tpush-pull\n", "reassert_delay\t60\n", "stay_on       \tfalse\n",
+	"pin_invert\tfalse\n", "load_sustain\t30\n" };
+// the names of the conf entry table, in its order
+static const char *entry_names[] = { "low_temp", "trig_temp", "hyst_dec_temp",
+	"update_delay", "output_pin", "output_bias", "output_drive", "reassert_delay",
+	"stay_on", "stop", "pin_invert", "load_trig", "load_sustain", "policy", "sensor",
+	"tach_pin", "tach_ppr", "stall_rpm" };
+#define TEMP_STRS (sizeof(temp_strs) / sizeof(*temp_strs))
+#define CONF_LINES (sizeof(conf_lines) / sizeof(*conf_lines))
+#define ENTRY_NAMES (sizeof(entry_names) / sizeof(*entry_names))
+
+void
+mbench_uint_read(unsigned int i)
+{
+	unsigned int val;
+	uint_read(&val, temp_strs[i % TEMP_STRS]);
+	sink = val;
+}
+
+void
+mbench_temp_parse(unsigned int i)
+{
+	// as tcctl_temp_read gets it from pread
+	char str[TEMP_BUF_MAX_LEN] = ZERO_STR;
+	str_copy(temp_strs[i % TEMP_STRS], str, TEMP_BUF_MAX_LEN);
+	unsigned int temp = 0;
+	uint_read(&temp, str);
+	sink = temp;
+}
+
+void
+mbench_uint_write(unsigned int i)
+{
+	char buf[ENTRY_LINE_MAX_LEN];
+	sink = uint_write(i * 7919, buf) + buf[0];
+}
+
+void
+mbench_uint_write_pad(unsigned int i)
+{
+	char buf[ENTRY_LINE_MAX_LEN];
+	sink = uint_write_pad(i % 120, buf, 3) + buf[0];
+}
+
+void
+mbench_time_write_ms(unsigned int i)
+{
+	char buf[TIME_BUF_LEN];
+	sink = time_write_ms(i * 1013ULL, buf) + buf[0];
+}
+
+void
+mbench_time_write(unsigned int i)
+{
+	char buf[TIME_BUF_LEN];
+	sink = time_write(buf) + buf[0];
+}
+
+void
+mbench_str_len(unsigned int i)
+{
+	sink = str_len(entry_names[i % ENTRY_NAMES], ENTRY_NAME_MAX_LEN);
+}
+
+void
+mbench_str_eq(unsigned int i)
+{
+	// a conf line against every entry name, as the parser does
+	const char *line = conf_lines[i % CONF_LINES];
+	unsigned int hits = 0;
+	for (unsigned int e = 0; e < ENTRY_NAMES; e++)
+		hits += str_eq(line, entry_names[e], ENTRY_NAME_MAX_LEN);
+	sink = hits;
+}
+
+void
+mbench_str_copy(unsigned int i)
+{
+	char buf[ENTRY_LINE_MAX_LEN];
+	sink = str_copy(conf_lines[i % CONF_LINES], buf, ENTRY_LINE_MAX_LEN) + buf[0];
+}
+
+void
+mbench_conf_line(unsigned int i)
+{
+	sink = tcctl_conf_read_next_line(&ctx, conf_lines[i % CONF_LINES]) != NULL;
+}
+
+static const struct mbench_case cases[] =
+{
+	{ "uint_read", mbench_uint_read },
+	{ "temp_parse", mbench_temp_parse },
+	{ "uint_write", mbench_uint_write },
+	{ "uint_write_pad", mbench_uint_write_pad },
+	{ "time_write_ms", mbench_time_write_ms },
+	{ "time_write", mbench_time_write },
+	{ "str_len", mbench_str_len },
+	{ "str_eq", mbench_str_eq },
+	{ "str_copy", mbench_str_copy },
+	{ "conf_read_next_line", mbench_conf_line },
+};
+#define MBENCH_CASES (sizeof(cases) / sizeof(*cases))
+
+int
+mbench_cycles_open(void)
+{
+	// user space cycles of this thread, needs perf_event_paranoid <= 2
+	struct perf_event_attr attr =
+	{
+		.type = PERF_TYPE_HARDWARE,
+		.size = sizeof(attr),
+		.config = PERF_COUNT_HW_CPU_CYCLES,
+		.exclude_kernel = 1,
+		.exclude_hv = 1
+	};
+	cycles_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	return cycles_fd != -1;
+}
+
+unsigned long long
+mbench_now(void)
+{
+	unsigned long long cycles;
+	if (cycles_fd != -1 && read(cycles_fd, &cycles, sizeof(cycles)) == sizeof(cycles))
+		return cycles;
+
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+unsigned int
+mbench_run(const struct mbench_case *c, unsigned int rounds, unsigned int iters)
+{
+	// best round, in hundredths per call
+	unsigned long long best = -1ULL;
+	for (unsigned int r = 0; r < rounds; r++)
+	{
+		unsigned long long start = mbench_now();
+		for (unsigned int i = 0; i < iters; i++)
+			c->fn(i);
+		unsigned long long took = mbench_now() - start;
+		if (took < best)
+			best = took;
+	}
+
+	return best * 100 / iters;
+}
+
+int
+mbench_hundredths_write(unsigned int val, char *str)
+{
+	char *p = str;
+	p += uint_write(val / 100, p);
+	*p++ = '.';
+	p += uint_write_pad(val % 100, p, 2);
+	return p - str;
+}
+
+int
+mbench_hundredths_read(unsigned int *val, const char *str)
+{
+	unsigned int whole, frac;
+	int len = uint_scan(&whole, str);
+	if (len == 0 || str[len] != '.' || uint_scan(&frac, str + len + 1) != 2)
+		return -1;
+	*val = whole * 100 + frac;
+	return len + 3;
+}
+
+int
+mbench_base_find(const char *base, const char *name, unsigned int *val)
+{
+	// NAME VALUE per line
+	size_t len = str_len(name, ENTRY_NAME_MAX_LEN);
+	for (const char *p = base; *p != '\0'; )
+	{
+		if (str_eq(p, name, len) && p[len] == ' ')
+			return mbench_hundredths_read(val, p + len + 1) != -1;
+		while (*p != '\0' && *p++ != '\n')
+			;
+	}
+	return 0;
+}
+
+int
+mbench_base_read(const char *path, char *base)
+{
+	int fd = open(path, O_RDONLY);
+	ssize_t len;
+	if (fd == -1 || (len = read(fd, base, MBENCH_BASE_MAX_LEN - 1)) == -1)
+	{
+		LOG_ERROR("could not read baseline: ", errno_msg(errno));
+		if (fd != -1)
+			close(fd);
+		return 0;
+	}
+
+	base[len] = '\0';
+	close(fd);
+	return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct tcctl_io io = { .user = NULL };
+	unsigned int rounds = MBENCH_ROUNDS_DEFAULT, iters = MBENCH_ITERS_DEFAULT;
+	unsigned int tolerance = MBENCH_TOLERANCE_DEFAULT;
+	const char *save_path = NULL, *check_path = NULL;
+	char base[MBENCH_BASE_MAX_LEN], out[MBENCH_BASE_MAX_LEN];
+
+	for (int argi = 1; argi < argc; argi += 2)
+	{
+		const char *arg = argv[argi], *val = argi + 1 < argc ? argv[argi + 1] : NULL;
+		int ok = val != NULL;
+
+		if (ok && str_eq(arg, "--rounds", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&rounds, val) > 0 && rounds > 0;
+		else if (ok && str_eq(arg, "--iters", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&iters, val) > 0 && iters > 0;
+		else if (ok && str_eq(arg, "--tolerance", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&tolerance, val) > 0;
+		else if (ok && str_eq(arg, "--save", ENTRY_NAME_MAX_LEN))
+			save_path = val;
+		else if (ok && str_eq(arg, "--check", ENTRY_NAME_MAX_LEN))
+			check_path = val;
+		else
+			ok = 0;
+
+		if (!ok)
+		{
+			STDOUT_PRINT("usage: tcctl-microbench [--rounds N] [--iters N]\n"
+				"  [--save PATH] [--check PATH] [--tolerance %]\n");
+			return 1;
+		}
+	}
+
+	if (check_path != NULL && !mbench_base_read(check_path, base))
+		return 2;
+
+	// the conf parser logs every entry, as it does in the service
+	int null_fd = open("/dev/null", O_WRONLY);
+	tcctl_ctx_init(&ctx, &io);
+	tcctl_conf_reset(&ctx.new_template);
+	ctx.new_conf = &ctx.new_template;
+
+	int cycles = mbench_cycles_open();
+	const char *unit = cycles ? "cycles" : "ns";
+	LOG_INFO("unit: ", unit);
+	tcctl_log_set(0, null_fd);
+
+	unsigned int vals[MBENCH_CASES];
+	for (unsigned int i = 0; i < MBENCH_CASES; i++)
+		vals[i] = mbench_run(&cases[i], rounds, iters);
+
+	tcctl_log_set(0, STDOUT_FILENO);
+	// numbers of one unit only compare to the same unit
+	int failed = 0;
+	char *o = out;
+	o += str_copy("unit ", o, ENTRY_NAME_MAX_LEN);
+	o += str_copy(unit, o, ENTRY_NAME_MAX_LEN);
+	*o++ = '\n';
+	*o = '\0';
+	if (check_path != NULL && str_find(base, out, MBENCH_BASE_MAX_LEN) != base)
+	{
+		LOG_ERROR("baseline not in ", unit);
+		return 2;
+	}
+	for (unsigned int i = 0; i < MBENCH_CASES; i++)
+	{
+		char line[MSG_MAX_LEN];
+		char *p = line;
+		p += str_copy("bench> ", p, ENTRY_NAME_MAX_LEN);
+		p += str_copy(cases[i].name, p, ENTRY_NAME_MAX_LEN);
+		*p++ = ' ';
+		p += mbench_hundredths_write(vals[i], p);
+		*p++ = ' ';
+		p += str_copy(unit, p, ENTRY_NAME_MAX_LEN);
+
+		// over the baseline by more than the tolerance is a regression
+		unsigned int was;
+		if (check_path != NULL && mbench_base_find(base, cases[i].name, &was))
+		{
+			p += str_copy(" base ", p, ENTRY_NAME_MAX_LEN);
+			p += mbench_hundredths_write(was, p);
+			if (vals[i] * 100ULL > was * (100ULL + tolerance))
+			{
+				p += str_copy(" REGRESSION", p, ENTRY_NAME_MAX_LEN);
+				failed = 1;
+			}
+		}
+		*p++ = '\n';
+		*p = '\0';
+		tcctl_stdout_write(line);
+
+		o += str_copy(cases[i].name, o, ENTRY_NAME_MAX_LEN);
+		*o++ = ' ';
+		o += mbench_hundredths_write(vals[i], o);
+		*o++ = '\n';
+	}
+
+	if (save_path != NULL)
+	{
+		int fd = open(save_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1 || write(fd, out, o - out) != o - out)
+		{
+			LOG_ERROR("could not write baseline: ", errno_msg(errno));
+			return 3;
+		}
+		close(fd);
+		LOG_INFO("baseline: ", save_path);
+	}
+
+	return failed ? 4 : 0;
+}
@@ -0,0 +1,90 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libtcctl.h"
+
+// tcctl-replay [--trace] CONF TRACE
+// runs a recorded trace through the engine with the thresholds of CONF
+
+static struct tcctl_ctx ctx;
+static struct tcctl_replay replay;
+
+const char *
+replay_map(const char *path, size_t *len)
+{
+	struct stat fs;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1 || fstat(fd, &fs) == -1)
+	{
+		LOG_ERROR("could not open file: ", errno_msg(errno));
+		return NULL;
+	}
+
+	*len = fs.st_size;
+	if (fs.st_size == 0)
+	{
+		close(fd);
+		return "";
+	}
+
+	char *memblk = mmap(NULL, fs.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (memblk == MAP_FAILED)
+	{
+		LOG_ERROR("mmap failed: ", errno_msg(errno));
+		return NULL;
+	}
+
+	return memblk;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct tcctl_io io;
+	const char *conf, *trace;
+	size_t conf_len, trace_len;
+	int argi = 1, ok;
+
+	tcctl_log_set(0, STDOUT_FILENO);
+	tcctl_replay_init(&replay, &ctx);
+	if (argi < argc && str_eq(argv[argi], "--trace", ENTRY_NAME_MAX_LEN))
+	{
+		replay.trace = 1;
+		argi++;
+	}
+
+	if (argc - argi != 2)
+	{
+		STDOUT_PRINT("usage: tcctl-replay [--trace] <CONF> <TRACE>\n");
+		return 1;
+	}
+
+	tcctl_replay_io(&replay, &io);
+	tcctl_ctx_init(&ctx, &io);
+
+	LOG_INFO("conf path: ", argv[argi]);
+	if ((conf = replay_map(argv[argi], &conf_len)) == NULL)
+		return 2;
+	if (!tcctl_conf_parse(&ctx, conf) || !tcctl_zones_apply(&ctx))
+		return 3;
+	tcctl_ctx_sync(&ctx);
+
+	LOG_INFO("trace path: ", argv[argi + 1]);
+	if ((trace = replay_map(argv[argi + 1], &trace_len)) == NULL)
+		return 2;
+
+	// binary captures start with the magic, anything else is a text log
+	if (tcctl_rec_len(trace, trace_len) != 0)
+		ok = tcctl_replay_bin(&replay, trace, trace_len);
+	else
+		ok = tcctl_replay_text(&replay, trace, trace_len);
+	if (!ok)
+		return 4;
+
+	tcctl_replay_report(&replay);
+	return 0;
+}
@@ -0,0 +1,56 @@
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "libtcctl.h"
+
+// tcctl-trip SOCKET TZ [up|down] [TEMP]
+// sends one trip point crossing of thermal_zone<TZ> to the --trip-socket of
+// a daemon, as the kernel would over thermal netlink, for tests
+
+int
+main(int argc, char *argv[])
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct tcctl_trip trip = { .up = 1 };
+	unsigned int temp = 0;
+
+	tcctl_log_set(0, STDOUT_FILENO);
+	if (
+		argc < 3 || argc > 5 ||
+		str_len(argv[1], sizeof(addr.sun_path)) >= sizeof(addr.sun_path) - 1 ||
+		uint_read(&trip.tz, argv[2]) <= 0 ||
+		(argc > 3 && !str_eq(argv[3], "up", 3) && !str_eq(argv[3], "down", 5)) ||
+		(argc > 4 && uint_read(&temp, argv[4]) <= 0)
+	)
+	{
+		STDOUT_PRINT("usage: tcctl-trip <SOCKET|@NAME> <TZ> [up|down] [TEMP mC]\n");
+		return 1;
+	}
+
+	if (argc > 3)
+		trip.up = str_eq(argv[3], "up", 3);
+	trip.temp = temp;
+
+	// an abstract name is as long as the address, no terminator
+	size_t len = str_copy(argv[1], addr.sun_path, sizeof(addr.sun_path));
+	if (*argv[1] == RC_ABSTRACT)
+		addr.sun_path[0] = '\0';
+	else
+		addr.sun_path[len++] = '\0';
+
+	int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (
+		fd == -1 ||
+		sendto(fd, &trip, sizeof(trip), 0, (struct sockaddr *)&addr,
+			offsetof(struct sockaddr_un, sun_path) + len) != sizeof(trip)
+	)
+	{
+		LOG_ERROR("could not send trip: ", errno_msg(errno));
+		return 2;
+	}
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,360 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libtcctl.h"
+
+// tcctl-tune [OPTIONS] [TRACE...]
+// grid search of low_temp, trig_temp and hyst_dec_temp on the thermal
+// model, driven by the recorded traces or by random load
+
+#define TUNE_SRCS_MAX 16
+#define TUNE_OUT_PATH "tcctl.tuned.conf"
+#define TUNE_CONF_MAX_LEN 2048
+
+static struct tcctl_ctx ctx;
+static struct tcctl_tune tune;
+static struct tcctl_tune_work works[TUNE_JOBS_MAX];
+static struct tcctl_tune_src srcs[TUNE_SRCS_MAX];
+
+const char *
+tune_map(const char *path, size_t *len)
+{
+	struct stat fs;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1 || fstat(fd, &fs) == -1)
+	{
+		LOG_ERROR("could not open file: ", errno_msg(errno));
+		return NULL;
+	}
+
+	*len = fs.st_size;
+	if (fs.st_size == 0)
+	{
+		close(fd);
+		return "";
+	}
+
+	char *memblk = mmap(NULL, fs.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (memblk == MAP_FAILED)
+	{
+		LOG_ERROR("mmap failed: ", errno_msg(errno));
+		return NULL;
+	}
+
+	return memblk;
+}
+
+void
+tune_fill(unsigned short *loads, size_t *fill, unsigned long long sec, unsigned int temp)
+{
+	// a sample holds back to the one before it
+	unsigned short load = tcctl_tune_load(temp);
+	for (; *fill <= sec; (*fill)++)
+	{
+		if (loads != NULL)
+			loads[*fill] = load;
+	}
+}
+
+size_t
+tune_scan(const char *buf, size_t len, unsigned short *loads)
+{
+	unsigned long long first = 0, ms;
+	unsigned int temp;
+	size_t fill = 0;
+	int zone_id, started = 0;
+
+	size_t rec_len = tcctl_rec_len(buf, len);
+	if (rec_len != 0)
+	{
+		// first zone of a capture only
+		const char *p = buf + REC_MAGIC_LEN, *end = buf + len;
+		for (; p + rec_len <= end; p += rec_len)
+		{
+			const struct tcctl_rec *rec = (const struct tcctl_rec *)p;
+			if (rec->zone != 0 || (started && rec->ms < first + fill * 1000ULL))
+				continue;
+			if (!started++)
+				first = rec->ms;
+			tune_fill(loads, &fill, (rec->ms - first) / 1000, rec->temp);
+		}
+		return fill;
+	}
+
+	struct tcctl_replay rp;
+	tcctl_replay_init(&rp, &ctx);
+	const char *p = buf, *end = buf + len;
+	while (p < end)
+	{
+		char line[MSG_MAX_LEN] = ZERO_STR;
+		size_t i = 0;
+		for (; p < end && *p != '\n'; p++)
+		{
+			if (i < MSG_MAX_LEN - 1)
+				line[i++] = *p;
+		}
+		p++;
+
+		if (tcctl_replay_parse(&rp, line, &ms, &temp, &zone_id) == -1)
+			continue;
+		if (started && ms < first + fill * 1000ULL)
+			continue;
+		if (!started++)
+			first = ms;
+		tune_fill(loads, &fill, (ms - first) / 1000, temp);
+	}
+	return fill;
+}
+
+int
+tune_trace(const char *path)
+{
+	struct tcctl_tune_src *src = &srcs[tune.srcs_num];
+	size_t len;
+	const char *buf;
+
+	if (tune.srcs_num == TUNE_SRCS_MAX)
+	{
+		LOG_ERROR("too many traces: ", path);
+		return 0;
+	}
+
+	LOG_INFO("trace path: ", path);
+	if ((buf = tune_map(path, &len)) == NULL)
+		return 0;
+
+	// once to size the load, once to fill it
+	src->loads_num = tune_scan(buf, len, NULL);
+	if (src->loads_num == 0)
+	{
+		LOG_ERROR("no samples in trace: ", path);
+		return 0;
+	}
+
+	unsigned short *loads = malloc(src->loads_num * sizeof(*loads));
+	if (loads == NULL)
+	{
+		LOG_ERROR("out of memory for trace: ", path);
+		return 0;
+	}
+
+	tune_scan(buf, len, loads);
+	munmap((void *)buf, len);
+	src->loads = loads;
+	src->end = src->loads_num * 1000ULL;
+	tune.srcs_num++;
+	return 1;
+}
+
+int
+tune_range(unsigned int *range, const char *str)
+{
+	// MIN:MAX or a single value
+	int len = uint_scan(&range[0], str);
+	if (len == 0)
+		return 0;
+	range[1] = range[0];
+	if (str[len] == '\0')
+		return 1;
+	return str[len] == ':' && uint_scan(&range[1], str + len + 1) > 0;
+}
+
+void *
+tune_worker(void *work)
+{
+	tcctl_tune_run(work);
+	return NULL;
+}
+
+void
+tune_print(struct tcctl_tune_score *score, const char *header)
+{
+	char line[MSG_MAX_LEN];
+	char *p = line;
+	const char *names[] = { " low ", " trig ", " hyst ", " peak ", " over_s ",
+		" switches ", " duty ", "\n" };
+	unsigned int vals[] = { score->cand.low_temp, score->cand.trig_temp,
+		score->cand.hyst_dec_temp, score->peak, score->over_s,
+		score->switches, score->duty };
+
+	p += str_copy(header, p, ENTRY_NAME_MAX_LEN);
+	for (unsigned int i = 0; i < 7; i++)
+	{
+		p += str_copy(names[i], p, ENTRY_NAME_MAX_LEN);
+		p += uint_write(vals[i], p);
+	}
+	p += str_copy(names[7], p, ENTRY_NAME_MAX_LEN);
+	*p = '\0';
+	tcctl_stdout_write(line);
+}
+
+int
+tune_write(const char *path, struct tcctl_tune_score *score)
+{
+	char str[TUNE_CONF_MAX_LEN];
+	struct tcctl_conf conf = tune.base;
+	conf.low_temp.uint = score->cand.low_temp;
+	conf.trig_temp.uint = score->cand.trig_temp;
+	conf.hyst_dec_temp.uint = score->cand.hyst_dec_temp;
+
+	int len = tcctl_conf_write(&conf, 0, str, TUNE_CONF_MAX_LEN);
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
+	if (len == -1 || fd == -1 || write(fd, str, len) != len)
+	{
+		LOG_ERROR("could not write tuned conf: ", errno_msg(errno));
+		return 0;
+	}
+
+	close(fd);
+	LOG_INFO("tuned conf: ", path);
+	return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct tcctl_io io = { .user = NULL };
+	struct tcctl_conf base;
+	const char *conf_path = NULL, *out_path = TUNE_OUT_PATH;
+	unsigned int model_s = 0, jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int max_over = TUNE_MAX_OVER_DEFAULT, limit = 0;
+	unsigned int ranges[TUNE_PARAMS][2];
+	int ranges_set[TUNE_PARAMS] = { 0 };
+	const char *range_args[TUNE_PARAMS] = { "--low", "--trig", "--hyst" };
+	int argi = 1;
+
+	tcctl_log_set(0, STDOUT_FILENO);
+	tcctl_ctx_init(&ctx, &io);
+	tcctl_conf_reset(&base);
+
+	for (; argi < argc && argv[argi][0] == '-'; argi += 2)
+	{
+		const char *arg = argv[argi], *val = argi + 1 < argc ? argv[argi + 1] : NULL;
+		int ok = val != NULL;
+		unsigned int p = 0;
+		for (; p < TUNE_PARAMS && !str_eq(arg, range_args[p], ENTRY_NAME_MAX_LEN); p++)
+			;
+
+		if (ok && p < TUNE_PARAMS)
+			ok = ranges_set[p] = tune_range(ranges[p], val);
+		else if (ok && str_eq(arg, "--conf", ENTRY_NAME_MAX_LEN))
+			conf_path = val;
+		else if (ok && str_eq(arg, "--out", ENTRY_NAME_MAX_LEN))
+			out_path = val;
+		else if (ok && str_eq(arg, "--limit", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&limit, val) > 0;
+		else if (ok && str_eq(arg, "--max-over", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&max_over, val) > 0;
+		else if (ok && str_eq(arg, "--model", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&model_s, val) > 0;
+		else if (ok && str_eq(arg, "--jobs", ENTRY_NAME_MAX_LEN))
+			ok = uint_read(&jobs, val) > 0;
+		else
+			ok = 0;
+
+		if (!ok)
+		{
+			STDOUT_PRINT("usage: tcctl-tune [--conf PATH] [--low|--trig|--hyst MIN:MAX]\n"
+				"  [--limit C] [--max-over %] [--model SECONDS] [--jobs N]\n"
+				"  [--out PATH] [TRACE...]\n");
+			return 1;
+		}
+	}
+
+	// thresholds are tuned, everything else comes from the first zone
+	if (conf_path != NULL)
+	{
+		size_t len;
+		const char *str;
+		LOG_INFO("conf path: ", conf_path);
+		if ((str = tune_map(conf_path, &len)) == NULL || !tcctl_conf_parse(&ctx, str))
+			return 3;
+		base = ctx.conf_live->zones[0];
+	}
+
+	tcctl_tune_init(&tune, &base);
+	for (unsigned int i = 0; i < TUNE_PARAMS; i++)
+	{
+		if (ranges_set[i])
+		{
+			tune.range[i][0] = ranges[i][0];
+			tune.range[i][1] = ranges[i][1];
+		}
+	}
+	if (limit != 0)
+		tune.limit = limit;
+
+	for (; argi < argc; argi++)
+	{
+		if (!tune_trace(argv[argi]))
+			return 2;
+	}
+	if (tune.srcs_num == 0 && model_s == 0)
+		model_s = SIM_TIME_DEFAULT;
+	if (model_s != 0 && tune.srcs_num < TUNE_SRCS_MAX)
+		srcs[tune.srcs_num++].end = model_s * 1000ULL;
+	tune.srcs = srcs;
+
+	// results are the only allocation, evaluations run on the work slots
+	tcctl_tune_cands(&tune);
+	tune.scores = malloc(tune.cands_num * sizeof(*tune.scores));
+	if (tune.scores == NULL)
+	{
+		LOG_ERROR("out of memory for scores", NULL);
+		return 2;
+	}
+
+	if (jobs == 0)
+		jobs = 1;
+	if (jobs > TUNE_JOBS_MAX)
+		jobs = TUNE_JOBS_MAX;
+
+	char buf[ENTRY_LINE_MAX_LEN];
+	buf[uint_write(tune.cands_num, buf)] = '\0';
+	LOG_INFO("candidates: ", buf);
+	buf[uint_write(jobs, buf)] = '\0';
+	LOG_INFO("jobs: ", buf);
+
+	unsigned long long start = time_mono_ms();
+	pthread_t threads[TUNE_JOBS_MAX];
+	for (unsigned int i = 0; i < jobs; i++)
+	{
+		works[i].tune = &tune;
+		if (i > 0 && pthread_create(&threads[i], NULL, tune_worker, &works[i]) != 0)
+		{
+			LOG_ERROR("could not start worker: ", errno_msg(errno));
+			return 4;
+		}
+	}
+	tcctl_tune_run(&works[0]);
+	for (unsigned int i = 1; i < jobs; i++)
+		pthread_join(threads[i], NULL);
+
+	buf[uint_write(time_mono_ms() - start, buf)] = '\0';
+	LOG_INFO("sweep ms: ", buf);
+
+	unsigned int front = tcctl_tune_front(&tune);
+	buf[uint_write(front, buf)] = '\0';
+	LOG_INFO("pareto front: ", buf);
+	for (unsigned int i = 0; i < tune.cands_num; i++)
+	{
+		if (tune.scores[i].front)
+			tune_print(&tune.scores[i], "front>");
+	}
+
+	int pick = tcctl_tune_pick(&tune, max_over);
+	if (pick == -1)
+	{
+		LOG_ERROR("no valid candidate in the grid", NULL);
+		return 5;
+	}
+
+	tune_print(&tune.scores[pick], "pick>");
+	return tune_write(out_path, &tune.scores[pick]) ? 0 : 6;
+}
@@ -1,31 +1,38 @@
 #include "tcctl.h"
 #include <linux/gpio.h>
 
-static struct tcctl_stat run_stat;
-static struct tcctl_conf run_conf, new_conf;
+static struct tcctl_ctx ctx;
+static int sensor_fds[ZONES_MAX][ZONE_SENSORS_MAX];
+static unsigned long long output_vals; // by zone
+static unsigned int output_lines[ZONES_MAX]; // line of outputs by zone, -1 - none
+static unsigned int outputs_gen, tachs_gen;
 
-#define CONF_ENTRIES 8
-#define CONF_ENTRY(FIELD) #FIELD, &new_conf.FIELD
-
-static struct tcctl_conf_entry tcctl_conf_entries[] = 
-{	
-	{ CONF_ENTRY(low_temp),      tcctl_get_uint },
-	{ CONF_ENTRY(trig_temp),     tcctl_get_uint },
-	{ CONF_ENTRY(hyst_dec_temp), tcctl_get_uint },
-	{ CONF_ENTRY(update_delay),  tcctl_get_uint },
-	{ CONF_ENTRY(output_pin),    tcctl_get_uint },
-	{ CONF_ENTRY(stay_on),       tcctl_get_boolean },
-	{ CONF_ENTRY(stop),          tcctl_get_boolean },
-	{ CONF_ENTRY(pin_invert),    tcctl_get_boolean }
-};
-
-#define ARG_ENTRIES 3
+#define ARG_ENTRIES 13
 
 static struct tcctl_arg arg_entries[ARG_ENTRIES] =
 {
 	{ "--help", "", "show help", 		tcctl_arg_help, POST_EXIT },
 	{ "--conf", "<PATH>", "set conf path", 	tcctl_arg_conf, POST_NORM },
-	{ "--log",  "<PATH>", "set log path",	tcctl_arg_log,  POST_NORM }
+	{ "--log",  "<PATH>", "set log path",	tcctl_arg_log,  POST_NORM },
+	{ "--gpio", "<PATH|LABEL>", "set gpio chip", tcctl_arg_gpio, POST_NORM },
+	{ "--simulate", "<model|PATH>", "run on a simulated board", 
+		tcctl_arg_simulate, POST_NORM },
+	{ "--sim-time", "<SECONDS>", "simulated time to run", 
+		tcctl_arg_sim_time, POST_NORM },
+	{ "--sim-speed", "<N>", "times real time (0 - max)", 
+		tcctl_arg_sim_speed, POST_NORM },
+	{ "--sim-stall", "<SECONDS>", "simulated fans stop turning after", 
+		tcctl_arg_sim_stall, POST_NORM },
+	{ "--record", "<PATH>", "append zone ticks for tcctl-replay", 
+		tcctl_arg_record, POST_NORM },
+	{ "--state", "<PATH>", "keep zone state for a warm restart", 
+		tcctl_arg_state, POST_NORM },
+	{ "--socket", "<PATH|@NAME>", "control socket, @ - abstract", 
+		tcctl_arg_socket, POST_NORM },
+	{ "--trip-socket", "<PATH|@NAME>", "take trip events from it, for tests", 
+		tcctl_arg_trip_socket, POST_NORM },
+	{ ARG_UPGRADE, "<FD>", "internal, take over from the old binary", 
+		tcctl_arg_upgrade, POST_NORM }
 };
 
 static struct sigaction tcctl_kill_sigaction = 
@@ -35,45 +42,125 @@ static struct sigaction tcctl_kill_sigaction =
 	.sa_flags   = SA_RESETHAND
 };
 
-#define LSTR(V) _LSTR(V)
-#define _LSTR(V) #V
-#define LOG_INFO(MSG, VAL) tcctl_log_info(MSG, VAL, __FUNCTION__, 0)
-#define LOG_WARN(MSG, VAL) tcctl_log_info(MSG, VAL, __FUNCTION__, 1)
-#define LOG_ERROR(MSG, VAL) tcctl_log_error(MSG, VAL, __FUNCTION__, LSTR(__LINE__))
-#define STDOUT_PRINT(MSG) tcctl_stdout_write(MSG);
-
 static char *log_path, *conf_path;
-static int stdout_fd, log_fd, conf_fd, temp_fd;
-static int conf_errline, conf_errentid;
-static int unsck_fd;
+static int log_fd, conf_fd;
+static int conf_ino_fd = -1;
+static unsigned long long conf_due;
+#ifndef TCCTL_BAKED
+static const char *conf_base;
+static int conf_dir_wd = -1, conf_file_wd = -1;
+// one conf writer at a time, a save asked for meanwhile waits for it
+static pid_t save_pid = -1;
+static int save_pending;
+static unsigned long long conf_hash;
+#endif
+static int unsck_fd, rc_activated;
+static const char *unsck_path = UNSCK_PATH;
 static struct sockaddr_un unsck_sun_addr;
 static struct tcctl_rc_addr unsck_addr; 
+static int trip_nl_fd = -1, trip_sock_fd = -1;
+static const char *trip_sock_path;
+static struct sockaddr_un trip_sun_addr;
+static struct tcctl_rc_addr trip_addr;
+static int alarm_fds[ZONES_MAX][ZONE_SENSORS_MAX];
+static struct tcctl_rc_bucket rc_budget, rc_clients[RC_CLIENTS_MAX];
+static unsigned int rc_dropped, rc_deferred;
+static unsigned int ticks, tick_late, tick_late_max;
 static struct gpio gpio;
-static struct gpio_pin output_pin;
+static struct gpio_lines outputs;
+static struct gpio_lines tachs;
+static struct tach_window tach_wins[GPIO_LINES_MAX]; // by line of tachs
+static struct tcctl_sim sim;
+static char *sim_src;
+static unsigned int sim_time = SIM_TIME_DEFAULT, sim_speed, sim_stall;
+static char *rec_path;
+static int rec_fd = -1;
+static size_t rec_len = sizeof(struct tcctl_rec);
+static char *snap_path;
+static struct tcctl_snap *snap;
+static unsigned long long snap_synced;
+static int main_argc, upgrade_fd = -1, upgrade_due, inherited;
+static char **main_argv;
+static char exe_path[EXE_PATH_MAX_LEN];
+static struct tcctl_upgrade upgrade;
+static int load_opened, load_stat_fd = -1, load_freq_fds[LOAD_CPUS_MAX], load_cpus;
+static unsigned int load_max_khz[LOAD_CPUS_MAX], load_busy, load_total;
+
+static const struct tcctl_io tcctl_daemon_io =
+{
+	.user         = NULL,
+	.sensor_open  = tcctl_io_sensor_open,
+	.sensor_read  = tcctl_io_sensor_read,
+	.output_write = tcctl_io_output_write,
+	.clock_ms     = tcctl_io_clock_ms,
+	.load_read    = tcctl_io_load_read,
+	.conf_check   = tcctl_io_conf_check,
+	.tach_read    = tcctl_io_tach_read
+};
 
 int
 main(int argc, char *argv[])
 {
 	tcctl_pre_init();
+	main_argc = argc;
+	main_argv = argv;
 
 	if (!tcctl_args_parse(argc - 1, argv + 1))
 		return 1;
 
 	tcctl_setup_sig();
+	tcctl_ctx_init(&ctx, &tcctl_daemon_io);
 	if (!tcctl_fd_init())
 		return 2;
 
-	tcctl_conf_reset(&new_conf);
-	if (!tcctl_conf_load(conf_fd))
-		return 3;
-	
-	tcctl_conf_apply(&new_conf, &run_conf);
+	if (sim_src != NULL && !tcctl_sim_setup())
+		return 2;
 
-	if (!tcctl_gpio_init())
+	if (upgrade_fd != -1 && !tcctl_upgrade_load())
+		return 7;
+
+	// the chip first, its line count checks the conf
+	if (sim_src == NULL && !tcctl_gpio_init())
 		return 4;
 
-	if (!tcctl_rc_init(UNSCK_PATH))
+#ifdef TCCTL_BAKED
+	if (!tcctl_conf_baked(&ctx))
+		return 3;
+#else
+	if (!tcctl_conf_load(conf_fd, 0))
+		return 3;
+#endif
+
+	if (!tcctl_zones_apply(&ctx))
+		return 3;
+
+	// before the first tick, it decides on the restored state, an upgrade
+	// hands over fresher state than the file
+	if (snap_path != NULL && !tcctl_snap_open())
+		return 6;
+	if (inherited)
+		tcctl_snap_load(&upgrade.snap);
+	else if (snap != NULL)
+		tcctl_snap_load(snap);
+
+	// the fan first, on a fresh reading, the socket and the watches can
+	// wait for it
+	tcctl_ctx_prime(&ctx);
+	if (!tcctl_ctx_run(&ctx))
+		return 3;
+	if (sim_src == NULL)
+		tcctl_gpio_write();
+
+	if (!tcctl_rc_init(unsck_path))
 		return 5;
+	if (!tcctl_trip_init())
+		return 8;
+
+#ifndef TCCTL_BAKED
+	// CONF still works without it
+	if (!tcctl_conf_watch_init())
+		LOG_WARN("no conf auto reload", NULL);
+#endif
 	
 	for (;;)
 	{
@@ -87,8 +174,18 @@ tcctl_pre_init(void)
 {
 	log_path = LOG_PATH;
 	conf_path = CONF_PATH;
+	gpio.path = GPIO_PATH;
+	for (unsigned int z = 0; z < ZONES_MAX; z++)
+	{
+		for (unsigned int i = 0; i < ZONE_SENSORS_MAX; i++)
+			alarm_fds[z][i] = -1;
+	}
 
-	stdout_fd = STDOUT_FILENO;
+	tcctl_log_set(0, STDOUT_FILENO);
+
+	// the path, not the file, an upgrade replaces the file under it
+	ssize_t len = readlink("/proc/self/exe", exe_path, EXE_PATH_MAX_LEN - 1);
+	exe_path[len > 0 ? len : 0] = '\0';
 }
 
 #define ARG_FAILED 0
@@ -115,7 +212,7 @@ tcctl_arg_help(int argr, char *pargv[])
 int
 tcctl_arg_conf(int argr, char *pargv[])
 {
-	if (argr < 1) 
+	if (argr < 2) 
 	{
 		LOG_WARN("missing parameter <PATH>", NULL);	
 		return ARG_FAILED;
@@ -128,7 +225,7 @@ tcctl_arg_conf(int argr, char *pargv[])
 int
 tcctl_arg_log(int argr, char *pargv[])
 {
-	if (argr < 1) 
+	if (argr < 2) 
 	{
 		LOG_WARN("missing parameter <PATH>", NULL);	
 		return ARG_FAILED;
@@ -138,6 +235,150 @@ tcctl_arg_log(int argr, char *pargv[])
 	return ARG_CONSUMED(1);
 }
 
+int
+tcctl_arg_gpio(int argr, char *pargv[])
+{
+	if (argr < 2) 
+	{
+		LOG_WARN("missing parameter <PATH|LABEL>", NULL);	
+		return ARG_FAILED;
+	}
+
+	// anything not looking like a path is a chip label
+	if (*pargv[1] == '/')
+		gpio.path = pargv[1];
+	else
+		gpio.label = pargv[1];
+	return ARG_CONSUMED(1);
+}
+
+int
+tcctl_arg_simulate(int argr, char *pargv[])
+{
+	if (argr < 2) 
+	{
+		LOG_WARN("missing parameter <model|PATH>", NULL);	
+		return ARG_FAILED;
+	}
+
+	sim_src = pargv[1];
+	return ARG_CONSUMED(1);
+}
+
+int
+tcctl_arg_sim_time(int argr, char *pargv[])
+{
+	if (argr < 2 || uint_read(&sim_time, pargv[1]) <= 0) 
+	{
+		LOG_WARN("missing parameter <SECONDS>", NULL);	
+		return ARG_FAILED;
+	}
+
+	return ARG_CONSUMED(1);
+}
+
+int
+tcctl_arg_sim_speed(int argr, char *pargv[])
+{
+	if (argr < 2 || uint_read(&sim_speed, pargv[1]) <= 0) 
+	{
+		LOG_WARN("missing parameter <N>", NULL);	
+		return ARG_FAILED;
+	}
+
+	return ARG_CONSUMED(1);
+}
+
+int
+tcctl_arg_sim_stall(int argr, char *pargv[])
+{
+	if (argr < 2 || uint_read(&sim_stall, pargv[1]) <= 0) 
+	{
+		LOG_WARN("missing parameter <SECONDS>", NULL);	
+		return ARG_FAILED;
+	}
+
+	return ARG_CONSUMED(1);
+}
+
+int
+tcctl_arg_record(int argr, char *pargv[])
+{
+	if (argr < 2) 
+	{
+		LOG_WARN("missing parameter <PATH>", NULL);	
+		return ARG_FAILED;
+	}
+
+	rec_path = pargv[1];
+	return ARG_CONSUMED(1);
+}
+
+int
+tcctl_arg_state(int argr, char *pargv[])
+{
+	if (argr < 2) 
+	{
+		LOG_WARN("missing parameter <PATH>", NULL);	
+		return ARG_FAILED;
+	}
+
+	snap_path = pargv[1];
+	return ARG_CONSUMED(1);
+}
+
+int
+tcctl_arg_upgrade(int argr, char *pargv[])
+{
+	unsigned int fd;
+	if (argr < 2 || uint_read(&fd, pargv[1]) <= 0) 
+	{
+		LOG_WARN("missing parameter <FD>", NULL);	
+		return ARG_FAILED;
+	}
+
+	upgrade_fd = fd;
+	return ARG_CONSUMED(1);
+}
+
+int
+tcctl_arg_socket(int argr, char *pargv[])
+{
+	if (argr < 2) 
+	{
+		LOG_WARN("missing parameter <PATH|@NAME>", NULL);	
+		return ARG_FAILED;
+	}
+
+	if (str_len(pargv[1], UNSCK_PATH_MAX_LEN) >= UNSCK_PATH_MAX_LEN - 1)
+	{
+		LOG_WARN("socket path too long: ", pargv[1]);
+		return ARG_FAILED;
+	}
+
+	unsck_path = pargv[1];
+	return ARG_CONSUMED(1);
+}
+
+int
+tcctl_arg_trip_socket(int argr, char *pargv[])
+{
+	if (argr < 2) 
+	{
+		LOG_WARN("missing parameter <PATH|@NAME>", NULL);	
+		return ARG_FAILED;
+	}
+
+	if (str_len(pargv[1], UNSCK_PATH_MAX_LEN) >= UNSCK_PATH_MAX_LEN - 1)
+	{
+		LOG_WARN("socket path too long: ", pargv[1]);
+		return ARG_FAILED;
+	}
+
+	trip_sock_path = pargv[1];
+	return ARG_CONSUMED(1);
+}
+
 int
 tcctl_args_parse(int argc, char *argv[])
 {
@@ -199,19 +440,38 @@ tcctl_setup_sig(void)
 {
 	sigaction(SIGTERM, &tcctl_kill_sigaction, NULL);
 	sigaction(SIGINT, &tcctl_kill_sigaction, NULL);
+	// conf writers reap themselves, the loop only polls whether one is gone
+	signal(SIGCHLD, SIG_IGN);
 }
 
 void
 tcctl_kill_sig(int sig)
 {
+	char temp_buf[TEMP_BUF_LEN] = ZERO_STR;
 	LOG_WARN("received exit signal", NULL);
-	LOG_INFO("fan stays: ", run_conf.stay_on.boolean ? "on" : "off");
-	tcctl_gpio_write(run_conf.stay_on.boolean);
+	if (snap != NULL)
+		tcctl_snap_save();
+	for (unsigned int i = 0; i < ctx.zones_num; i++)
+	{
+		// with a state kept a running fan runs on into the restart
+		struct tcctl_zone *zone = &ctx.zones[i];
+		int stay_on = zone->conf.stay_on.boolean || (snap != NULL && zone->is_on);
+		LOG_INFO("zone: ", zone->conf.name);
+		LOG_INFO("fan stays: ", stay_on ? "on" : "off");
+		tcctl_io_output_write(NULL, i, stay_on);
+		uint_write_pad(zone->stat.last_temp, temp_buf, 3);
+		LOG_INFO("current temperature: ", temp_buf);
+		if (zone->conf.tach_pin.uint != -1)
+		{
+			temp_buf[uint_write(zone->rpm, temp_buf)] = '\0';
+			LOG_INFO("fan speed rpm: ", temp_buf);
+		}
+	}
+	if (sim_src == NULL)
+		tcctl_gpio_write();
 	LOG_INFO("shutdown remote ctl", NULL);
 	tcctl_rc_end();
-	char temp_buf[TEMP_BUF_LEN] = ZERO_STR;
-	uint_write_pad(run_stat.last_temp, temp_buf, 3);
-	LOG_INFO("current temperature: ", temp_buf);
+	tcctl_trip_end();
 	LOG_INFO("exit", NULL);
 	raise(sig); // handler is reset, will kill program
 }
@@ -228,8 +488,10 @@ tcctl_fd_init(void)
 		LOG_ERROR("could not open log file: ", errno_msg(errno));
 		return 0;
 	}
+	tcctl_log_set(log_fd, STDOUT_FILENO);
 	LOG_INFO("tcctl log start", NULL);
 
+#ifndef TCCTL_BAKED
 	LOG_INFO("conf path: ", conf_path);
 	conf_fd = open(conf_path, O_RDONLY | O_NONBLOCK);
 	if (conf_fd == -1)
@@ -237,273 +499,1325 @@ tcctl_fd_init(void)
 		LOG_ERROR("could not open conf file: ", errno_msg(errno));
 		return 0;
 	}
+#endif
 
-	LOG_INFO("temp sensor path: ", TEMP_PATH);
-	temp_fd = open(TEMP_PATH, O_RDONLY | O_NONBLOCK);
-	if (temp_fd == -1)
-	{
-		LOG_ERROR("could not open sensor: ", errno_msg(errno));
+	if (rec_path != NULL && !tcctl_rec_open())
 		return 0;
-	}
 
 	LOG_INFO("fds ok", NULL);
 	return 1;
 }
 
 int
-tcctl_loop(void)
+tcctl_rec_open(void)
 {
-	fd_set read_fds;
-	struct timeval timeout;
-
-	tcctl_conf_apply(&new_conf, &run_conf);
-	tcctl_stat_update(&run_stat, &run_conf);
-
-	FD_ZERO(&read_fds);
-	FD_SET(unsck_fd, &read_fds); // local socket
-
-	timeout.tv_sec = run_conf.update_delay.uint;
-	timeout.tv_usec = 0;
+	struct stat fs;
+	char magic[REC_MAGIC_LEN];
 
-	int nfdr = select(unsck_fd + 1, &read_fds, NULL, NULL, &timeout);
-		
-	if (nfdr == -1)
+	LOG_INFO("record path: ", rec_path);
+	rec_fd = open(rec_path, O_RDWR | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP);
+	if (rec_fd == -1 || fstat(rec_fd, &fs) == -1)
 	{
-		LOG_ERROR("select failed: ", errno_msg(errno));
+		LOG_ERROR("could not open record file: ", errno_msg(errno));
 		return 0;
 	}
 
-	if (nfdr == 1 && !tcctl_rc_recv_msg())
+	// a new capture starts with the magic, old ones are continued
+	if (fs.st_size == 0 && write(rec_fd, REC_MAGIC, REC_MAGIC_LEN) != REC_MAGIC_LEN)
 	{
-		LOG_WARN("loop end", NULL);
+		LOG_ERROR("could not write record file: ", errno_msg(errno));
 		return 0;
 	}
 
-	return tcctl_update();
+	// in their own record format
+	if (fs.st_size != 0)
+	{
+		if (
+			pread(rec_fd, magic, REC_MAGIC_LEN, 0) != REC_MAGIC_LEN ||
+			(rec_len = tcctl_rec_len(magic, REC_MAGIC_LEN)) == 0
+		)
+		{
+			LOG_ERROR("record file is not a tcctl capture", NULL);
+			return 0;
+		}
+		if (rec_len == REC_V1_LEN)
+			LOG_WARN("old capture, fan speed not recorded", NULL);
+	}
+
+	return 1;
 }
 
 int
-tcctl_update(void)
+tcctl_snap_open(void)
 {
-	int is_on;
-	unsigned int temp = run_stat.last_temp;
+	struct stat fs;
 
-	switch (run_stat.phase)
+	LOG_INFO("state path: ", snap_path);
+	int fd = open(snap_path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (fd == -1 || fstat(fd, &fs) == -1)
 	{
-		case OVRD_IDLE:
-		case OVRD_RUN:
-			is_on = run_stat.phase == OVRD_RUN;
-			break;
-		case LOW_TEMP:
-			if (temp >= run_stat.low_temp)
-				run_stat.phase = IDLE;
-		case IDLE:
-			if (temp >= run_stat.trig_temp)
-				run_stat.phase = HIGH_TEMP;
-
-			is_on = 0;
-			break;
-		case HIGH_TEMP:
-			if (temp < run_stat.trig_temp)
-				run_stat.phase = RUN;
-		case RUN:
-			// switch to high temp mode
-			if (temp >= run_stat.trig_temp)
-				run_stat.phase = HIGH_TEMP;
-			if (temp <= run_stat.trig_temp - run_conf.hyst_dec_temp.uint)
-				run_stat.phase = LOW_TEMP;
-			
-			is_on = 1;
-			break;
-		case FAIL:
-		default:
-			// fail safe
-			is_on = 1;
+		LOG_ERROR("could not open state file: ", errno_msg(errno));
+		return 0;
 	}
 
-	tcctl_gpio_write(is_on);
-	return tcctl_temp_read(temp_fd, &run_stat.last_temp);
-}
+	// a file of another size is another format, it fails the check
+	if (fs.st_size != sizeof(*snap) && ftruncate(fd, sizeof(*snap)) == -1)
+	{
+		LOG_ERROR("could not size state file: ", errno_msg(errno));
+		close(fd);
+		return 0;
+	}
 
-int
-tcctl_gpio_init(void)
-{
-	gpio.path = "/dev/gpiochip1";
-	if (!gpio_open(&gpio))
-		LOG_ERROR("could not init gpio", NULL);	
+	snap = mmap(NULL, sizeof(*snap), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (snap == MAP_FAILED)
+	{
+		LOG_ERROR("mmap failed: ", errno_msg(errno));
+		snap = NULL;
 		return 0;
-	LOG_INFO("gpio ok", NULL);
+	}
+
 	return 1;
 }
 
-int
-tcctl_gpio_update_conf(unsigned int pin)
+void
+tcctl_snap_load(const struct tcctl_snap *from)
 {
-	if (output_pin.pin == pin)
-		return 1;
-	output_pin.pin = pin;
-	output_pin.pull = GPIO_PULLDOWN;
-	if (!gpio_pin(&gpio, &output_pin))
-		return 0;
-	return 1;
+	unsigned long long wall = time_real_ms();
+	if (!tcctl_snap_valid(from, wall))
+		return;
+
+	if (tcctl_snap_restore(&ctx, from, wall) == 0)
+		LOG_WARN("no zone of the state snapshot in the conf", NULL);
+	rc_dropped = from->counters[SNAP_RC_DROPPED];
+	rc_deferred = from->counters[SNAP_RC_DEFERRED];
+	ticks = from->counters[SNAP_TICKS];
+	tick_late = from->counters[SNAP_TICK_LATE];
+	tick_late_max = from->counters[SNAP_TICK_LATE_MAX];
 }
 
-int
-tcctl_gpio_write(int level)
+void
+tcctl_snap_fill(struct tcctl_snap *to)
+{
+	to->counters[SNAP_RC_DROPPED] = rc_dropped;
+	to->counters[SNAP_RC_DEFERRED] = rc_deferred;
+	to->counters[SNAP_TICKS] = ticks;
+	to->counters[SNAP_TICK_LATE] = tick_late;
+	to->counters[SNAP_TICK_LATE_MAX] = tick_late_max;
+	tcctl_snap_take(&ctx, to, time_real_ms());
+}
+
+void
+tcctl_snap_save(void)
 {
-	int true_level = run_conf.pin_invert.boolean ? !level : level;
-	if (!tcctl_gpio_update_conf(run_conf.output_pin.uint))
+	tcctl_snap_fill(snap);
+
+	// the page cache outlives a crash, the disk is for power loss
+	unsigned long long mono = time_mono_ms();
+	if (mono - snap_synced >= SNAP_SYNC_MS)
 	{
-		LOG_ERROR("could not init gpio pin", NULL);
-		return 0;
+		if (msync(snap, sizeof(*snap), MS_ASYNC) == -1)
+			LOG_WARN("could not sync state file: ", errno_msg(errno));
+		snap_synced = mono;
 	}
-
-	return gpio_write(&gpio, &output_pin, true_level);
 }
 
-#define RC_ADDR(ADDR) (struct sockaddr *)(ADDR).addr, (ADDR).len
-#define RECV_RC_ADDR(ADDR) (struct sockaddr *)(ADDR).addr, &((ADDR).len)
-
-size_t
-tcctl_rc_addr_len(const char *path)
+int
+tcctl_upgrade_load(void)
 {
-	return offsetof(struct sockaddr_un, sun_path) + 
-		str_len(path, UNSCK_SUN_ADDR_LEN) + 1; 
+	ssize_t len = read(upgrade_fd, &upgrade, sizeof(upgrade));
+	close(upgrade_fd);
+	if (
+		len != sizeof(upgrade) || 
+		!str_eq(upgrade.magic, UPGRADE_MAGIC, UPGRADE_MAGIC_LEN) ||
+		upgrade.version != UPGRADE_VERSION
+	)
+	{
+		LOG_ERROR("upgrade state of another version", NULL);
+		return 0;
+	}
+
+	LOG_INFO("upgrade, taking over", NULL);
+	inherited = 1;
+	return 1;
 }
 
 void
-tcctl_rc_addr_set(struct tcctl_rc_addr *addr, const char *path)
+tcctl_fd_inherit(int fd, int inherit)
 {
-	addr->addr->sun_family = AF_UNIX;
-	str_copy(path, addr->addr->sun_path, UNSCK_SUN_ADDR_LEN);
-	addr->len = tcctl_rc_addr_len(path);
+	// stdio stays as it is, unopened fds are 0 here
+	if (fd > STDERR_FILENO)
+		fcntl(fd, F_SETFD, inherit ? 0 : FD_CLOEXEC);
 }
 
 int
-tcctl_rc_init(const char *path)
+tcctl_upgrade_exec(void)
 {
-	unsck_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
-	if (unsck_fd == -1)
+	char fd_buf[ENTRY_LINE_MAX_LEN];
+	char *args[ARGS_MAX + 3];
+	int argn = 0;
+
+	str_copy(UPGRADE_MAGIC, upgrade.magic, UPGRADE_MAGIC_LEN + 1);
+	upgrade.version = UPGRADE_VERSION;
+	upgrade.unsck_fd = unsck_fd;
+	upgrade.rc_activated = rc_activated;
+	upgrade.chip_fd = gpio.chip_fd;
+	upgrade.use_v1 = gpio.use_v1;
+	upgrade.outputs = outputs;
+	upgrade.tachs = tachs;
+	tcctl_snap_fill(&upgrade.snap);
+
+	int fd = memfd_create("tcctl-upgrade", 0);
+	if (
+		fd == -1 || write(fd, &upgrade, sizeof(upgrade)) != sizeof(upgrade) ||
+		lseek(fd, 0, SEEK_SET) == -1
+	)
 	{
-		LOG_ERROR("could not get af_unix socket: ", errno_msg(errno));
+		LOG_ERROR("could not pass upgrade state: ", errno_msg(errno));
+		if (fd != -1)
+			close(fd);
 		return 0;
 	}
 
-	unsck_addr.addr = &unsck_sun_addr;	
-	tcctl_rc_addr_set(&unsck_addr, path);
-	
-	LOG_INFO("bind address: ", path);
-	unlink(path);
-	if (bind(unsck_fd, RC_ADDR(unsck_addr)) == -1)
+	// the same args, but for the fd of a former upgrade
+	for (int i = 0; i < main_argc && argn < ARGS_MAX; i++)
 	{
-		LOG_ERROR("could not bind address: ", errno_msg(errno));
-		return 0;
+		if (str_eq(main_argv[i], ARG_UPGRADE, ARG_SYM_MAX_LEN))
+		{
+			i++;
+			continue;
+		}
+		args[argn++] = main_argv[i];
+	}
+	fd_buf[uint_write(fd, fd_buf)] = '\0';
+	args[argn++] = ARG_UPGRADE;
+	args[argn++] = fd_buf;
+	args[argn] = NULL;
+
+	// the lines and the socket live on, everything else is opened anew
+	tcctl_fd_inherit(unsck_fd, 1);
+	tcctl_fd_inherit(gpio.chip_fd, 1);
+	tcctl_fd_inherit(outputs.fd, 1);
+	tcctl_fd_inherit(tachs.fd, 1);
+	tcctl_fd_inherit(log_fd, 0);
+	tcctl_fd_inherit(conf_fd, 0);
+	tcctl_fd_inherit(rec_fd, 0);
+	tcctl_fd_inherit(load_stat_fd, 0);
+	for (unsigned int i = 0; i < LOAD_CPUS_MAX; i++)
+		tcctl_fd_inherit(load_freq_fds[i], 0);
+	for (unsigned int z = 0; z < ZONES_MAX; z++)
+	{
+		for (unsigned int i = 0; i < ZONE_SENSORS_MAX; i++)
+		{
+			tcctl_fd_inherit(sensor_fds[z][i], 0);
+			tcctl_fd_inherit(alarm_fds[z][i], 0);
+		}
 	}
+	tcctl_fd_inherit(trip_nl_fd, 0);
+	tcctl_fd_inherit(trip_sock_fd, 0);
 
-	LOG_INFO("remote ctl ok", NULL);
-	return 1;
+	LOG_INFO("upgrade to: ", exe_path);
+	execv(exe_path, args);
+
+	LOG_ERROR("could not exec, running on: ", errno_msg(errno));
+	close(fd);
+	return 0;
 }
 
-int
-tcctl_rc_end(void)
+void
+tcctl_rec_write(unsigned int zone)
 {
-	const char *path = unsck_addr.addr->sun_path;
-	LOG_INFO("unlink socket: ", path);
-	if (unlink(path) == -1)
+	struct tcctl_rec rec =
 	{
-		LOG_ERROR("could not unlink socket: ", errno_msg(errno));
-		return 0;
-	}
+		.ms = ctx.io.clock_ms(ctx.io.user),
+		.zone = zone,
+		.temp = ctx.zones[zone].stat.last_temp,
+		.rpm = ctx.zones[zone].rpm
+	};
 
-	return 1;
+	if (write(rec_fd, &rec, rec_len) != rec_len)
+	{
+		LOG_ERROR("could not write record, stop recording: ", errno_msg(errno));
+		close(rec_fd);
+		rec_fd = -1;
+	}
 }
 
 int
-tcctl_rc_recv_msg(void)
-{	
-	struct tcctl_rc_addr cl_addr;
-	char cl_path[UNSCK_PATH_MAX_LEN] = ZERO_STR;
-
-	tcctl_rc_addr_set(&cl_addr, cl_path);
+tcctl_sim_setup(void)
+{
+	struct tcctl_io io;
 
-	struct tcctl_rc_msg rc_msg;
+	LOG_INFO("simulate board: ", sim_src);
+	tcctl_sim_init(&sim, &ctx, sim_speed);
+	tcctl_sim_io(&sim, &io);
+	tcctl_ctx_init(&ctx, &io);
+	sim.end = sim_time * 1000ULL;
+	sim.stall_at = sim_stall * 1000ULL;
 
-	int rc_msg_size = recvfrom(
-		unsck_fd, 
-		&rc_msg, 
-		sizeof(struct tcctl_rc_msg), 
-		0,
-		RECV_RC_ADDR(cl_addr)
-	);
+	if (str_eq(sim_src, SIM_MODEL, ENTRY_NAME_MAX_LEN))
+		return 1;
 
-	if (rc_msg_size == -1)
+	// scripted source stays mapped for the whole run
+	struct stat fs;
+	int fd = open(sim_src, O_RDONLY);
+	if (fd == -1 || fstat(fd, &fs) == -1)
 	{
-		LOG_ERROR("could not receive message: ", errno_msg(errno));
+		LOG_ERROR("could not open sim script: ", errno_msg(errno));
+		if (fd != -1)
+			close(fd);
 		return 0;
 	}
-
-	if (rc_msg_size != sizeof(struct tcctl_rc_msg))
+	if (fs.st_size == 0)
 	{
-		LOG_WARN("received malformed message/no data", NULL);
-		// TODO send acknowledge
+		LOG_ERROR("sim script is empty: ", sim_src);
+		close(fd);
 		return 0;
 	}
 
-	if (!tcctl_rc_handle_msg(&rc_msg, &cl_addr))
+	char *memblk = mmap(NULL, fs.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (memblk == MAP_FAILED)
 	{
-		LOG_WARN("received kill command", NULL);
+		LOG_ERROR("mmap failed: ", errno_msg(errno));
 		return 0;
 	}
-	
+
+	tcctl_sim_script(&sim, memblk, fs.st_size);
 	return 1;
 }
 
 int
-tcctl_rc_handle_msg(struct tcctl_rc_msg *msg, struct tcctl_rc_addr *addr)
+tcctl_loop(void)
 {
-	struct tcctl_rc_msg ret_msg;
-	union tcctl_rc_param rc_stat;
-	switch (msg->cmd)
-	{
+	fd_set read_fds, except_fds;
+	struct timeval timeout;
+	unsigned long long now = ctx.io.clock_ms(ctx.io.user);
+	unsigned long long next = now, wait = 0;
+
+	tcctl_ctx_sync(&ctx);
+
+	// out of budget the socket waits, the zones do not
+	unsigned long long mono_us = time_mono_us(), mono = mono_us / 1000;
+	int rc_ready = tcctl_bucket_fill(&rc_budget, mono, RC_BUDGET_RATE, RC_BUDGET_BURST);
+
+	FD_ZERO(&read_fds);
+	FD_ZERO(&except_fds);
+	if (rc_ready)
+		FD_SET(unsck_fd, &read_fds); // local socket
+	if (conf_ino_fd != -1)
+		FD_SET(conf_ino_fd, &read_fds);
+
+	// sleep until the earliest zone is due
+	int zone_due = tcctl_ctx_next(&ctx, &next);
+	if (zone_due && next > now)
+		wait = next - now;
+	// simulated board sleeps in virtual time
+	long long ahead = zone_due ? (long long)next - (long long)now : 0;
+	if (sim_src != NULL)
+	{
+		wait = sim.speed ? wait / sim.speed : 0;
+		ahead = sim.speed ? ahead / (long long)sim.speed : 0;
+	}
+	// the deadline on the real clock, both clocks tick in whole ms
+	unsigned long long due_us = (mono + ahead) * 1000;
+	if (!rc_ready && wait > 1000 / RC_BUDGET_RATE + 1)
+		wait = 1000 / RC_BUDGET_RATE + 1;
+	// a pending conf reload wakes up on real time
+	if (conf_due != 0)
+	{
+		unsigned long long left = conf_due > mono ? conf_due - mono : 0;
+		if (left < wait)
+			wait = left;
+	}
+#ifndef TCCTL_BAKED
+	if (save_pending && wait > CONF_SAVE_POLL_MS)
+		wait = CONF_SAVE_POLL_MS;
+#endif
+	timeout.tv_sec = wait / 1000;
+	timeout.tv_usec = wait % 1000 * 1000;
+
+	int nfds = (conf_ino_fd > unsck_fd ? conf_ino_fd : unsck_fd) + 1;
+	nfds = tcctl_trip_fds(&read_fds, &except_fds, nfds);
+	int nfdr = select(nfds, &read_fds, NULL, &except_fds, &timeout);
+		
+	if (nfdr == -1)
+	{
+		LOG_ERROR("select failed: ", errno_msg(errno));
+		return 0;
+	}
+
+#ifndef TCCTL_BAKED
+	if (nfdr > 0 && conf_ino_fd != -1 && FD_ISSET(conf_ino_fd, &read_fds))
+		tcctl_conf_watch_read();
+	if (conf_due != 0 && time_mono_ms() >= conf_due)
+		tcctl_conf_reload();
+	if (save_pid != -1)
+		tcctl_conf_save_poll();
+#endif
+
+	// a crossed trip point kicks its zones into this pass
+	if (nfdr > 0)
+		tcctl_trip_ready(&read_fds, &except_fds);
+
+	if (sim_src != NULL && !tcctl_sim_advance(&sim, next))
+	{
+		LOG_INFO("simulation end", NULL);
+		tcctl_sim_report(&sim);
+		return 0;
+	}
+
+	// how late the zones run, in real time
+	unsigned long long now_us = time_mono_us();
+	if (zone_due && now_us >= due_us)
+	{
+		unsigned int late = now_us - due_us;
+		ticks++;
+		tick_late += late;
+		if (late > tick_late_max)
+			tick_late_max = late;
+	}
+
+	if (!tcctl_ctx_run(&ctx))
+		return 0;
+
+	if (sim_src == NULL)
+		tcctl_gpio_write();
+	if (snap != NULL)
+		tcctl_snap_save();
+
+	// clients only get what is left after the zones
+	if (rc_ready && nfdr > 0 && FD_ISSET(unsck_fd, &read_fds) && !tcctl_rc_recv_all())
+	{
+		LOG_WARN("loop end", NULL);
+		return 0;
+	}
+	return 1;
+}
+
+int
+tcctl_io_sensor_open(void *user, unsigned int zone, unsigned int sensor, const char *path)
+{
+	int *fd = &sensor_fds[zone][sensor];
+	tcctl_alarm_open(zone, sensor, NULL);
+	if (path == NULL)
+	{
+		close(*fd);
+		*fd = -1;
+		return 1;
+	}
+
+	LOG_INFO("temp sensor path: ", path);
+	*fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (*fd == -1)
+	{
+		LOG_ERROR("could not open sensor: ", errno_msg(errno));
+		return 0;
+	}
+
+	tcctl_alarm_open(zone, sensor, path);
+	return 1;
+}
+
+int
+tcctl_io_sensor_read(void *user, unsigned int zone, unsigned int sensor, unsigned int *temp)
+{
+	return tcctl_temp_read(sensor_fds[zone][sensor], temp);
+}
+
+int
+tcctl_io_output_write(void *user, unsigned int zone, int is_on)
+{
+	if (rec_fd != -1)
+		tcctl_rec_write(zone);
+
+	// collected here, committed at once by tcctl_gpio_write
+	int level = ctx.zones[zone].conf.pin_invert.boolean ? !is_on : is_on;
+	if (level)
+		output_vals |= 1ULL << zone;
+	else
+		output_vals &= ~(1ULL << zone);
+	return 1;
+}
+
+unsigned long long
+tcctl_io_clock_ms(void *user)
+{
+	return time_mono_ms();
+}
+
+int
+tcctl_io_conf_check(void *user, const struct tcctl_conf *conf)
+{
+	// no chip in simulation, -1 - no output
+	if (gpio.info.lines == 0)
+		return 1;
+	if (conf->tach_pin.uint != -1 && conf->tach_pin.uint >= gpio.info.lines)
+		return 0;
+	return conf->output_pin.uint == -1 || conf->output_pin.uint < gpio.info.lines;
+}
+
+int
+tcctl_io_tach_read(void *user, unsigned int zone, unsigned int *rpm)
+{
+	unsigned int pin = ctx.zones[zone].conf.tach_pin.uint;
+	if (tachs.fd == -1)
+		return 0;
+
+	// what came in since the last tick, then the window up to now
+	tcctl_tach_drain();
+	for (unsigned int i = 0; i < tachs.num; i++)
+	{
+		if (tachs.pins[i].pin != pin)
+			continue;
+		*rpm = tach_window_rpm(
+				&tach_wins[i],
+				time_mono_us() * 1000,
+				ctx.zones[zone].conf.tach_ppr.uint
+		);
+		return 1;
+	}
+
+	return 0;
+}
+
+int
+tcctl_io_load_read(void *user, struct tcctl_load *load)
+{
+	unsigned int busy, total;
+
+	// opened once on first use, kept for good
+	if (!load_opened && !tcctl_load_open())
+		return 0;
+	if (load_stat_fd == -1 || !tcctl_load_stat(&busy, &total))
+		return 0;
+
+	// counters wrap, the differences do not care
+	unsigned int dbusy = busy - load_busy, dtotal = total - load_total;
+	load->util = load_total && dtotal ? dbusy * 1000ULL / dtotal : 0;
+	load_busy = busy;
+	load_total = total;
+
+	unsigned long long cur = 0, max = 0;
+	for (int i = 0; i < load_cpus; i++)
+	{
+		unsigned int khz;
+		if (!tcctl_uint_pread(load_freq_fds[i], &khz))
+			continue;
+		cur += khz;
+		max += load_max_khz[i];
+	}
+
+	// no cpufreq, never throttled
+	load->khz = load_cpus ? cur / load_cpus : 0;
+	load->freq = max ? cur * 1000 / max : 1000;
+	return 1;
+}
+
+int
+tcctl_load_open(void)
+{
+	char path[SENSOR_PATH_MAX_LEN];
+
+	load_opened = 1;
+	LOG_INFO("cpu load path: ", LOAD_STAT_PATH);
+	load_stat_fd = open(LOAD_STAT_PATH, O_RDONLY);
+	if (load_stat_fd == -1)
+	{
+		LOG_ERROR("could not open cpu stats: ", errno_msg(errno));
+		return 0;
+	}
+
+	for (load_cpus = 0; load_cpus < LOAD_CPUS_MAX; load_cpus++)
+	{
+		unsigned int max = 0;
+		tcctl_load_freq_path(path, load_cpus, "cpuinfo_max_freq");
+		int fd = open(path, O_RDONLY);
+		if (fd == -1)
+			break;
+		int ok = tcctl_uint_pread(fd, &max);
+		close(fd);
+
+		tcctl_load_freq_path(path, load_cpus, "scaling_cur_freq");
+		if (!ok || max == 0 || (load_freq_fds[load_cpus] = open(path, O_RDONLY)) == -1)
+			break;
+		load_max_khz[load_cpus] = max;
+	}
+
+	char buf[ENTRY_LINE_MAX_LEN];
+	buf[uint_write(load_cpus, buf)] = '\0';
+	LOG_INFO("cpufreq cpus: ", buf);
+	return 1;
+}
+
+void
+tcctl_load_freq_path(char *path, unsigned int cpu, const char *name)
+{
+	char *p = path;
+	p += str_copy(LOAD_FREQ_PATH, p, SENSOR_PATH_MAX_LEN);
+	p += uint_write(cpu, p);
+	p += str_copy("/cpufreq/", p, ENTRY_LINE_MAX_LEN);
+	p += str_copy(name, p, ENTRY_NAME_MAX_LEN);
+	*p = '\0';
+}
+
+int
+tcctl_load_stat(unsigned int *busy, unsigned int *total)
+{
+	char buf[LOAD_BUF_LEN] = ZERO_STR;
+	if (pread(load_stat_fd, buf, LOAD_BUF_LEN - 1, 0) <= 0)
+	{
+		LOG_ERROR("could not read cpu stats: ", errno_msg(errno));
+		return 0;
+	}
+
+	// cpu  user nice system idle iowait irq softirq steal
+	const char *p = buf + 3;
+	if (!str_eq(buf, "cpu ", 4))
+		return 0;
+
+	*busy = *total = 0;
+	for (unsigned int i = 0; i < 8; i++)
+	{
+		unsigned int val;
+		while (*p == ' ')
+			p++;
+		int len = uint_scan(&val, p);
+		if (len == 0)
+			break;
+		p += len;
+		*total += val;
+		if (i != 3 && i != 4)
+			*busy += val;
+	}
+
+	return 1;
+}
+
+int
+tcctl_gpio_init(void)
+{
+	outputs.fd = -1;
+	tachs.fd = -1;
+	for (unsigned int i = 0; i < GPIO_LINES_MAX; i++)
+	{
+		outputs.pins[i].pin = -1;
+		outputs.pins[i].level = -1;
+	}
+
+	// the old binary's lines stay requested, levels and all
+	if (inherited)
+	{
+		gpio.chip_fd = upgrade.chip_fd;
+		gpio.use_v1 = upgrade.use_v1;
+		outputs = upgrade.outputs;
+		tachs = upgrade.tachs;
+		if (ioctl(gpio.chip_fd, GPIO_GET_CHIPINFO_IOCTL, &gpio.info) == -1)
+		{
+			LOG_ERROR("cannot read inherited gpio info", errno_msg(errno));
+			return 0;
+		}
+		LOG_INFO("gpio inherited", NULL);
+		return 1;
+	}
+
+	if (!gpio_open(&gpio))
+	{
+		LOG_ERROR("could not init gpio", NULL);	
+		return 0;
+	}
+	LOG_INFO("gpio ok", NULL);
+	return 1;
+}
+
+int
+tcctl_gpio_update_conf(void)
+{
+	struct gpio_lines want = { .num = 0, .fd = -1 };
+
+	// one try per conf generation, a failed request is not logged every tick
+	if (outputs_gen == ctx.zones_gen)
+		return 1;
+	outputs_gen = ctx.zones_gen;
+
+	// one line per zone with an output pin, all in a single request
+	for (unsigned int i = 0; i < ctx.zones_num; i++)
+	{
+		struct tcctl_conf *conf = &ctx.zones[i].conf;
+		struct gpio_pin *pin = &want.pins[want.num];
+		unsigned int l = 0;
+
+		output_lines[i] = -1;
+		if (conf->output_pin.uint == -1)
+			continue;
+
+		// a kept line keeps its level, a new one starts at the level
+		// decided for it
+		while (l < outputs.num && outputs.pins[l].pin != conf->output_pin.uint)
+			l++;
+		if (l < outputs.num)
+			*pin = outputs.pins[l];
+		else
+		{
+			pin->pin = conf->output_pin.uint;
+			pin->level = (output_vals >> i) & 1;
+			pin->commit_time = time_mono();
+		}
+		pin->pull = conf->output_bias.uint;
+		pin->drive = conf->output_drive.uint;
+		output_lines[i] = want.num++;
+	}
+
+	int changed = want.num != outputs.num || (want.num != 0 && outputs.fd == -1);
+	for (unsigned int l = 0; l < want.num && !changed; l++)
+	{
+		struct gpio_pin *pin = &want.pins[l], *was = &outputs.pins[l];
+		changed = 
+			pin->pin != was->pin || pin->pull != was->pull || 
+			pin->drive != was->drive;
+	}
+	if (!changed)
+		return 1;
+
+	gpio_release(&outputs);
+	outputs = want;
+	if (outputs.num == 0)
+		return 1;
+	return gpio_request(&gpio, &outputs);
+}
+
+int
+tcctl_gpio_write(void)
+{
+	unsigned long long vals = 0;
+	unsigned int reassert = 0;
+
+	if (!tcctl_gpio_update_conf())
+	{
+		LOG_ERROR("could not init gpio pin", NULL);
+		return 0;
+	}
+	// without its tach a zone just never stalls
+	tcctl_tach_update_conf();
+	if (outputs.fd == -1)
+		return outputs.num == 0;
+
+	for (unsigned int i = 0; i < ctx.zones_num; i++)
+	{
+		// shortest reassert delay of all zones wins
+		unsigned int delay = ctx.zones[i].conf.reassert_delay.uint;
+		if (delay != 0 && (reassert == 0 || delay < reassert))
+			reassert = delay;
+
+		// zone bits to line bits, a zone without output has no line
+		if (output_lines[i] != -1 && (output_vals >> i) & 1)
+			vals |= 1ULL << output_lines[i];
+	}
+
+	return gpio_commit(&gpio, &outputs, vals, reassert);
+}
+
+int
+tcctl_tach_update_conf(void)
+{
+	struct gpio_lines want = { .num = 0, .fd = -1 };
+
+	// one try per conf generation, a failed request is not logged every tick
+	if (tachs_gen == ctx.zones_gen)
+		return 1;
+	tachs_gen = ctx.zones_gen;
+
+	// one input line per tach pin, zones may share it
+	for (unsigned int i = 0; i < ctx.zones_num; i++)
+	{
+		unsigned int pin = ctx.zones[i].conf.tach_pin.uint, l = 0;
+		if (pin == -1)
+			continue;
+		while (l < want.num && want.pins[l].pin != pin)
+			l++;
+		if (l == want.num)
+			want.pins[want.num++].pin = pin;
+	}
+
+	int changed = want.num != tachs.num || (want.num != 0 && tachs.fd == -1);
+	for (unsigned int l = 0; l < want.num && !changed; l++)
+		changed = want.pins[l].pin != tachs.pins[l].pin;
+	if (!changed)
+		return 1;
+
+	gpio_release(&tachs);
+	tachs = want;
+	struct tach_window empty = { .num = 0 };
+	for (unsigned int l = 0; l < GPIO_LINES_MAX; l++)
+		tach_wins[l] = empty;
+	if (tachs.num == 0)
+		return 1;
+
+	// v1 line events have no per line seqno and need one fd a line
+	if (gpio.use_v1)
+	{
+		LOG_WARN("no fan tach on the v1 gpio uapi", NULL);
+		return 0;
+	}
+	if (!gpio_request_edges(&gpio, &tachs))
+	{
+		LOG_ERROR("could not get the tach lines", errno_msg(errno));
+		return 0;
+	}
+
+	LOG_INFO("tach lines ok", NULL);
+	return 1;
+}
+
+void
+tcctl_tach_drain(void)
+{
+	struct gpio_v2_line_event events[TACH_EVENTS_LEN];
+	struct tach_batch batch[GPIO_LINES_MAX];
+	unsigned int seen = 0;
+	ssize_t len;
+
+	// the loop never wakes up for an edge, they queue in the kernel with
+	// their timestamps and are read here a buffer at a time
+	while ((len = read(tachs.fd, events, sizeof(events))) > 0)
+	{
+		for (size_t e = 0; e < len / sizeof(*events); e++)
+		{
+			struct gpio_v2_line_event *ev = &events[e];
+			unsigned int l = 0;
+			while (l < tachs.num && tachs.pins[l].pin != ev->offset)
+				l++;
+			if (l == tachs.num)
+				continue;
+
+			if (!(seen & 1U << l))
+			{
+				batch[l].first_seq = ev->line_seqno;
+				batch[l].first_ns = ev->timestamp_ns;
+				seen |= 1U << l;
+			}
+			batch[l].last_seq = ev->line_seqno;
+			batch[l].last_ns = ev->timestamp_ns;
+		}
+
+		if (len < sizeof(events))
+			break;
+	}
+	if (len == -1 && errno != EAGAIN)
+		LOG_WARN("could not read tach events: ", errno_msg(errno));
+
+	for (unsigned int l = 0; l < tachs.num; l++)
+	{
+		if (!(seen & 1U << l))
+			continue;
+
+		// a full ring drops its oldest batch
+		struct tach_window *win = &tach_wins[l];
+		win->batches[win->head] = batch[l];
+		win->head = (win->head + 1) % TACH_BATCHES;
+		if (win->num < TACH_BATCHES)
+			win->num++;
+	}
+}
+
+unsigned int
+tach_window_rpm(struct tach_window *win, unsigned long long now_ns, unsigned int ppr)
+{
+	unsigned long long window_ns = TACH_WINDOW_MS * 1000000ULL;
+	unsigned int oldest;
+
+	// batches that ended before the window are gone, no edges - stopped
+	for (; win->num > 0; win->num--)
+	{
+		oldest = (win->head + TACH_BATCHES - win->num) % TACH_BATCHES;
+		if (win->batches[oldest].last_ns + window_ns >= now_ns)
+			break;
+	}
+	if (win->num == 0 || ppr == 0)
+		return 0;
+
+	// first edge of the oldest to the last of the newest, seqno counts
+	// the edges in between, those the kernel buffer dropped too
+	struct tach_batch *first = &win->batches[oldest];
+	struct tach_batch *last = &win->batches[(win->head + TACH_BATCHES - 1) % TACH_BATCHES];
+	unsigned long long edges = last->last_seq - first->first_seq;
+	unsigned long long span = last->last_ns - first->first_ns;
+	if (edges == 0 || span == 0)
+		return 0;
+	return edges * 60000000000ULL / (span * ppr);
+}
+
+#define RC_ADDR(ADDR) (struct sockaddr *)(ADDR).addr, (ADDR).len
+#define RECV_RC_ADDR(ADDR) (struct sockaddr *)(ADDR).addr, &((ADDR).len)
+
+size_t
+tcctl_rc_addr_len(const char *path)
+{
+	return offsetof(struct sockaddr_un, sun_path) + 
+		str_len(path, UNSCK_SUN_ADDR_LEN) + 1; 
+}
+
+void
+tcctl_rc_addr_set(struct tcctl_rc_addr *addr, const char *path)
+{
+	addr->addr->sun_family = AF_UNIX;
+	str_copy(path, addr->addr->sun_path, UNSCK_SUN_ADDR_LEN);
+	addr->len = tcctl_rc_addr_len(path);
+
+	// the name of an abstract socket is as long as the address says
+	if (*path == RC_ABSTRACT)
+	{
+		addr->addr->sun_path[0] = '\0';
+		addr->len--;
+	}
+}
+
+int
+tcctl_rc_listen_fd(void)
+{
+	// systemd style socket activation, for us if the pid is ours
+	const char *pid = getenv("LISTEN_PID"), *fds = getenv("LISTEN_FDS");
+	unsigned int listen_pid, listen_fds;
+	if (
+		pid == NULL || fds == NULL || 
+		uint_read(&listen_pid, pid) <= 0 || listen_pid != (unsigned int)getpid() ||
+		uint_read(&listen_fds, fds) <= 0 || listen_fds == 0
+	)
+		return -1;
+
+	// not for the children, nor for the binary of an upgrade
+	unsetenv("LISTEN_PID");
+	unsetenv("LISTEN_FDS");
+	unsetenv("LISTEN_FDNAMES");
+	if (listen_fds > 1)
+		LOG_WARN("more than one socket passed, using the first", NULL);
+
+	int type;
+	socklen_t len = sizeof(type);
+	if (
+		getsockopt(LISTEN_FDS_START, SOL_SOCKET, SO_TYPE, &type, &len) == -1 || 
+		type != SOCK_DGRAM
+	)
+	{
+		LOG_WARN("passed fd is not a datagram socket, ignored", NULL);
+		return -1;
+	}
+
+	return LISTEN_FDS_START;
+}
+
+int
+tcctl_rc_init(const char *path)
+{
+	unsck_addr.addr = &unsck_sun_addr;	
+	tcctl_rc_addr_set(&unsck_addr, path);
+
+	// bound already, with whatever clients queued during the exec
+	if (inherited)
+	{
+		unsck_fd = upgrade.unsck_fd;
+		rc_activated = upgrade.rc_activated;
+		LOG_INFO("socket inherited: ", path);
+		return 1;
+	}
+
+	// a socket from the service manager is there before we are
+	unsck_fd = tcctl_rc_listen_fd();
+	rc_activated = unsck_fd != -1;
+	if (rc_activated)
+	{
+		LOG_INFO("socket from the service manager", NULL);
+		fcntl(unsck_fd, F_SETFL, fcntl(unsck_fd, F_GETFL) | O_NONBLOCK);
+	}
+	else
+		unsck_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if (unsck_fd == -1)
+	{
+		LOG_ERROR("could not get af_unix socket: ", errno_msg(errno));
+		return 0;
+	}
+
+	// every datagram comes with the sender pid for the rate limits
+	int on = 1;
+	if (setsockopt(unsck_fd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)) == -1)
+		LOG_WARN("no sender credentials, one rate limit for all: ", errno_msg(errno));
+
+	if (rc_activated)
+		return 1;
+
+	LOG_INFO("bind address: ", path);
+	if (*path != RC_ABSTRACT)
+		unlink(path);
+	if (bind(unsck_fd, RC_ADDR(unsck_addr)) == -1)
+	{
+		LOG_ERROR("could not bind address: ", errno_msg(errno));
+		return 0;
+	}
+
+	LOG_INFO("remote ctl ok", NULL);
+	return 1;
+}
+
+int
+tcctl_rc_end(void)
+{
+	// abstract names go with the fd, activated sockets stay for the next start
+	const char *path = unsck_addr.addr->sun_path;
+	if (*path == '\0' || rc_activated)
+		return 1;
+
+	LOG_INFO("unlink socket: ", path);
+	if (unlink(path) == -1)
+	{
+		LOG_ERROR("could not unlink socket: ", errno_msg(errno));
+		return 0;
+	}
+
+	return 1;
+}
+
+int
+tcctl_rc_recv_all(void)
+{
+	unsigned int num = 0;
+	struct msghdr peek = { .msg_iov = NULL };
+
+	for (;;)
+	{
+		// drops are cheap and do not count against the budget
+		unsigned long long now = time_mono_ms();
+		if (
+			num == RC_PASS_MAX || 
+			!tcctl_bucket_fill(&rc_budget, now, RC_BUDGET_RATE, RC_BUDGET_BURST)
+		)
+		{
+			// deferred only if something is left, empty datagrams too
+			if (recvmsg(unsck_fd, &peek, MSG_PEEK | MSG_DONTWAIT) != -1)
+				rc_deferred++;
+			return 1;
+		}
+
+		// read until the queue is empty, a length of 0 is a datagram too
+		num++;
+		int run = tcctl_rc_recv_msg();
+		if (run == -1)
+			return 1;
+		if (!run)
+			return 0;
+
+		// the rest of the queue is for the new binary
+		if (upgrade_due)
+		{
+			upgrade_due = 0;
+			tcctl_upgrade_exec();
+			return 1;
+		}
+	}
+}
+
+int
+tcctl_bucket_fill(
+		struct tcctl_rc_bucket *bucket,
+		unsigned long long now,
+		unsigned int rate,
+		unsigned int burst
+)
+{
+	unsigned long long tokens = bucket->tokens + (now - bucket->ms) * rate;
+	bucket->tokens = tokens > burst * 1000ULL ? burst * 1000 : tokens;
+	bucket->ms = now;
+	return bucket->tokens >= 1000;
+}
+
+struct tcctl_rc_bucket *
+tcctl_rc_client(pid_t pid, unsigned long long now)
+{
+	// the client heard from longest ago makes room, a full bucket to start
+	struct tcctl_rc_bucket *oldest = &rc_clients[0];
+	for (unsigned int i = 0; i < RC_CLIENTS_MAX; i++)
+	{
+		if (rc_clients[i].pid == pid)
+			return &rc_clients[i];
+		if (rc_clients[i].ms < oldest->ms)
+			oldest = &rc_clients[i];
+	}
+
+	struct tcctl_rc_bucket fresh = { .pid = pid, .tokens = RC_CLIENT_BURST * 1000, .ms = now };
+	*oldest = fresh;
+	return oldest;
+}
+
+unsigned int
+tcctl_rc_stat(unsigned int param_id)
+{
+	if (param_id == STAT_RC_DROPPED)
+		return rc_dropped;
+	if (param_id == STAT_RC_DEFERRED)
+		return rc_deferred;
+	if (param_id == STAT_TICKS)
+		return ticks;
+	if (param_id == STAT_TICK_LATE)
+		return tick_late;
+	if (param_id == STAT_TICK_LATE_MAX)
+		return tick_late_max;
+	return 0;
+}
+
+int
+tcctl_rc_recv_msg(void)
+{	
+	// room for the whole client path, replies go back to it
+	struct sockaddr_un cl_sun_addr = { .sun_family = AF_UNIX };
+	struct tcctl_rc_addr cl_addr = { &cl_sun_addr, sizeof(cl_sun_addr) };
+	union tcctl_rc_buf rc_buf;
+	int run = 1;
+
+	// the sender, from the kernel
+	char cmsg_buf[CMSG_SPACE(sizeof(struct ucred))];
+	struct iovec iov = { &rc_buf, sizeof(rc_buf) };
+	struct msghdr mh =
+	{
+		.msg_name = cl_addr.addr,
+		.msg_namelen = cl_addr.len,
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cmsg_buf,
+		.msg_controllen = sizeof(cmsg_buf)
+	};
+
+	int rc_msg_size = recvmsg(unsck_fd, &mh, MSG_DONTWAIT);
+	cl_addr.len = mh.msg_namelen;
+
+	// nothing a client sends ends the loop, only KILL
+	if (rc_msg_size == -1)
+	{
+		if (errno != EAGAIN && errno != EINTR)
+			LOG_ERROR("could not receive message: ", errno_msg(errno));
+		return -1;
+	}
+
+	// over its rate a client is not even answered
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mh);
+	pid_t pid = 0;
+	if (cmsg != NULL && cmsg->cmsg_type == SCM_CREDENTIALS)
+		pid = ((struct ucred *)CMSG_DATA(cmsg))->pid;
+
+	unsigned long long now = time_mono_ms();
+	struct tcctl_rc_bucket *client = tcctl_rc_client(pid, now);
+	if (!tcctl_bucket_fill(client, now, RC_CLIENT_RATE, RC_CLIENT_BURST))
+	{
+		if (now - client->warn_ms >= RC_WARN_MS)
+		{
+			char buf[ENTRY_LINE_MAX_LEN];
+			buf[uint_write(pid, buf)] = '\0';
+			LOG_WARN("client over rate limit, pid: ", buf);
+			client->warn_ms = now;
+		}
+		rc_dropped++;
+		return 1;
+	}
+	client->tokens -= 1000;
+	rc_budget.tokens -= 1000;
+
+	if (rc_msg_size < sizeof(struct tcctl_rc_head))
+	{
+		LOG_WARN("dropped message without header", NULL);
+		rc_dropped++;
+		return 1;
+	}
+
+	// the reply defaults to a bare ACK for the same seq
+	struct tcctl_rc_msg ret_msg = { .head = rc_buf.head };
+	ret_msg.head.version = RC_VERSION;
+	ret_msg.head.status = RC_OK;
+	ret_msg.head.cmd = ACK;
+	ret_msg.p1.uint = rc_buf.head.cmd;
+	PROBE4(rc__msg, rc_buf.head.cmd, rc_buf.head.zone, rc_buf.head.seq, rc_msg_size);
+
+	// a batch is as long as its sets
+	size_t batch_head = offsetof(struct tcctl_rc_batch, sets);
+	if (rc_buf.head.version != RC_VERSION)
+		ret_msg.head.status = RC_EVERSION;
+	else if (rc_buf.head.cmd == SETB)
+	{
+		if (
+			rc_msg_size >= batch_head && rc_buf.batch.num <= RC_BATCH_MAX &&
+			rc_msg_size == batch_head + 
+				rc_buf.batch.num * sizeof(struct tcctl_conf_update)
+		)
+			tcctl_rc_handle_batch(&rc_buf.batch, &ret_msg);
+		else
+			ret_msg.head.status = RC_EMSG;
+	}
+	else if (rc_msg_size != sizeof(struct tcctl_rc_msg))
+		ret_msg.head.status = RC_EMSG;
+	else
+		run = tcctl_rc_handle_msg(&rc_buf.msg, &ret_msg);
+
+	if (ret_msg.head.status != RC_OK)
+	{
+		char buf[ENTRY_LINE_MAX_LEN];
+		buf[uint_write(ret_msg.head.status, buf)] = '\0';
+		LOG_WARN("refused message, status: ", buf);
+	}
+
+	tcctl_rc_send_msg(&ret_msg, &cl_addr);
+	PROBE3(rc__msg__done, rc_buf.head.cmd, rc_buf.head.seq, ret_msg.head.status);
+	if (!run)
+		LOG_WARN("received kill command", NULL);
+	return run;
+}
+
+int
+tcctl_rc_zoned(enum tcctl_rc_cmd cmd)
+{
+	// STAT checks the zone itself, some stats are not per zone
+	return 
+		cmd == OVRD || cmd == AUTO || cmd == TRIG || cmd == HINT || 
+		cmd == GET || cmd == SET || cmd == SETB;
+}
+
+struct tcctl_zone *
+tcctl_rc_zone(unsigned int zone_id)
+{
+	if (zone_id >= ctx.zones_num)
+	{
+		LOG_WARN("no such zone", NULL);
+		return NULL;
+	}
+
+	return &ctx.zones[zone_id];
+}
+
+int
+tcctl_rc_handle_msg(struct tcctl_rc_msg *msg, struct tcctl_rc_msg *ret_msg)
+{
+	struct tcctl_zone *zone = NULL;
+
+	// zone addressed commands check it once
+	if (
+		tcctl_rc_zoned(msg->head.cmd) && (zone = tcctl_rc_zone(msg->head.zone)) == NULL
+	)
+	{
+		ret_msg->head.status = RC_EZONE;
+		return 1;
+	}
+
+	switch (msg->head.cmd)
+	{
 		case STAT:	
-			ret_msg.cmd = INFO;
-			ret_msg.p1 = msg->p1;
-			rc_stat.uint = tcctl_stat_get(msg->p1.uint);
-			ret_msg.p2 = rc_stat;
-			return tcctl_rc_send_msg(&ret_msg, addr);
+			ret_msg->head.cmd = INFO;
+			ret_msg->p1 = msg->p1;
+			ret_msg->p2.uint = 
+				msg->p1.uint >= STAT_RC_DROPPED && msg->p1.uint <= STAT_TICK_LATE_MAX ?
+				tcctl_rc_stat(msg->p1.uint) :
+				tcctl_stat_get(&ctx, msg->head.zone, msg->p1.uint);
+			return 1;
 		case OVRD:
 			LOG_INFO("override output to ", msg->p1.boolean ? "run" : "idle");
-			run_stat.phase = msg->p1.boolean ? 
+			zone->stat.phase = msg->p1.boolean ? 
 				OVRD_RUN : OVRD_IDLE;
+			tcctl_ctx_kick(&ctx, msg->head.zone);
 			return 1;
 		case AUTO:
 			LOG_INFO("switch to auto mode", NULL);
-			run_stat.phase = RUN; // switch to auto mode
+			zone->stat.phase = RUN; // switch to auto mode
+			tcctl_ctx_kick(&ctx, msg->head.zone);
 			return 1;
 		case TRIG:
 			LOG_INFO("update trigger temps", NULL);
-			run_stat.low_temp = msg->p1.uint;
-			run_stat.trig_temp = msg->p2.uint;
+			zone->stat.low_temp = msg->p1.uint;
+			zone->stat.trig_temp = msg->p2.uint;
+			tcctl_ctx_kick(&ctx, msg->head.zone);
+			return 1;
+		case HINT:
+			LOG_INFO("heat hint for zone: ", zone->conf.name);
+			// overrides keep the fan, the hint runs out underneath
+			if (zone->stat.phase == OVRD_IDLE || zone->stat.phase == OVRD_RUN)
+				LOG_WARN("zone overridden, hint waits for auto mode", NULL);
+			tcctl_zone_hint(&ctx, msg->head.zone, msg->p1.uint, msg->p2.uint, msg->p3.uint);
+			tcctl_ctx_kick(&ctx, msg->head.zone);
+			return 1;
+#ifndef TCCTL_BAKED
+		// a baked conf has no fields to get or set and nothing to reload
+		case GET:
+			ret_msg->head.cmd = CVAL;
+			ret_msg->p1 = msg->p1;
+			if (!tcctl_conf_field_get(
+					&ctx.conf_live->zones[msg->head.zone], 
+					msg->p1.uint, 
+					&ret_msg->p2.uint
+			))
+				ret_msg->head.status = RC_EMSG;
+			return 1;
+		case SET:
+		{
+			struct tcctl_conf_update update = { msg->p1.uint, msg->p2.uint };
+			LOG_INFO("set conf field", NULL);
+			if (!tcctl_conf_update(&ctx, msg->head.zone, &update, 1))
+				tcctl_rc_conf_err(ret_msg);
+			else if (msg->p3.boolean)
+				tcctl_conf_save();
 			return 1;
+		}
 		case CONF:
 			LOG_INFO("request conf reload", NULL);
-			if (!tcctl_conf_load(conf_fd))
+			if (!tcctl_conf_load(conf_fd, 0) || !tcctl_zones_apply(&ctx))
 			{
-				ret_msg.cmd = CERR;
-				ret_msg.p1.sint = conf_errline;
-				ret_msg.p2.sint = conf_errentid;
-
 				LOG_WARN("could not load conf", NULL);
-				tcctl_rc_send_msg(&ret_msg, addr);
-				return 0;
+				tcctl_rc_conf_err(ret_msg);
 			}
 			return 1;
+#endif
 		case KILL:
 			LOG_INFO("request service kill", NULL);
 			return 0;
+		case UPGRADE:
+			// answered first, the exec follows the reply
+			LOG_INFO("request upgrade", NULL);
+			if (sim_src != NULL || exe_path[0] == '\0')
+				ret_msg->head.status = RC_ECMD;
+			else
+				upgrade_due = 1;
+			return 1;
 		default:
-			return 0;
+			ret_msg->head.status = RC_ECMD;
+			return 1;
+	}
+}
+
+int
+tcctl_rc_handle_batch(struct tcctl_rc_batch *batch, struct tcctl_rc_msg *ret_msg)
+{
+	LOG_INFO("set conf fields", NULL);
+#ifdef TCCTL_BAKED
+	ret_msg->head.status = RC_ECMD;
+	return 0;
+#else
+	if (tcctl_rc_zone(batch->head.zone) == NULL)
+	{
+		ret_msg->head.status = RC_EZONE;
+		return 0;
+	}
+	if (!tcctl_conf_update(&ctx, batch->head.zone, batch->sets, batch->num))
+	{
+		tcctl_rc_conf_err(ret_msg);
+		return 0;
 	}
+
+	if (batch->write_back)
+		tcctl_conf_save();
+	return 1;
+#endif
+}
+
+void
+tcctl_rc_conf_err(struct tcctl_rc_msg *ret_msg)
+{
+	ret_msg->head.cmd = CERR;
+	ret_msg->head.status = RC_ECONF;
+	ret_msg->p1.sint = ctx.conf_errline;
+	ret_msg->p2.sint = ctx.conf_errentid;
 }
 
 int
@@ -517,6 +1831,7 @@ tcctl_rc_send_msg(struct tcctl_rc_msg *msg, struct tcctl_rc_addr *addr)
 		RC_ADDR(*addr)
 	);
 
+	// the client resends, nothing to do here
 	if (rc_msg_size == -1)
 	{
 		LOG_ERROR("could not send message: ", errno_msg(errno));
@@ -526,122 +1841,389 @@ tcctl_rc_send_msg(struct tcctl_rc_msg *msg, struct tcctl_rc_addr *addr)
 	if (rc_msg_size != sizeof(struct tcctl_rc_msg))
 	{
 		LOG_WARN("sent malformed data/no data", NULL);
-		// TODO retry
 		return 0;
 	}
 
 	return 1;
 }
 
-unsigned int
-tcctl_stat_get(unsigned int param_id)
-{
-	switch (param_id)
-	{
-		case 0:
-			return run_stat.last_temp;
-		case 1:
-			return run_stat.low_temp;
-		case 2:
-			return run_stat.trig_temp;
-		case 3:
-			return run_stat.phase;
-		default:
-			return 0;
+int
+tcctl_trip_init(void)
+{
+	// a board has the kernel's trips, a simulation only the test socket
+	if (sim_src == NULL && !tcctl_trip_nl_open())
+		LOG_WARN("no thermal netlink, trips from hwmon alarms only", NULL);
+	if (trip_sock_path != NULL && !tcctl_trip_sock_open())
+		return 0;
+	return 1;
+}
+
+int
+tcctl_trip_nl_open(void)
+{
+	unsigned int group;
+
+	trip_nl_fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+	if (trip_nl_fd == -1)
+	{
+		LOG_WARN("could not get a netlink socket: ", errno_msg(errno));
+		return 0;
+	}
+
+	// the reply to the family lookup is waited for, the events never
+	if (
+		!tcctl_trip_nl_group(trip_nl_fd, &group) ||
+		setsockopt(trip_nl_fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) == -1 ||
+		fcntl(trip_nl_fd, F_SETFL, O_NONBLOCK) == -1
+	)
+	{
+		close(trip_nl_fd);
+		trip_nl_fd = -1;
+		return 0;
 	}
+
+	LOG_INFO("thermal netlink events ok", NULL);
+	return 1;
 }
 
-void
-tcctl_stat_update(struct tcctl_stat *stat, struct tcctl_conf *conf)
+int
+tcctl_trip_nl_group(int fd, unsigned int *group)
+{
+	struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+	struct
+	{
+		struct nlmsghdr nh;
+		struct genlmsghdr gh;
+		char attr[NLA_HDRLEN + NLA_ALIGN(sizeof(THERMAL_GENL_FAMILY_NAME))];
+	} req = { { 0 } };
+	char buf[TRIP_BUF_LEN];
+	const struct nlattr *nla, *grp, *at;
+
+	// the thermal family by name, the reply lists its multicast groups
+	struct nlattr *name = (struct nlattr *)req.attr;
+	name->nla_type = CTRL_ATTR_FAMILY_NAME;
+	name->nla_len = NLA_HDRLEN + sizeof(THERMAL_GENL_FAMILY_NAME);
+	str_copy(THERMAL_GENL_FAMILY_NAME, req.attr + NLA_HDRLEN, sizeof(THERMAL_GENL_FAMILY_NAME));
+	req.nh.nlmsg_len = sizeof(req);
+	req.nh.nlmsg_type = GENL_ID_CTRL;
+	req.nh.nlmsg_flags = NLM_F_REQUEST;
+	req.gh.cmd = CTRL_CMD_GETFAMILY;
+	req.gh.version = 1;
+
+	if (sendto(fd, &req, sizeof(req), 0, (struct sockaddr *)&kernel, sizeof(kernel)) == -1)
+	{
+		LOG_WARN("could not ask for the thermal family: ", errno_msg(errno));
+		return 0;
+	}
+
+	ssize_t len = read(fd, buf, sizeof(buf));
+	const struct nlmsghdr *nh = (const struct nlmsghdr *)buf;
+	if (len == -1 || !NLMSG_OK(nh, len) || nh->nlmsg_type == NLMSG_ERROR)
+	{
+		LOG_WARN("no thermal netlink family", NULL);
+		return 0;
+	}
+
+	// groups nest in groups, the one named event carries the trips
+	const char *p = (const char *)NLMSG_DATA(nh) + GENL_HDRLEN;
+	const char *end = (const char *)nh + nh->nlmsg_len;
+	while ((nla = tcctl_nla_next(&p, end)) != NULL)
+	{
+		if ((nla->nla_type & NLA_TYPE_MASK) != CTRL_ATTR_MCAST_GROUPS)
+			continue;
+
+		const char *g = (const char *)nla + NLA_HDRLEN;
+		const char *g_end = (const char *)nla + nla->nla_len;
+		while ((grp = tcctl_nla_next(&g, g_end)) != NULL)
+		{
+			const char *a = (const char *)grp + NLA_HDRLEN;
+			const char *a_end = (const char *)grp + grp->nla_len;
+			int found = 0, has_id = 0;
+			while ((at = tcctl_nla_next(&a, a_end)) != NULL)
+			{
+				const char *data = (const char *)at + NLA_HDRLEN;
+				if (at->nla_type == CTRL_ATTR_MCAST_GRP_NAME)
+					found = str_eq(data, THERMAL_GENL_EVENT_GROUP_NAME,
+						sizeof(THERMAL_GENL_EVENT_GROUP_NAME));
+				if (at->nla_type == CTRL_ATTR_MCAST_GRP_ID)
+				{
+					*group = *(const unsigned int *)data;
+					has_id = 1;
+				}
+			}
+			if (found && has_id)
+				return 1;
+		}
+	}
+
+	LOG_WARN("no thermal event group", NULL);
+	return 0;
+}
+
+const struct nlattr *
+tcctl_nla_next(const char **p, const char *end)
 {
-	stat->low_temp = conf->low_temp.uint;
-	stat->trig_temp = conf->trig_temp.uint;
+	// the attribute at *p if it fits, *p moves past it
+	const struct nlattr *nla = (const struct nlattr *)*p;
+	if (*p + NLA_HDRLEN > end || nla->nla_len < NLA_HDRLEN || *p + nla->nla_len > end)
+		return NULL;
+
+	*p += NLA_ALIGN(nla->nla_len);
+	return nla;
 }
 
 int
-tcctl_temp_read(int fd, unsigned int *val)
+tcctl_trip_sock_open(void)
 {
-	char str[TEMP_BUF_MAX_LEN] = ZERO_STR;
-	if (pread(fd, str, TEMP_BUF_MAX_LEN, 0) == -1)
+	trip_addr.addr = &trip_sun_addr;
+	tcctl_rc_addr_set(&trip_addr, trip_sock_path);
+
+	// a path left by the binary before an upgrade is ours
+	if (*trip_sock_path != RC_ABSTRACT)
+		unlink(trip_sock_path);
+
+	LOG_INFO("trip test socket: ", trip_sock_path);
+	trip_sock_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if (
+		trip_sock_fd == -1 ||
+		bind(trip_sock_fd, (struct sockaddr *)trip_addr.addr, trip_addr.len) == -1
+	)
 	{
-		LOG_ERROR("could not read sensor: ", errno_msg(errno));
-		close(fd);
+		LOG_ERROR("could not bind trip socket: ", errno_msg(errno));
 		return 0;
 	}
-	
-	unsigned int temp = 0;
 
-	uint_read(&temp, str);
-	*val = temp / 1000;
 	return 1;
 }
 
+int
+tcctl_trip_fds(fd_set *read_fds, fd_set *except_fds, int nfds)
+{
+	// sysfs signals a changed alarm as an exception
+	for (unsigned int z = 0; z < ctx.zones_num; z++)
+	{
+		for (unsigned int i = 0; i < ZONE_SENSORS_MAX; i++)
+		{
+			int fd = alarm_fds[z][i];
+			if (fd == -1)
+				continue;
+			FD_SET(fd, except_fds);
+			if (fd >= nfds)
+				nfds = fd + 1;
+		}
+	}
+
+	int fds[2] = { trip_nl_fd, trip_sock_fd };
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		if (fds[i] == -1)
+			continue;
+		FD_SET(fds[i], read_fds);
+		if (fds[i] >= nfds)
+			nfds = fds[i] + 1;
+	}
+
+	return nfds;
+}
+
 void
-tcctl_conf_reset(struct tcctl_conf *conf)
+tcctl_trip_ready(fd_set *read_fds, fd_set *except_fds)
 {
-	conf->low_temp.uint = LOW_TEMP_DEFAULT;
-	conf->trig_temp.uint = TRIG_TEMP_DEFAULT;
-	conf->hyst_dec_temp.uint = HYST_DEC_TEMP_DEFAULT;
+	unsigned int val;
+
+	if (trip_nl_fd != -1 && FD_ISSET(trip_nl_fd, read_fds))
+		tcctl_trip_nl_read();
+	if (trip_sock_fd != -1 && FD_ISSET(trip_sock_fd, read_fds))
+		tcctl_trip_sock_read();
 
-	conf->update_delay.uint = UPDATE_DELAY_DEFAULT;
-	conf->output_pin.uint = OUTPUT_PIN_DEFAULT;
+	for (unsigned int z = 0; z < ctx.zones_num; z++)
+	{
+		int tripped = 0;
+		for (unsigned int i = 0; i < ZONE_SENSORS_MAX; i++)
+		{
+			int fd = alarm_fds[z][i];
+			if (fd == -1 || !FD_ISSET(fd, except_fds))
+				continue;
 
-	conf->stay_on.boolean = 0;
-	conf->stop.boolean = 0;
-	conf->pin_invert.boolean = 0;
+			// read to rearm, raised or cleared the zone decides now
+			tcctl_uint_pread(fd, &val);
+			tripped = 1;
+		}
+		if (tripped)
+			tcctl_zone_trip(&ctx, z);
+	}
 }
 
 void
-tcctl_conf_apply(struct tcctl_conf *from, struct tcctl_conf *to)
+tcctl_trip_nl_read(void)
 {
-	to->low_temp = from->low_temp;
-	to->trig_temp = from->trig_temp;
-	to->hyst_dec_temp = from->hyst_dec_temp;
+	char buf[TRIP_BUF_LEN];
+	ssize_t len;
+	const struct nlattr *nla;
+
+	while ((len = read(trip_nl_fd, buf, sizeof(buf))) > 0)
+	{
+		int left = len;
+		for (
+			const struct nlmsghdr *nh = (const struct nlmsghdr *)buf; 
+			NLMSG_OK(nh, left); 
+			nh = NLMSG_NEXT(nh, left)
+		)
+		{
+			const struct genlmsghdr *gh = NLMSG_DATA(nh);
+			if (
+				nh->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN) ||
+				(gh->cmd != THERMAL_GENL_EVENT_TZ_TRIP_UP &&
+				gh->cmd != THERMAL_GENL_EVENT_TZ_TRIP_DOWN)
+			)
+				continue;
 
-	to->update_delay = from->update_delay;
-	to->output_pin = from->output_pin;
+			struct tcctl_trip trip = { .up = gh->cmd == THERMAL_GENL_EVENT_TZ_TRIP_UP };
+			const char *p = (const char *)gh + GENL_HDRLEN;
+			const char *end = (const char *)nh + nh->nlmsg_len;
+			int has_tz = 0;
+			while ((nla = tcctl_nla_next(&p, end)) != NULL)
+			{
+				const int *data = (const int *)((const char *)nla + NLA_HDRLEN);
+				if (nla->nla_type == THERMAL_GENL_ATTR_TZ_ID)
+				{
+					trip.tz = *data;
+					has_tz = 1;
+				}
+				else if (nla->nla_type == THERMAL_GENL_ATTR_TZ_TRIP_ID)
+					trip.trip = *data;
+				else if (nla->nla_type == THERMAL_GENL_ATTR_TZ_TEMP)
+					trip.temp = *data;
+			}
+			if (has_tz)
+				tcctl_trip_handle(&trip);
+		}
+	}
 
-	to->stay_on = from->stay_on;
-	to->stop = from->stop;
-	to->pin_invert = from->pin_invert;
+	// an overrun lost events, every zone decides now to be safe
+	if (len == -1 && errno == ENOBUFS)
+	{
+		LOG_WARN("thermal events lost", NULL);
+		for (unsigned int z = 0; z < ctx.zones_num; z++)
+			tcctl_zone_trip(&ctx, z);
+	}
 }
 
 void
-tcctl_conf_log_error(const char *msg, const char *entry)
+tcctl_trip_sock_read(void)
 {
-	char error_loc[ENTRY_NAME_MAX_LEN+ENTRY_LINE_MAX_LEN] = ZERO_STR;
-	char *p = error_loc;
+	struct tcctl_trip trip;
+	ssize_t len;
 
-	p += str_copy(entry, p, ENTRY_NAME_MAX_LEN);
-	p += str_copy(" in line ", p, ENTRY_LINE_MAX_LEN);
-	if (uint_write(conf_errline, p) <= 0)
+	while ((len = read(trip_sock_fd, &trip, sizeof(trip))) != -1)
 	{
-		p += str_copy("---", p, ENTRY_LINE_MAX_LEN);
-		LOG_ERROR(msg, error_loc);
+		if (len != sizeof(trip))
+		{
+			LOG_WARN("malformed trip datagram", NULL);
+			continue;
+		}
+		tcctl_trip_handle(&trip);
 	}
-	else
-		LOG_ERROR(msg, error_loc);
 }
 
-void
-tcctl_conf_log_load(
-		const char *msg, 
-		const char *entry, 
-		const char *val_text, 
-		size_t val_len
-)
+void
+tcctl_trip_handle(const struct tcctl_trip *trip)
+{
+	char buf[ENTRY_LINE_MAX_LEN];
+
+	buf[uint_write(trip->tz, buf)] = '\0';
+	LOG_INFO(trip->up ? "trip up, thermal zone: " : "trip down, thermal zone: ", buf);
+	if (tcctl_ctx_trip(&ctx, trip->tz) == 0)
+		LOG_INFO("no zone on that thermal zone", NULL);
+}
+
+void
+tcctl_trip_end(void)
+{
+	if (trip_sock_fd == -1 || *trip_sock_path == RC_ABSTRACT)
+		return;
+	unlink(trip_sock_path);
+}
+
+void
+tcctl_alarm_open(unsigned int zone, unsigned int sensor, const char *path)
+{
+	static const char *attrs[TRIP_ALARM_ATTRS] = { "_alarm", "_max_alarm", "_crit_alarm" };
+	char alarm[SENSOR_PATH_MAX_LEN + ENTRY_LINE_MAX_LEN];
+	int *fd = &alarm_fds[zone][sensor];
+	unsigned int val;
+
+	if (*fd != -1)
+	{
+		close(*fd);
+		*fd = -1;
+	}
+
+	// hwmon tempN_input has its alarms next to it
+	const char *suffix = path != NULL ? str_find(path, "_input", SENSOR_PATH_MAX_LEN) : NULL;
+	if (suffix == NULL || str_find(path, "hwmon", SENSOR_PATH_MAX_LEN) == NULL)
+		return;
+
+	for (unsigned int i = 0; i < TRIP_ALARM_ATTRS; i++)
+	{
+		char *p = alarm;
+		p += str_copy(path, p, suffix - path + 1);
+		p += str_copy(attrs[i], p, ENTRY_LINE_MAX_LEN);
+		*p = '\0';
+
+		*fd = open(alarm, O_RDONLY | O_NONBLOCK);
+		if (*fd == -1)
+			continue;
+
+		// sysfs notifies only after a first read
+		tcctl_uint_pread(*fd, &val);
+		LOG_INFO("hwmon alarm path: ", alarm);
+		return;
+	}
+}
+
+int
+tcctl_uint_pread(int fd, unsigned int *val)
+{
+	char str[TEMP_BUF_MAX_LEN] = ZERO_STR;
+	if (pread(fd, str, TEMP_BUF_MAX_LEN - 1, 0) <= 0)
+		return 0;
+	return uint_read(val, str) > 0;
+}
+
+int
+tcctl_temp_read(int fd, unsigned int *val)
+{
+	char str[TEMP_BUF_MAX_LEN] = ZERO_STR;
+	unsigned int temp = 0;
+
+	PROBE1(temp__read, fd);
+	if (pread(fd, str, TEMP_BUF_MAX_LEN, 0) == -1)
+	{
+		PROBE3(temp__read__done, fd, temp, 0);
+		LOG_ERROR("could not read sensor: ", errno_msg(errno));
+		close(fd);
+		return 0;
+	}
+
+	uint_read(&temp, str);
+	PROBE3(temp__read__done, fd, temp, 1);
+	*val = temp;
+	return 1;
+}
+
+#ifndef TCCTL_BAKED
+int
+tcctl_conf_load(int fd, int if_changed)
 {
-	char load_info[ENTRY_NAME_MAX_LEN+ENTRY_LINE_MAX_LEN] = ZERO_STR;
-	char *p = load_info;
-
-	p += str_copy(entry, p, ENTRY_NAME_MAX_LEN);
-	p += str_copy(" = ", p, ENTRY_LINE_MAX_LEN);
-	p += str_copy(val_text, p, val_len);
-	LOG_INFO(msg, load_info);
+	PROBE2(conf__load, fd, if_changed);
+	int ret = tcctl_conf_load_map(fd, if_changed);
+	PROBE2(conf__load__done, ret, ctx.conf_live->num);
+	return ret;
 }
 
 int
-tcctl_conf_load(int fd)
+tcctl_conf_load_map(int fd, int if_changed)
 {
 	struct stat fs;
 	if (fstat(fd, &fs) == -1)
@@ -653,8 +2235,12 @@ tcctl_conf_load(int fd)
 
 	if (fs.st_size == 0)
 	{
+		// FNV offset basis, the hash of nothing
+		if (if_changed && conf_hash == str_hash("", 0))
+			return -1;
+		conf_hash = str_hash("", 0);
 		LOG_WARN("empty conf file", NULL);
-		return 1;
+		return tcctl_conf_parse(&ctx, "");
 	}
 
 	char *memblk = mmap(NULL, fs.st_size, PROT_READ, MAP_SHARED, fd, 0);
@@ -665,311 +2251,211 @@ tcctl_conf_load(int fd)
 		return 0;
 	}
 
-	const char *str = memblk;
-
-	conf_errline = 0;
-	conf_errentid = -1;
-
-	for (;;)
+	// same bytes, nothing to do
+	unsigned long long hash = str_hash(memblk, fs.st_size);
+	if (if_changed && hash == conf_hash)
 	{
-		str = tcctl_conf_read_next_line(str);
-		conf_errline++;
-		if (str == NULL)
-		{
-			munmap(memblk, fs.st_size);
-			return 0;
-		}
-
-		if (*str == '\0') break;
+		munmap(memblk, fs.st_size);
+		return -1;
 	}
 
+	conf_hash = hash;
+	int ok = tcctl_conf_parse(&ctx, memblk);
 	munmap(memblk, fs.st_size);
-	LOG_INFO("load conf ok", NULL);
-	return 1;
+	if (ok)
+		LOG_INFO("load conf ok", NULL);
+	return ok;
 }
 
-#define CONF_IS_WSPACE(C) (C == ' ' || C == '\t')
-
-const char *
-tcctl_conf_read_next_line(const char *conf_str)
+int
+tcctl_conf_watch_init(void)
 {
-	const char *p = conf_str;
-	while (CONF_IS_WSPACE(*p))
-		p++;
-
-	if (*p == '\n')
-		return p + 1;
+	char dir[CONF_DIR_MAX_LEN] = ".";
+	size_t dir_len;
 
-	if (*p == '\0')
-		return p;
-
-	for (size_t i = 0; i < CONF_ENTRIES; i++)
+	conf_ino_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (conf_ino_fd == -1)
 	{
-		struct tcctl_conf_entry entry = tcctl_conf_entries[i];
-		size_t len = str_len(entry.name, ENTRY_NAME_MAX_LEN);
-		if (str_eq(p, entry.name, len))
-		{
-			p += len;
-			while (CONF_IS_WSPACE(*p)) 
-				p++;
-			int next = entry.read_fn(entry.field, p);
-			tcctl_conf_log_load(
-					"conf load entry: ", 
-					entry.name,
-					p,
-					next + 1
-			);
-			conf_errentid = i; // just in case
-			if (next == -1)
-			{
-				tcctl_conf_log_error(
-						"malformed conf entry: ", 
-						entry.name
-				);
-				return NULL;
-			}
-
-			return p+next+1;
-		}
+		LOG_ERROR("could not init inotify: ", errno_msg(errno));
+		return 0;
 	}
 
-	tcctl_conf_log_error("unknown conf entry: ", "");
-	conf_errline = 0;
-	conf_errentid = CONF_ENTRIES;
-	return NULL;
-}
-
-int
-tcctl_get_uint(union tcctl_conf_field *field, const char *val)
-{
-	return uint_read(&field->uint, val);
-}
-
-int
-tcctl_get_boolean(union tcctl_conf_field *field, const char *val)
-{
-	return boolean_read(&field->boolean, val);
-}
-
-void 
-tcctl_log_writeln(const char **msgs, size_t cnt)
-{
-	for (size_t i = 0; i < cnt; i++)
+	// the directory sees the file replaced by rename (editors, scp)
+	conf_base = conf_path;
+	for (const char *p = conf_path; *p != '\0'; p++)
 	{
-		const char *msg = *(msgs+i);
-		if (msg == NULL) continue;
-		size_t msg_len = str_len(msg, MSG_MAX_LEN);
-		if (log_fd)
-			write(log_fd, msg, msg_len);
-		write(stdout_fd, msg, msg_len);
+		if (*p == '/')
+			conf_base = p + 1;
+	}
+	dir_len = conf_base - conf_path;
+	if (dir_len >= CONF_DIR_MAX_LEN)
+	{
+		LOG_ERROR("conf dir too long: ", conf_path);
+		return 0;
+	}
+	if (dir_len > 0)
+	{
+		for (size_t i = 0; i < dir_len; i++)
+			dir[i] = conf_path[i];
+		dir[dir_len] = '\0';
 	}
-	if (log_fd)
-		write(log_fd, "\n", 1);
-	write(stdout_fd, "\n", 1);
-	if (log_fd)
-		fsync(log_fd);
-}
 
-void 
-tcctl_log_info(const char *msg, const char *val, const char *src, int warn)
-{
-	const char *header = warn ? "warn>" : "info>";
-	char time_buf[TIME_BUF_LEN] = ZERO_STR;
-	time_write(time_buf);
-	const char *msg_buf[] = 
-	{ 
-		header, " [", time_buf , "] ", msg, val, " (", src, ")" 
-	};
-	tcctl_log_writeln(msg_buf, 9);
-}
+	LOG_INFO("watch conf dir: ", dir);
+	conf_dir_wd = inotify_add_watch(conf_ino_fd, dir, CONF_DIR_EVENTS);
+	if (conf_dir_wd == -1)
+	{
+		LOG_ERROR("could not watch conf dir: ", errno_msg(errno));
+		return 0;
+	}
 
-void 
-tcctl_log_error(const char *msg, const char *val, const char *src, const char *loc)
-{
-	char time_buf[TIME_BUF_LEN] = ZERO_STR;
-	time_write(time_buf);
-	const char *msg_buf[] = 
-	{ 
-		"!err>", " [", time_buf, "] ", msg, val, " (", src, "/:", loc, ")" 
-	};
-	tcctl_log_writeln(msg_buf, 11);
+	tcctl_conf_watch_file();
+	return 1;
 }
 
 void
-tcctl_stdout_write(const char *msg)
+tcctl_conf_watch_file(void)
 {
-	write(stdout_fd, msg, str_len(msg, MSG_MAX_LEN));
+	// follows a symlinked conf, moves to the new inode on every reopen
+	int wd = inotify_add_watch(conf_ino_fd, conf_path, CONF_FILE_EVENTS);
+	if (conf_file_wd != -1 && wd != conf_file_wd)
+		inotify_rm_watch(conf_ino_fd, conf_file_wd);
+	conf_file_wd = wd;
 }
 
 int
-str_eq(const char *s1, const char *s2, size_t max_len)
+tcctl_conf_watch_read(void)
 {
-	for (size_t i = 0; i < max_len; i++)
+	char buf[CONF_EVENTS_LEN] __attribute__((aligned(__alignof__(struct inotify_event))));
+	size_t base_len = str_len(conf_base, CONF_DIR_MAX_LEN) + 1;
+	int hit = 0;
+	ssize_t len;
+
+	while ((len = read(conf_ino_fd, buf, CONF_EVENTS_LEN)) > 0)
 	{
-		if (*s1 != *s2) 
-			return 0;
-		if (*s1 == '\0' || *s2 == '\0') 
-			break;
-		s1++;
-		s2++;
+		const struct inotify_event *ev;
+		for (char *p = buf; p < buf + len; p += sizeof(*ev) + ev->len)
+		{
+			ev = (const struct inotify_event *)p;
+			if (ev->mask & IN_Q_OVERFLOW)
+				hit = 1;
+			else if (ev->wd == conf_file_wd)
+			{
+				hit = 1;
+				if (ev->mask & IN_IGNORED)
+					conf_file_wd = -1;
+			}
+			else if (ev->len > 0 && str_eq(ev->name, conf_base, base_len))
+				hit = 1;
+		}
 	}
 
-	return 1;
-}
-
-size_t
-str_copy(const char *from, char *to, size_t max_len)
-{
-	size_t len = 0;
-	while (*from != '\0' && len < max_len - 1)
+	if (len == -1 && errno != EAGAIN)
 	{
-		*to++ = *from++;
-		len++;
+		LOG_ERROR("could not read conf events: ", errno_msg(errno));
+		return 0;
 	}
 
-	return len;
+	// editors write in bursts, every event pushes the reload out
+	if (hit)
+		conf_due = time_mono_ms() + CONF_DEBOUNCE_MS;
+	return 1;
 }
 
-size_t 
-str_set(char c, char *to, size_t max_len)
+int
+tcctl_conf_reload(void)
 {
-	size_t len = 0;
-	while (*to != '\0' && len < max_len - 1)
+	conf_due = 0;
+	int fd = open(conf_path, O_RDONLY | O_NONBLOCK);
+	if (fd == -1)
 	{
-		*to++ = c;
-		len++;
+		LOG_WARN("conf gone, keep the last one: ", errno_msg(errno));
+		return 0;
 	}
-	
-	*to = '\0';
-	return len;
-}
-
-size_t
-str_len(const char *s, size_t max_len)
-{
-	size_t len = 0;
-	while (*s++ != '\0' && len < max_len - 1)
-		len++;
 
-	return len;
-}
+	// a renamed in file is a new inode, CONF reads that one from now on
+	close(conf_fd);
+	conf_fd = fd;
+	tcctl_conf_watch_file();
 
-size_t
-str_zlen(const char *s, size_t max_len)
-{
-	return str_len(s, max_len) + 1;
-}
+	int ok = tcctl_conf_load(conf_fd, 1);
+	if (ok == -1)
+		return 1;
 
-size_t 
-str_join(char *to, char *s, size_t max_len)
-{
-	size_t len = str_len(to, max_len);
-	char *p = to+len;
-	while (*s != '\0' && len < max_len - 1)
+	LOG_INFO("conf changed on disk, reload", NULL);
+	if (!ok || !tcctl_zones_apply(&ctx))
 	{
-		*p++ = *s++;
-		len++;
+		LOG_WARN("could not load conf", NULL);
+		return 0;
 	}
 
-	*p = '\0';
-	return len + 1;
+	return 1;
 }
 
 int
-uint_read(unsigned int *val, const char *str)
+tcctl_conf_save(void)
 {
-	const char *p = str;
-	unsigned short places = 0;
-	unsigned int mult = 1;
-	
-	while (*p != '\0' && *p != '\n')
-	{
-		if (*p >= '0' && *p <= '9')
-		{
-			mult *= 10;
-			places++;
-			p++;
-			continue;
-		}
-
-		if (*p == ' ' || *p == '_')
-		{
-			places++;
-			p++;
-			continue;
-		}
-
-		LOG_WARN("read malformed uint: ", str);
-		return -1;
-	}
+	static char str[CONF_ZONE_MAX_LEN * ZONES_MAX];
+	char tmp_path[CONF_DIR_MAX_LEN];
+	struct tcctl_conf_set *set = ctx.conf_live;
 
-	unsigned int num = 0;
-	for (size_t i = 0; i < places; i++)
+	// two writers would share the tmp file and race to the rename, the
+	// second one waits and then writes whatever is live by then
+	if (save_pid != -1)
 	{
-		char c = *(str+i);
-		if (c >= '0' && c <= '9')
-		{
-			mult /= 10;
-			num += (c - '0') * mult;
-		}
+		save_pending = 1;
+		return 1;
 	}
 
-	*val = num;
-	return places;
-}
-
-int
-uint_write(unsigned int val, char *str)
-{
-	unsigned short places = 0;
-	unsigned int num = val;
-	while (num > 0)
+	// formatting and fsync happen in a child, the loop does not wait
+	pid_t pid = fork();
+	if (pid == -1)
 	{
-		num /= 10;
-		places++;
+		LOG_ERROR("could not fork conf writer: ", errno_msg(errno));
+		return 0;
 	}
-
-	uint_write_pad(val, str, places);
-	return places;
-}
-
-int
-uint_write_pad(unsigned int val, char *str, size_t len)
-{
-	unsigned short places = 0;
-	char *p = str+len-1;
-	while (p >= str)
+	if (pid > 0)
 	{
-		int d = val % 10;
-		*p-- = d + '0';
-		val /= 10;
-		places++;
+		save_pid = pid;
+		return 1;
 	}
 
-	return places;
-}
+	int len = tcctl_conf_set_write(set, str, sizeof(str));
 
-int
-boolean_read(int *val, const char *str)
-{
-	int set_true = str_eq(str, "true", 4);
-	int set_false = str_eq(str, "false", 5);
+	if (str_len(conf_path, CONF_DIR_MAX_LEN) + sizeof(CONF_TMP_SUFFIX) > CONF_DIR_MAX_LEN)
+		_exit(1);
+	char *p = tmp_path + str_copy(conf_path, tmp_path, CONF_DIR_MAX_LEN);
+	p += str_copy(CONF_TMP_SUFFIX, p, sizeof(CONF_TMP_SUFFIX));
+	*p = '\0';
 
-	if (!set_true && !set_false)
+	// the old file stays whole until the rename
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (
+		len == -1 || fd == -1 || write(fd, str, len) != len || 
+		fsync(fd) == -1 || rename(tmp_path, conf_path) == -1
+	)
 	{
-		LOG_WARN("read malformed boolean: ", str);
-		return -1;
+		LOG_ERROR("could not write conf back: ", errno_msg(errno));
+		_exit(1);
 	}
 
-	*val = set_true;
-	return set_true ? 4 : 5;
+	LOG_INFO("conf written back: ", conf_path);
+	_exit(0);
 }
 
 int
-boolean_write(int val, char *str)
+tcctl_conf_save_poll(void)
 {
-	return str_copy(val ? "true" : "false", str, 5);
+	// still running, or gone and reaped with SIGCHLD ignored (ECHILD)
+	if (waitpid(save_pid, NULL, WNOHANG) == 0)
+		return 0;
+
+	save_pid = -1;
+	if (!save_pending)
+		return 1;
+	save_pending = 0;
+	return tcctl_conf_save();
 }
+#endif
 
 void
 gpio_print_pin(const char *msg, unsigned int pin)
@@ -1002,6 +2488,9 @@ gpio_warn_pin(struct gpio *gpio, unsigned int pin)
 int 
 gpio_open(struct gpio *gpio)
 {
+	if (gpio->label != NULL && !gpio_find(gpio))
+		return 0;
+
 	LOG_INFO("open gpio bank at: ", gpio->path);
 
 	if (gpio->path == NULL)
@@ -1029,6 +2518,40 @@ gpio_open(struct gpio *gpio)
 	return 1;
 }
 
+int
+gpio_find(struct gpio *gpio)
+{
+	LOG_INFO("find gpio bank labeled: ", gpio->label);
+
+	struct gpiochip_info info;
+	for (unsigned int i = 0; i < GPIO_CHIPS_MAX; i++)
+	{
+		char *p = gpio->path_buf;
+		p += str_copy("/dev/gpiochip", p, GPIO_PATH_LEN);
+		p += uint_write_pad(i, p, i < 10 ? 1 : 2);
+		*p = '\0';
+
+		// chip numbers may have gaps, keep looking
+		int fd = open(gpio->path_buf, O_RDONLY);
+		if (fd == -1)
+			continue;
+
+		int found = 
+			ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) != -1 &&
+			str_eq(info.label, gpio->label, GPIO_MAX_NAME_SIZE);
+		close(fd);
+
+		if (found)
+		{
+			gpio->path = gpio->path_buf;
+			return 1;
+		}
+	}
+
+	LOG_ERROR("no gpio bank labeled: ", gpio->label);
+	return 0;
+}
+
 int 
 gpio_close(struct gpio *gpio)
 {
@@ -1044,226 +2567,318 @@ gpio_close(struct gpio *gpio)
 	return 1;
 }
 
-int
-gpio_pin(struct gpio *gpio, struct gpio_pin *pin)
+unsigned long long
+gpio_v2_flags(struct gpio_pin *pin)
 {
-	gpio_warn_pin(gpio, pin->pin);
-
-	pin->hreq.lineoffsets[0] = pin->pin;
-	pin->hreq.flags = GPIOHANDLE_REQUEST_OUTPUT;
-	pin->hreq.lines = 1;
+	unsigned long long flags = GPIO_V2_LINE_FLAG_OUTPUT;
 
 	switch (pin->pull) 
 	{
 		case GPIO_NOPULL:
 			gpio_print_pin("no pull on pin: P", pin->pin);
-			pin->hreq.flags |= GPIOHANDLE_REQUEST_BIAS_DISABLE;
+			flags |= GPIO_V2_LINE_FLAG_BIAS_DISABLED;
 			break;
 		case GPIO_PULLDOWN:
 			gpio_print_pin("pull down on pin: P", pin->pin);
-			pin->hreq.flags |= GPIOHANDLE_REQUEST_BIAS_PULL_DOWN;
+			flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN;
 			break;
 		case GPIO_PULLUP:
 			gpio_print_pin("pull up on pin: P", pin->pin);
-			pin->hreq.flags |= GPIOHANDLE_REQUEST_BIAS_PULL_UP;
+			flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
 			break;
 	}
-	
-	if (ioctl(gpio->chip_fd, GPIO_GET_LINEHANDLE_IOCTL, &pin->hreq) == -1)
+
+	switch (pin->drive)
+	{
+		case GPIO_OPEN_DRAIN:
+			gpio_print_pin("open drain on pin: P", pin->pin);
+			flags |= GPIO_V2_LINE_FLAG_OPEN_DRAIN;
+			break;
+		case GPIO_OPEN_SOURCE:
+			gpio_print_pin("open source on pin: P", pin->pin);
+			flags |= GPIO_V2_LINE_FLAG_OPEN_SOURCE;
+			break;
+		case GPIO_PUSH_PULL:
+		default:
+			break;
+	}
+
+	return flags;
+}
+
+int
+gpio_request_v2(struct gpio *gpio, struct gpio_lines *lines)
+{
+	struct gpio_v2_line_request req = { { 0 } };
+	struct gpio_v2_line_config *conf = &req.config;
+	struct gpio_v2_line_config_attribute *attr;
+	unsigned long long known = 0, vals = 0;
+
+	for (unsigned int i = 0; i < lines->num; i++)
+	{
+		struct gpio_pin *pin = &lines->pins[i];
+		unsigned long long bit = 1ULL << i;
+		unsigned long long flags = gpio_v2_flags(pin);
+
+		req.offsets[i] = pin->pin;
+		if (pin->level != -1)
+			known |= bit;
+		if (pin->level == GPIO_HIGH)
+			vals |= bit;
+
+		if (i == 0)
+			conf->flags = flags;
+		if (flags == conf->flags)
+			continue;
+
+		// lines differing from the first one share attributes by flags,
+		// GPIO_LINES_MAX keeps that within GPIO_V2_LINE_NUM_ATTRS_MAX
+		unsigned int a = 0;
+		while (a < conf->num_attrs && conf->attrs[a].attr.flags != flags)
+			a++;
+		attr = &conf->attrs[a];
+		if (a == conf->num_attrs)
+		{
+			attr->attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+			attr->attr.flags = flags;
+			conf->num_attrs++;
+		}
+		attr->mask |= bit;
+	}
+
+	// keep committed levels through a re-request, no glitch
+	if (known != 0)
 	{
-		LOG_ERROR("could not get a handle for a pin", errno_msg(errno));
+		attr = &conf->attrs[conf->num_attrs++];
+		attr->attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		attr->attr.values = vals;
+		attr->mask = known;
+	}
+
+	req.num_lines = lines->num;
+	str_copy(GPIO_CONSUMER, req.consumer, GPIO_MAX_NAME_SIZE);
+
+	if (ioctl(gpio->chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) == -1)
 		return 0;
+
+	lines->fd = req.fd;
+	return 1;
+}
+
+int
+gpio_request_v1(struct gpio *gpio, struct gpio_lines *lines)
+{
+	struct gpiohandle_request hreq = { { 0 } };
+	struct gpio_pin *first = &lines->pins[0];
+
+	hreq.flags = GPIOHANDLE_REQUEST_OUTPUT;
+	switch (first->pull)
+	{
+		case GPIO_NOPULL:
+			hreq.flags |= GPIOHANDLE_REQUEST_BIAS_DISABLE;
+			break;
+		case GPIO_PULLDOWN:
+			hreq.flags |= GPIOHANDLE_REQUEST_BIAS_PULL_DOWN;
+			break;
+		case GPIO_PULLUP:
+			hreq.flags |= GPIOHANDLE_REQUEST_BIAS_PULL_UP;
+			break;
+	}
+	if (first->drive == GPIO_OPEN_DRAIN)
+		hreq.flags |= GPIOHANDLE_REQUEST_OPEN_DRAIN;
+	if (first->drive == GPIO_OPEN_SOURCE)
+		hreq.flags |= GPIOHANDLE_REQUEST_OPEN_SOURCE;
+
+	for (unsigned int i = 0; i < lines->num; i++)
+	{
+		struct gpio_pin *pin = &lines->pins[i];
+		// v1 handles have one config for all lines
+		if (pin->pull != first->pull || pin->drive != first->drive)
+			gpio_print_pin("v1 gpio ignores line config: P", pin->pin);
+		hreq.lineoffsets[i] = pin->pin;
+		hreq.default_values[i] = pin->level == GPIO_HIGH;
 	}
 
+	hreq.lines = lines->num;
+	str_copy(GPIO_CONSUMER, hreq.consumer_label, GPIO_MAX_NAME_SIZE);
+
+	if (ioctl(gpio->chip_fd, GPIO_GET_LINEHANDLE_IOCTL, &hreq) == -1)
+		return 0;
+
+	lines->fd = hreq.fd;
 	return 1;
 }
 
-int 
-gpio_write(struct gpio *gpio, struct gpio_pin *pin, enum gpio_val val)
+int
+gpio_request(struct gpio *gpio, struct gpio_lines *lines)
 {
-	struct gpiohandle_data hdat;
+	if (lines->num == 0 || lines->num > GPIO_LINES_MAX)
+	{
+		LOG_ERROR("bad number of gpio lines", NULL);
+		return 0;
+	}
 
-	hdat.values[0] = val;
+	gpio_release(lines);
+	for (unsigned int i = 0; i < lines->num; i++)
+		gpio_warn_pin(gpio, lines->pins[i].pin);
 
-	if (val == GPIO_LOW)
-		gpio_print_pin("write LOW: P", pin->pin);
-	else
-		gpio_print_pin("write HIGH: P", pin->pin);
+	if (!gpio->use_v1)
+	{
+		if (gpio_request_v2(gpio, lines))
+			return 1;
+		if (errno != ENOTTY)
+		{
+			LOG_ERROR("could not get a handle for lines", errno_msg(errno));
+			return 0;
+		}
+
+		LOG_WARN("no gpio v2 uapi, fall back to v1", NULL);
+		gpio->use_v1 = 1;
+	}
+
+	if (!gpio_request_v1(gpio, lines))
+	{
+		LOG_ERROR("could not get a handle for lines", errno_msg(errno));
+		return 0;
+	}
+
+	return 1;
+}
+
+int
+gpio_request_edges(struct gpio *gpio, struct gpio_lines *lines)
+{
+	struct gpio_v2_line_request req = { { 0 } };
+
+	if (lines->num == 0 || lines->num > GPIO_LINES_MAX)
+	{
+		LOG_ERROR("bad number of gpio lines", NULL);
+		return 0;
+	}
+
+	// one falling edge a tach pulse, tach outputs are open collector
+	req.config.flags = 
+		GPIO_V2_LINE_FLAG_INPUT | 
+		GPIO_V2_LINE_FLAG_EDGE_FALLING | 
+		GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+	for (unsigned int i = 0; i < lines->num; i++)
+	{
+		gpio_warn_pin(gpio, lines->pins[i].pin);
+		gpio_print_pin("tach input on pin: P", lines->pins[i].pin);
+		req.offsets[i] = lines->pins[i].pin;
+	}
+
+	req.num_lines = lines->num;
+	req.event_buffer_size = TACH_EVENTS_MAX;
+	str_copy(GPIO_CONSUMER, req.consumer, GPIO_MAX_NAME_SIZE);
+
+	if (ioctl(gpio->chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) == -1)
+		return 0;
 
-	if (ioctl(pin->hreq.fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &pin->hreq) == -1)
+	// drained once a tick, never waited on
+	if (fcntl(req.fd, F_SETFL, O_NONBLOCK) == -1)
 	{
-		LOG_ERROR("could not set value for a pin", errno_msg(errno));
+		close(req.fd);
 		return 0;
 	}
 
+	lines->fd = req.fd;
+	return 1;
+}
+
+int
+gpio_release(struct gpio_lines *lines)
+{
+	if (lines->fd == -1)
+		return 0;
+	close(lines->fd);
+	lines->fd = -1;
 	return 1;
 }
 
 int 
-time_write(char *str)
-{
-	struct timeval time;
-	gettimeofday(&time, NULL);
-	unsigned int s = time.tv_sec % 86400;
-	unsigned int tusecs = time.tv_usec / 1000;
-	unsigned int tsecs = s % 60;
-	unsigned int tmins = s / 60 % 60;
-	unsigned int thrs = s / 3600;
-	// unsigned int ddays = time.tv_sec / 86400;
-
-	char *p = str;
-
-	p+=uint_write_pad(thrs, p, 2);
-	*p++ = ':';
-	p+=uint_write_pad(tmins, p, 2);
-	*p++ = ':';
-	p+=uint_write_pad(tsecs, p, 2);
-	*p++ = '.';
-	p+=uint_write_pad(tusecs, p, 3);
-
-	return p-str;
-}
-
-static const char *errno_msgs[] = 
-{
-	"EPERM operation not permitted",
-        "ENOENT no such file or directory",
-        "ESRCH no such process",
-        "EINTR interrupted system call",
-        "EIO i/o error",
-        "ENXIO no such device or address",
-        "E2BIG argument list too long",
-        "ENOEXEC exec format error",
-        "EBADF bad file descriptor",
-        "ECHILD no child process",
-        "EAGAIN resource temporarily unavailable",
-        "ENOMEM out of memory",
-        "EACCES permission denied",
-        "EFAULT bad address",
-        "ENOTBLK block device required",
-        "EBUSY resource busy",
-        "EEXIST file exists",
-        "EXDEV cross-device link",
-        "ENODEV no such device",
-        "ENOTDIR not a directory",
-        "EISDIR is a directory",
-        "EINVAL invalid argument",
-        "ENFILE too many open files in system",
-        "EMFILE no file descriptors available",
-        "ENOTTY not a tty",
-        "ETXTBSY text file busy",
-        "EFBIG file too large",
-        "ENOSPC no space left on device",
-        "ESPIPE invalid seek",
-        "EROFS read-only file system",
-        "EMLINK too many links",
-        "EPIPE broken pipe",
-        "EDOM domain error",
-        "ERANGE result not representable",
-        "EDEADLK resource deadlock would occur",
-        "ENAMETOOLONG filename too long",
-        "ENOLCK no locks available",
-        "ENOSYS function not implemented",
-        "ENOTEMPTY directory not empty",
-        "ELOOP symbolic link loop",
-        "EWOULDBLOCK resource temporarily unavailable",
-        "ENOMSG no message of desired type",
-        "EIDRM identifier removed",
-        "ECHRNG no error information",
-        "EL2NSYNC no error information",
-        "EL3HLT no error information",
-        "EL3RST no error information",
-        "ELNRNG no error information",
-        "EUNATCH no error information",
-        "ENOCSI no error information",
-        "EL2HLT no error information",
-        "EBADE no error information",
-        "EBADR no error information",
-        "EXFULL no error information",
-        "ENOANO no error information",
-        "EBADRQC no error information",
-        "EBADSLT no error information",
-        "EDEADLOCK resource deadlock would occur",
-        "EBFONT no error information",
-        "ENOSTR device not a stream",
-        "ENODATA no data available",
-        "ETIME device timeout",
-        "ENOSR out of streams resources",
-        "ENONET no error information",
-        "ENOPKG no error information",
-        "EREMOTE no error information",
-        "ENOLINK link has been severed",
-        "EADV no error information",
-        "ESRMNT no error information",
-        "ECOMM no error information",
-        "EPROTO protocol error",
-        "EMULTIHOP multihop attempted",
-        "EDOTDOT no error information",
-        "EBADMSG bad message",
-        "EOVERFLOW value too large for data type",
-        "ENOTUNIQ no error information",
-        "EBADFD file descriptor in bad state",
-        "EREMCHG no error information",
-        "ELIBACC no error information",
-        "ELIBBAD no error information",
-        "ELIBSCN no error information",
-        "ELIBMAX no error information",
-        "ELIBEXEC no error information",
-        "EILSEQ illegal byte sequence",
-        "ERESTART no error information",
-        "ESTRPIPE no error information",
-        "EUSERS no error information",
-        "ENOTSOCK not a socket",
-        "EDESTADDRREQ destination address required",
-        "EMSGSIZE message too large",
-        "EPROTOTYPE protocol wrong type for socket",
-        "ENOPROTOOPT protocol not available",
-        "EPROTONOSUPPORT protocol not supported",
-        "ESOCKTNOSUPPORT socket type not supported",
-        "EOPNOTSUPP not supported",
-        "ENOTSUP not supported",
-        "EPFNOSUPPORT protocol family not supported",
-        "EAFNOSUPPORT address family not supported by protocol",
-        "EADDRINUSE address in use",
-        "EADDRNOTAVAIL address not available",
-        "ENETDOWN network is down",
-        "ENETUNREACH network unreachable",
-        "ENETRESET connection reset by network",
-        "ECONNABORTED connection aborted",
-        "ECONNRESET connection reset by peer",
-        "ENOBUFS no buffer space available",
-        "EISCONN socket is connected",
-        "ENOTCONN socket not connected",
-        "ESHUTDOWN cannot send after socket shutdown",
-        "ETOOMANYREFS no error information",
-        "ETIMEDOUT operation timed out",
-        "ECONNREFUSED connection refused",
-        "EHOSTDOWN host is down",
-        "EHOSTUNREACH host is unreachable",
-        "EALREADY operation already in progress",
-        "EINPROGRESS operation in progress",
-        "ESTALE stale file handle",
-        "EUCLEAN no error information",
-        "ENOTNAM no error information",
-        "ENAVAIL no error information",
-        "EISNAM no error information",
-        "EREMOTEIO remote i/o error",
-        "EDQUOT quota exceeded",
-        "ENOMEDIUM no medium found",
-        "EMEDIUMTYPE wrong medium type",
-        "ECANCELED operation canceled",
-        "ENOKEY no error information",
-        "EKEYEXPIRED no error information",
-        "EKEYREVOKED no error information",
-        "EKEYREJECTED no error information",
-        "EOWNERDEAD previous owner died",
-        "ENOTRECOVERABLE state not recoverable",
-        "ERFKILL no error information",
-        "EHWPOISON no error information"
-};
+gpio_write(
+		struct gpio *gpio, 
+		struct gpio_lines *lines, 
+		unsigned long long mask, 
+		unsigned long long vals
+)
+{
+	int ret;
+
+	PROBE2(gpio__write, mask, vals);
+	if (gpio->use_v1)
+	{
+		// no mask in v1, repeat what the other lines hold
+		struct gpiohandle_data hdat = { { 0 } };
+		for (unsigned int i = 0; i < lines->num; i++)
+		{
+			unsigned long long bit = 1ULL << i;
+			hdat.values[i] = mask & bit ? 
+				(vals & bit) != 0 : lines->pins[i].level == GPIO_HIGH;
+		}
+		ret = ioctl(lines->fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &hdat);
+	}
+	else
+	{
+		struct gpio_v2_line_values lval;
+		lval.bits = vals & mask;
+		lval.mask = mask;
+		ret = ioctl(lines->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &lval);
+	}
+	PROBE2(gpio__write__done, mask, ret);
+
+	for (unsigned int i = 0; i < lines->num; i++)
+	{
+		unsigned long long bit = 1ULL << i;
+		if (mask & bit)
+			// unknown after failure, forces a retry on next commit
+			lines->pins[i].level = ret == -1 ? -1 : (vals & bit) != 0;
+	}
+
+	if (ret == -1)
+	{
+		LOG_ERROR("could not set value for lines", errno_msg(errno));
+		return 0;
+	}
 
-const char *
-errno_msg(int err)
+	return 1;
+}
+
+int
+gpio_commit(
+		struct gpio *gpio, 
+		struct gpio_lines *lines, 
+		unsigned long long vals, 
+		unsigned int reassert
+)
 {
-	return errno_msgs[err - 1];	
+	time_t now = time_mono();
+	unsigned long long mask = 0;
+
+	for (unsigned int i = 0; i < lines->num; i++)
+	{
+		struct gpio_pin *pin = &lines->pins[i];
+		unsigned long long bit = 1ULL << i;
+		int val = (vals & bit) != 0;
+
+		if (pin->level == val)
+		{
+			// steady state, touch the line only to undo external tampering
+			if (reassert == 0 || now - pin->commit_time < reassert)
+				continue;
+		}
+		else if (val == GPIO_LOW)
+			gpio_print_pin("write LOW: P", pin->pin);
+		else
+			gpio_print_pin("write HIGH: P", pin->pin);
+
+		pin->commit_time = now;
+		mask |= bit;
+	}
+
+	if (mask == 0)
+		return 1;
+
+	return gpio_write(gpio, lines, mask, vals);
 }
@@ -1,8 +1,10 @@
 #ifndef _TCCTL_H_
 #define _TCCTL_H_
 
-#include <stddef.h>
+#define _GNU_SOURCE // struct ucred
 #include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <signal.h>
 #include <fcntl.h>
@@ -14,76 +16,71 @@
 #include <sys/un.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
 
 #include <linux/gpio.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/thermal.h>
+
+#include "libtcctl.h"
 
 #define LOG_PATH "./tcctl.log"
 #define LOG_MSG_BUF_LEN 16
 #define CONF_PATH "/etc/tcctl/tcctl.conf"
-#define TEMP_PATH "/sys/class/thermal/thermal_zone0/temp"
-#define TEMP_BUF_MAX_LEN 64
+#define CONF_DIR_MAX_LEN 256
+#define CONF_DEBOUNCE_MS 200
+#define CONF_EVENTS_LEN 1024
+#define CONF_DIR_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE)
+#define CONF_FILE_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+#define CONF_ZONE_MAX_LEN 2048
+#define CONF_TMP_SUFFIX ".tmp"
+#define CONF_SAVE_POLL_MS 20 // while a write back waits for the one before
 #define UNSCK_PATH "af_un_tcctl.serv"
 #define UNSCK_SUN_ADDR_LEN 108
 #define UNSCK_PATH_MAX_LEN 64
+#define LISTEN_FDS_START 3 // first fd passed by the service manager
+#define RC_CLIENTS_MAX 16
+#define RC_CLIENT_RATE 50  // messages/s per client
+#define RC_CLIENT_BURST 20
+#define RC_BUDGET_RATE 400 // messages/s for all clients
+#define RC_BUDGET_BURST 64
+#define RC_PASS_MAX 64     // datagrams read per loop pass, after the zones
+#define RC_WARN_MS 10000   // one rate limit warning per client
+#define TRIP_BUF_LEN 4096  // thermal netlink read at once
+#define TRIP_ALARM_ATTRS 3 // hwmon alarm files tried per sensor
 
-#define ENTRY_NAME_MAX_LEN 64
-#define ENTRY_LINE_MAX_LEN 16
 #define ARG_SYM_MAX_LEN 32
-#define MSG_MAX_LEN 512
-#define TIME_BUF_LEN 16
-#define TEMP_BUF_LEN 8
-
-#define GPIO_PATH_LEN 40
-#define GPIO_BUF_LEN 4
+#define ARG_UPGRADE "--upgrade"
+#define ARGS_MAX 32
 
-#define ZERO_STR { '\0' }
+#define UPGRADE_MAGIC "tcctlupg"
+#define UPGRADE_MAGIC_LEN 8
+#define UPGRADE_VERSION 3
+#define EXE_PATH_MAX_LEN 256
 
-enum tcctl_phase
+// daemon counters kept in the state snapshot
+enum tcctl_snap_counter
 {
-	LOW_TEMP,  // temperature below threshold (always off)
-	IDLE,      // ready for cooling
-	RUN,       // cooling
-	HIGH_TEMP, // temperature above threshold (always on)
-	OVRD_IDLE, // start and stay idle
-	OVRD_RUN,  // start and stay running
-	FAIL       // failure
+	SNAP_RC_DROPPED,
+	SNAP_RC_DEFERRED,
+	SNAP_TICKS,
+	SNAP_TICK_LATE,
+	SNAP_TICK_LATE_MAX
 };
 
-struct tcctl_stat
-{
-	unsigned int last_temp;
-	unsigned int low_temp;
-	unsigned int trig_temp;
-
-	enum tcctl_phase phase;
-};
-
-union tcctl_conf_field
-{
-	unsigned int uint;
-	int boolean;
-};
-
-struct tcctl_conf_entry
-{
-	const char *name;
-	union tcctl_conf_field *field;
-	int (*read_fn)(union tcctl_conf_field *field, const char *val);
-};
-
-struct tcctl_conf
-{
-	union tcctl_conf_field low_temp;       // never run below that temperature
-	union tcctl_conf_field trig_temp;      // start cooling when reached
-	union tcctl_conf_field hyst_dec_temp;  // minimal temp drop to stop
-
-	union tcctl_conf_field update_delay;   // time between updates	
-	union tcctl_conf_field output_pin;     // output pin to the switch
+#define GPIO_PATH "/dev/gpiochip1"
+#define GPIO_PATH_LEN 40
+#define GPIO_BUF_LEN 4
+#define GPIO_CHIPS_MAX 16
+#define GPIO_LINES_MAX 8
+#define GPIO_CONSUMER "tcctl"
 
-	union tcctl_conf_field stay_on;    	// fan on after exit
-	union tcctl_conf_field stop;       	// stop the temperature control
-	union tcctl_conf_field pin_invert; 	// invert pin (for p-mosfets)
-};
+#define TACH_EVENTS_LEN 64     // edge events per read
+#define TACH_EVENTS_MAX 1024   // kernel buffer, its cap (16 per line of a request)
+#define TACH_WINDOW_MS 2000    // rpm over the edges of the last window
+#define TACH_BATCHES 16
 
 enum tcctl_arg_post
 {
@@ -100,31 +97,13 @@ struct tcctl_arg
 	enum tcctl_arg_post post;
 };
 
-enum tcctl_rc_cmd
-{
-	// client commands
-	STAT, // get status     | p1 <- parameter id  | p2 <- n/a
-	OVRD, // force run/hold | p1 <- on/off        | p2 <- n/a
-	AUTO, // automatic mode | p1 <- n/a           | p2 <- n/a
-	TRIG, // trigger temps  | p1 <- low temp      | p2 <- trigger temp
-	CONF, // reload conf    | p1 <- n/a           | p2 <- n/a
-	KILL, // kill service   | p1 <- n/a           | p2 <- n/a
-	// service responses
-	INFO, // return status  | p1 <- parameter id  | p2 <- return value
-	CERR, // conf error     | p1 <- conf entry id | p2 <- conf line
-};
-
-union tcctl_rc_param
-{
-	unsigned int uint;
-	int sint;
-	int boolean;
-};
-
-struct tcctl_rc_msg
+// token bucket, tokens in thousandths
+struct tcctl_rc_bucket
 {
-	enum tcctl_rc_cmd cmd;
-	union tcctl_rc_param p1, p2;
+	pid_t pid;
+	unsigned int tokens;
+	unsigned long long ms;
+	unsigned long long warn_ms;
 };
 
 struct tcctl_rc_addr
@@ -138,63 +117,101 @@ void tcctl_pre_init(void);
 int tcctl_arg_help(int, char *[]);
 int tcctl_arg_conf(int, char *[]);
 int tcctl_arg_log(int, char *[]);
+int tcctl_arg_gpio(int, char *[]);
+int tcctl_arg_simulate(int, char *[]);
+int tcctl_arg_sim_time(int, char *[]);
+int tcctl_arg_sim_speed(int, char *[]);
+int tcctl_arg_sim_stall(int, char *[]);
+int tcctl_arg_record(int, char *[]);
+int tcctl_arg_state(int, char *[]);
+int tcctl_arg_upgrade(int, char *[]);
+int tcctl_arg_socket(int, char *[]);
+int tcctl_arg_trip_socket(int, char *[]);
 int tcctl_args_parse(int, char *[]);
 
 void tcctl_setup_sig(void);
 void tcctl_kill_sig(int);
 
 int tcctl_fd_init(void);
+int tcctl_rec_open(void);
+void tcctl_rec_write(unsigned int);
+int tcctl_snap_open(void);
+void tcctl_snap_load(const struct tcctl_snap *);
+void tcctl_snap_fill(struct tcctl_snap *);
+void tcctl_snap_save(void);
+int tcctl_upgrade_load(void);
+void tcctl_fd_inherit(int, int);
+int tcctl_upgrade_exec(void);
+int tcctl_sim_setup(void);
 
 int tcctl_loop(void);
-int tcctl_update(void);
+
+int tcctl_io_sensor_open(void *, unsigned int, unsigned int, const char *);
+int tcctl_io_sensor_read(void *, unsigned int, unsigned int, unsigned int *);
+int tcctl_io_output_write(void *, unsigned int, int);
+int tcctl_io_load_read(void *, struct tcctl_load *);
+int tcctl_io_conf_check(void *, const struct tcctl_conf *);
+int tcctl_io_tach_read(void *, unsigned int, unsigned int *);
+int tcctl_load_open(void);
+void tcctl_load_freq_path(char *, unsigned int, const char *);
+int tcctl_load_stat(unsigned int *, unsigned int *);
+unsigned long long tcctl_io_clock_ms(void *);
 
 int tcctl_gpio_init(void);
-int tcctl_gpio_update_conf(unsigned int);
-int tcctl_gpio_write(int);
+int tcctl_gpio_update_conf(void);
+int tcctl_gpio_write(void);
+int tcctl_tach_update_conf(void);
+void tcctl_tach_drain(void);
 
 size_t tcctl_rc_addr_len(const char *);
 void tcctl_rc_addr_set(struct tcctl_rc_addr *, const char *);
+int tcctl_rc_listen_fd(void);
 int tcctl_rc_init(const char *);
 int tcctl_rc_end(void);
 int tcctl_rc_recv_msg(void);
-int tcctl_rc_handle_msg(struct tcctl_rc_msg *, struct tcctl_rc_addr *);
+int tcctl_rc_recv_all(void);
+int tcctl_bucket_fill(struct tcctl_rc_bucket *, unsigned long long, unsigned int, unsigned int);
+struct tcctl_rc_bucket *tcctl_rc_client(pid_t, unsigned long long);
+unsigned int tcctl_rc_stat(unsigned int);
+int tcctl_rc_zoned(enum tcctl_rc_cmd);
+struct tcctl_zone *tcctl_rc_zone(unsigned int);
+int tcctl_rc_handle_msg(struct tcctl_rc_msg *, struct tcctl_rc_msg *);
+int tcctl_rc_handle_batch(struct tcctl_rc_batch *, struct tcctl_rc_msg *);
+void tcctl_rc_conf_err(struct tcctl_rc_msg *);
 int tcctl_rc_send_msg(struct tcctl_rc_msg *, struct tcctl_rc_addr *);
 
-unsigned int tcctl_stat_get(unsigned int);
-void tcctl_stat_update(struct tcctl_stat *, struct tcctl_conf *);
+int tcctl_trip_init(void);
+int tcctl_trip_nl_open(void);
+int tcctl_trip_nl_group(int, unsigned int *);
+const struct nlattr *tcctl_nla_next(const char **, const char *);
+int tcctl_trip_sock_open(void);
+int tcctl_trip_fds(fd_set *, fd_set *, int);
+void tcctl_trip_ready(fd_set *, fd_set *);
+void tcctl_trip_nl_read(void);
+void tcctl_trip_sock_read(void);
+void tcctl_trip_handle(const struct tcctl_trip *);
+void tcctl_trip_end(void);
+void tcctl_alarm_open(unsigned int, unsigned int, const char *);
+
+int tcctl_uint_pread(int, unsigned int *);
 int tcctl_temp_read(int, unsigned int *);
-
-void tcctl_conf_reset(struct tcctl_conf *);
-void tcctl_conf_apply(struct tcctl_conf *, struct tcctl_conf *);
-void tcctl_conf_log_error(const char *msg, const char *entry);
-int tcctl_conf_load(int);
-const char * tcctl_conf_read_next_line(const char *);
-
-int tcctl_get_uint(union tcctl_conf_field *, const char *);
-int tcctl_get_boolean(union tcctl_conf_field *, const char *);
-
-void tcctl_log_writeln(const char **, size_t);
-void tcctl_log_info(const char *, const char *, const char *, int);
-void tcctl_log_error(const char *, const char *,  const char *, const char *);
-void tcctl_stdout_write(const char *);
-
-int str_eq(const char *, const char *, size_t);
-size_t str_copy(const char *, char *, size_t);
-size_t str_set(char, char *, size_t);
-size_t str_len(const char *, size_t);
-size_t str_join(char *, char *, size_t);
-
-int uint_read(unsigned int *, const char *);
-int uint_write(unsigned int, char *);
-int uint_write_pad(unsigned int val, char *str, size_t len);
-int boolean_read(int *, const char *);
-int boolean_write(int, char *);
+int tcctl_conf_load(int, int);
+int tcctl_conf_load_map(int, int);
+int tcctl_conf_watch_init(void);
+int tcctl_conf_watch_read(void);
+void tcctl_conf_watch_file(void);
+int tcctl_conf_reload(void);
+int tcctl_conf_save(void);
+int tcctl_conf_save_poll(void);
 
 struct gpio
 {
 	char *path;
+	char *label;    // find the chip by label instead of path
 	int chip_fd;
+	int use_v1;     // kernel lacks the v2 line uapi
 	struct gpiochip_info info;
+	char path_buf[GPIO_PATH_LEN];
 };
 
 enum gpio_pull
@@ -204,6 +221,13 @@ enum gpio_pull
 	GPIO_PULLUP
 };
 
+enum gpio_drive
+{
+	GPIO_PUSH_PULL,
+	GPIO_OPEN_DRAIN,
+	GPIO_OPEN_SOURCE
+};
+
 enum gpio_val
 {
 	GPIO_LOW  = 0,
@@ -214,23 +238,67 @@ struct gpio_pin
 {
 	unsigned int pin;
 	enum gpio_pull pull;
-	struct gpiohandle_request hreq;
+	enum gpio_drive drive;
+
+	int level;          // last committed level (-1 - unknown)
+	time_t commit_time; // when the level was last written
 };
 
-int gpio_open(struct gpio *gpio);
-int gpio_close(struct gpio *gpio);
-int gpio_pin(struct gpio *gpio, struct gpio_pin *pin);
-int gpio_write(struct gpio *gpio, struct gpio_pin *pin, enum gpio_val val);
+// lines requested together, written atomically
+struct gpio_lines
+{
+	unsigned int num;
+	struct gpio_pin pins[GPIO_LINES_MAX];
+	int fd;             // line request fd (-1 - not requested)
+};
+
+// the tach edges of one line read in one drain
+struct tach_batch
+{
+	unsigned int first_seq, last_seq; // line seqno, counts edges the buffer lost
+	unsigned long long first_ns, last_ns;
+};
 
-int time_write(char *);
+// batches of the last TACH_WINDOW_MS of a tach line
+struct tach_window
+{
+	unsigned int head, num;
+	struct tach_batch batches[TACH_BATCHES];
+};
 
-const char *errno_msg(int);
+unsigned int tach_window_rpm(struct tach_window *, unsigned long long, unsigned int);
 
-#define LOW_TEMP_DEFAULT 29
-#define TRIG_TEMP_DEFAULT 33
-#define HYST_DEC_TEMP_DEFAULT 2
+// handed to the next binary through a memfd on UPGRADE
+struct tcctl_upgrade
+{
+	char magic[UPGRADE_MAGIC_LEN];
+	unsigned int version;
+	int unsck_fd;
+	int rc_activated;             // the socket belongs to the service manager
+	int chip_fd;
+	int use_v1;
+	struct gpio_lines outputs;    // the line request fd and levels
+	struct gpio_lines tachs;      // the tach edge request
+	struct tcctl_snap snap;
+};
 
-#define UPDATE_DELAY_DEFAULT 1
-#define OUTPUT_PIN_DEFAULT -1
+int gpio_open(struct gpio *gpio);
+int gpio_find(struct gpio *gpio);
+int gpio_close(struct gpio *gpio);
+int gpio_request(struct gpio *gpio, struct gpio_lines *lines);
+int gpio_request_edges(struct gpio *gpio, struct gpio_lines *lines);
+int gpio_release(struct gpio_lines *lines);
+int gpio_write(
+	struct gpio *gpio, 
+	struct gpio_lines *lines, 
+	unsigned long long mask, 
+	unsigned long long vals
+);
+int gpio_commit(
+	struct gpio *gpio, 
+	struct gpio_lines *lines, 
+	unsigned long long vals, 
+	unsigned int reassert
+);
 
 #endif//_TCCTL_H_
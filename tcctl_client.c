@@ -0,0 +1,225 @@
+#include "libtcctl.h"
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/select.h>
+
+int
+tcctl_client_open(struct tcctl_client *cl, const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct tcctl_client empty = { .fd = -1 };
+	*cl = empty;
+	cl->seq = 1;
+
+	if (str_len(path, sizeof(addr.sun_path)) >= sizeof(addr.sun_path) - 1)
+	{
+		LOG_ERROR("socket path too long: ", path);
+		return 0;
+	}
+
+	// an abstract name is as long as the address, no terminator
+	size_t len = str_copy(path, addr.sun_path, sizeof(addr.sun_path));
+	if (*path == RC_ABSTRACT)
+		addr.sun_path[0] = '\0';
+	else
+		addr.sun_path[len++] = '\0';
+
+	cl->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (cl->fd == -1)
+	{
+		LOG_ERROR("could not get af_unix socket: ", errno_msg(errno));
+		return 0;
+	}
+
+	// autobind to an abstract address, nothing to clean up on exit
+	if (
+		bind(cl->fd, (struct sockaddr *)&addr, sizeof(sa_family_t)) == -1 ||
+		connect(
+			cl->fd, 
+			(struct sockaddr *)&addr, 
+			offsetof(struct sockaddr_un, sun_path) + len
+		) == -1
+	)
+	{
+		LOG_ERROR("could not connect to service: ", errno_msg(errno));
+		tcctl_client_close(cl);
+		return 0;
+	}
+
+	return 1;
+}
+
+void
+tcctl_client_close(struct tcctl_client *cl)
+{
+	if (cl->fd != -1)
+		close(cl->fd);
+	cl->fd = -1;
+}
+
+int
+tcctl_client_send(
+		struct tcctl_client *cl,
+		union tcctl_rc_buf *buf,
+		size_t len,
+		unsigned int *seq
+)
+{
+	// the slot of a seq is free again once its result is taken
+	struct tcctl_client_req *req = &cl->reqs[cl->seq % CLIENT_INFLIGHT_MAX];
+	if (req->state != REQ_FREE || len > sizeof(*buf))
+		return 0;
+
+	buf->head.version = RC_VERSION;
+	buf->head.status = RC_OK;
+	buf->head.seq = cl->seq++;
+	req->buf = *buf;
+	req->len = len;
+	req->tries = 1;
+	req->sent_ms = time_mono_ms();
+	req->state = REQ_SENT;
+	cl->pending++;
+	*seq = buf->head.seq;
+
+	// a full socket buffer is just a lost datagram, the resend covers it
+	if (send(cl->fd, buf, len, 0) == -1 && errno != EAGAIN)
+	{
+		LOG_ERROR("could not send message: ", errno_msg(errno));
+		req->state = REQ_LOST;
+		cl->pending--;
+	}
+
+	return 1;
+}
+
+int
+tcctl_client_msg(
+		struct tcctl_client *cl,
+		enum tcctl_rc_cmd cmd,
+		unsigned int zone,
+		unsigned int p1,
+		unsigned int p2,
+		unsigned int p3,
+		unsigned int *seq
+)
+{
+	union tcctl_rc_buf buf =
+	{
+		.msg =
+		{
+			.head = { .cmd = cmd, .zone = zone },
+			.p1.uint = p1,
+			.p2.uint = p2,
+			.p3.uint = p3
+		}
+	};
+
+	return tcctl_client_send(cl, &buf, sizeof(struct tcctl_rc_msg), seq);
+}
+
+int
+tcctl_client_poll(struct tcctl_client *cl, unsigned int timeout_ms)
+{
+	fd_set read_fds;
+	struct timeval timeout;
+	unsigned long long now = time_mono_ms(), wait = timeout_ms;
+
+	// wake up for the oldest resend at the latest
+	for (unsigned int i = 0; i < CLIENT_INFLIGHT_MAX; i++)
+	{
+		struct tcctl_client_req *req = &cl->reqs[i];
+		if (req->state != REQ_SENT)
+			continue;
+		unsigned long long due = req->sent_ms + CLIENT_RETRY_MS;
+		if (due <= now)
+			wait = 0;
+		else if (due - now < wait)
+			wait = due - now;
+	}
+
+	FD_ZERO(&read_fds);
+	FD_SET(cl->fd, &read_fds);
+	timeout.tv_sec = wait / 1000;
+	timeout.tv_usec = wait % 1000 * 1000;
+	if (select(cl->fd + 1, &read_fds, NULL, NULL, &timeout) == -1 && errno != EINTR)
+	{
+		LOG_ERROR("select failed: ", errno_msg(errno));
+		return -1;
+	}
+
+	tcctl_client_recv(cl);
+	tcctl_client_resend(cl, time_mono_ms());
+	return cl->pending;
+}
+
+void
+tcctl_client_recv(struct tcctl_client *cl)
+{
+	struct tcctl_rc_msg reply;
+	ssize_t len;
+
+	while ((len = recv(cl->fd, &reply, sizeof(reply), 0)) != -1)
+	{
+		// late duplicates of answered resends land on a done slot
+		struct tcctl_client_req *req = &cl->reqs[reply.head.seq % CLIENT_INFLIGHT_MAX];
+		if (
+			len != sizeof(reply) || req->state != REQ_SENT ||
+			req->buf.head.seq != reply.head.seq
+		)
+			continue;
+
+		req->reply = reply;
+		req->state = REQ_DONE;
+		cl->pending--;
+	}
+}
+
+void
+tcctl_client_resend(struct tcctl_client *cl, unsigned long long now)
+{
+	for (unsigned int i = 0; i < CLIENT_INFLIGHT_MAX; i++)
+	{
+		struct tcctl_client_req *req = &cl->reqs[i];
+		if (req->state != REQ_SENT || now < req->sent_ms + CLIENT_RETRY_MS)
+			continue;
+
+		if (req->tries == CLIENT_TRIES_MAX)
+		{
+			req->state = REQ_LOST;
+			cl->pending--;
+			continue;
+		}
+
+		// the daemon keeps no seqs, only reads and SET are safe to apply
+		// twice. the rest is sent once and waits out the same tries for a
+		// late reply, then it is lost to the caller
+		req->tries++;
+		req->sent_ms = now;
+		if (tcctl_client_resendable(req->buf.head.cmd))
+			send(cl->fd, &req->buf, req->len, 0);
+	}
+}
+
+int
+tcctl_client_resendable(enum tcctl_rc_cmd cmd)
+{
+	return cmd == STAT || cmd == GET || cmd == SET || cmd == SETB;
+}
+
+int
+tcctl_client_result(struct tcctl_client *cl, unsigned int seq, struct tcctl_rc_msg *reply)
+{
+	struct tcctl_client_req *req = &cl->reqs[seq % CLIENT_INFLIGHT_MAX];
+	if (req->buf.head.seq != seq || req->state == REQ_FREE)
+		return -1;
+	if (req->state == REQ_SENT)
+		return 0;
+
+	int done = req->state == REQ_DONE;
+	if (done)
+		*reply = req->reply;
+	req->state = REQ_FREE;
+	return done ? 1 : -1;
+}
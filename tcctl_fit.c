@@ -0,0 +1,154 @@
+#include "libtcctl.h"
+
+#define LN2 0.69314718055994531
+
+void
+tcctl_fit_update(
+		struct tcctl_fit *fit,
+		unsigned long long tick,
+		unsigned long long now,
+		unsigned int mtemp,
+		int was_on
+)
+{
+	// a and b only hold for one tick length, start over on a new one
+	if (tick != fit->dt)
+	{
+		tcctl_rls_reset(&fit->rls[0]);
+		tcctl_rls_reset(&fit->rls[1]);
+		fit->dt = tick;
+		fit->started = 0;
+	}
+
+	// off schedule ticks (kicks, a late loop) break the chain
+	unsigned long long dt = now > fit->last_ms ? now - fit->last_ms : 0;
+	if (
+		!fit->started ||
+		dt * 100 > tick * (100 + FIT_DT_JITTER) ||
+		dt * 100 < tick * (100 - FIT_DT_JITTER)
+	)
+		fit->has_diff = 0;
+	else
+	{
+		// two steps in a row on the same fan state make a sample
+		double diff = ((double)mtemp - fit->last_mtemp) / 1000.0;
+		if (fit->has_diff && fit->last_on == was_on)
+			tcctl_rls_update(
+					&fit->rls[!!was_on],
+					fit->last_diff,
+					diff,
+					fit->last_mtemp / 1000.0,
+					mtemp / 1000.0
+			);
+		fit->last_diff = diff;
+		fit->has_diff = 1;
+	}
+
+	fit->started = 1;
+	fit->last_on = was_on;
+	fit->last_ms = now;
+	fit->last_mtemp = mtemp;
+}
+
+void
+tcctl_rls_reset(struct tcctl_rls *rls)
+{
+	rls->a = 1.0;
+	rls->p = FIT_P_INIT;
+	rls->b = 0.0;
+	rls->samples = 0;
+}
+
+void
+tcctl_rls_update(struct tcctl_rls *rls, double x, double y, double t, double t_next)
+{
+	// dT[k+1] = a dT[k], scalar gain p x / (lambda + x p x)
+	double k = rls->p * x / (FIT_FORGET + x * rls->p * x);
+	rls->a += k * (y - rls->a * x);
+	rls->p = (rls->p - k * x * rls->p) / FIT_FORGET;
+
+	// b with the same memory, seeded by the first sample
+	double b = t_next - rls->a * t;
+	rls->b = rls->samples ? FIT_FORGET * rls->b + (1.0 - FIT_FORGET) * b : b;
+	rls->samples++;
+}
+
+int
+tcctl_fit_valid(const struct tcctl_fit *fit, int on)
+{
+	const struct tcctl_rls *rls = &fit->rls[!!on];
+	return fit->dt > 0 && rls->samples >= FIT_SAMPLES_MIN &&
+		rls->a > 0.0 && rls->a < 1.0;
+}
+
+unsigned int
+tcctl_fit_tau(const struct tcctl_fit *fit, int on)
+{
+	// a = exp(-dt / tau)
+	if (!tcctl_fit_valid(fit, on))
+		return 0;
+	return -(double)fit->dt / tcctl_ln(fit->rls[!!on].a);
+}
+
+unsigned int
+tcctl_fit_eq(const struct tcctl_fit *fit, int on)
+{
+	// b = (1 - a) eq
+	const struct tcctl_rls *rls = &fit->rls[!!on];
+	if (!tcctl_fit_valid(fit, on))
+		return 0;
+
+	double eq = rls->b / (1.0 - rls->a);
+	return eq > 0.0 ? eq * 1000.0 : 0;
+}
+
+int
+tcctl_fit_run_ms(
+		const struct tcctl_fit *fit,
+		unsigned int from,
+		unsigned int to,
+		unsigned long long *ms
+)
+{
+	if (from <= to)
+	{
+		*ms = 0;
+		return 1;
+	}
+
+	// no fit yet, or the fan can not get that low at the current load
+	unsigned int eq = tcctl_fit_eq(fit, 1);
+	if (!tcctl_fit_valid(fit, 1) || eq >= to)
+		return 0;
+
+	*ms = tcctl_fit_tau(fit, 1) * tcctl_ln((double)(from - eq) / (to - eq));
+	return 1;
+}
+
+double
+tcctl_ln(double x)
+{
+	// down to [0.5, 2], then 2 atanh((x - 1) / (x + 1))
+	int e = 0;
+	if (x <= 0.0)
+		return 0.0;
+	while (x > 2.0)
+	{
+		x /= 2.0;
+		e++;
+	}
+	while (x < 0.5)
+	{
+		x *= 2.0;
+		e--;
+	}
+
+	double z = (x - 1.0) / (x + 1.0), z2 = z * z, term = z, sum = 0.0;
+	for (unsigned int n = 1; n < 32; n += 2)
+	{
+		sum += term / n;
+		term *= z2;
+	}
+
+	return 2.0 * sum + e * LN2;
+}
@@ -0,0 +1,568 @@
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/stat.h>
+
+// just enough of libc for tcctl-tiny (make tiny): the entry point, errno,
+// the environment and raw syscalls in place of the wrappers the daemon
+// calls, linked static with -nostdlib
+
+#define SYS_ERR_MAX 4095
+#define SA_RESTORER_FLAG 0x04000000 // x86_64 only, has no default sigreturn
+#define KSIGSET_LEN 8
+#ifndef AT_EMPTY_PATH
+#define AT_EMPTY_PATH 0x1000
+#endif
+
+// the layout of the kernel, not of libc
+struct ksigaction
+{
+	void (*handler)(int);
+	unsigned long flags;
+	void (*restorer)(void);
+	unsigned char mask[KSIGSET_LEN];
+};
+
+struct ktimespec
+{
+	long sec;
+	long nsec;
+};
+
+char **environ;
+static int err;
+
+int main(int, char *[]);
+
+#if defined(__x86_64__)
+
+__asm__(
+	".text\n"
+	".global _start\n"
+	"_start:\n"
+	"	xor %ebp, %ebp\n"
+	"	mov %rsp, %rdi\n"
+	"	and $-16, %rsp\n"
+	"	call tcctl_nolibc_start\n"
+	"	hlt\n"
+	"tcctl_sigreturn:\n"
+	"	mov $15, %eax\n"
+	"	syscall\n"
+);
+
+static inline long
+sys6(long n, long a, long b, long c, long d, long e, long f)
+{
+	register long r10 __asm__("r10") = d;
+	register long r8 __asm__("r8") = e;
+	register long r9 __asm__("r9") = f;
+	long ret;
+	__asm__ volatile ("syscall"
+		: "=a"(ret)
+		: "a"(n), "D"(a), "S"(b), "d"(c), "r"(r10), "r"(r8), "r"(r9)
+		: "rcx", "r11", "memory");
+	return ret;
+}
+
+#elif defined(__aarch64__)
+
+__asm__(
+	".text\n"
+	".global _start\n"
+	"_start:\n"
+	"	mov x29, #0\n"
+	"	mov x0, sp\n"
+	"	bl tcctl_nolibc_start\n"
+);
+
+static inline long
+sys6(long n, long a, long b, long c, long d, long e, long f)
+{
+	register long x8 __asm__("x8") = n;
+	register long x0 __asm__("x0") = a;
+	register long x1 __asm__("x1") = b;
+	register long x2 __asm__("x2") = c;
+	register long x3 __asm__("x3") = d;
+	register long x4 __asm__("x4") = e;
+	register long x5 __asm__("x5") = f;
+	__asm__ volatile ("svc #0"
+		: "+r"(x0)
+		: "r"(x8), "r"(x1), "r"(x2), "r"(x3), "r"(x4), "r"(x5)
+		: "memory", "cc");
+	return x0;
+}
+
+#elif defined(__arm__) && defined(__ARM_EABI__)
+
+// r7 carries the number, thumb builds need -fomit-frame-pointer (-Os has it)
+__asm__(
+	".text\n"
+	".global _start\n"
+	"_start:\n"
+	"	mov fp, #0\n"
+	"	mov r0, sp\n"
+	"	bic sp, sp, #7\n"
+	"	bl tcctl_nolibc_start\n"
+);
+
+static inline long
+sys6(long n, long a, long b, long c, long d, long e, long f)
+{
+	register long r7 __asm__("r7") = n;
+	register long r0 __asm__("r0") = a;
+	register long r1 __asm__("r1") = b;
+	register long r2 __asm__("r2") = c;
+	register long r3 __asm__("r3") = d;
+	register long r4 __asm__("r4") = e;
+	register long r5 __asm__("r5") = f;
+	__asm__ volatile ("svc #0"
+		: "+r"(r0)
+		: "r"(r7), "r"(r1), "r"(r2), "r"(r3), "r"(r4), "r"(r5)
+		: "memory", "cc");
+	return r0;
+}
+
+#else
+#error "tcctl-tiny: no syscalls for this arch, build tcctl instead"
+#endif
+
+#define SYS0(N) sys_ret(sys6(N, 0, 0, 0, 0, 0, 0))
+#define SYS1(N, A) sys_ret(sys6(N, (long)(A), 0, 0, 0, 0, 0))
+#define SYS2(N, A, B) sys_ret(sys6(N, (long)(A), (long)(B), 0, 0, 0, 0))
+#define SYS3(N, A, B, C) sys_ret(sys6(N, (long)(A), (long)(B), (long)(C), 0, 0, 0))
+#define SYS4(N, A, B, C, D) \
+	sys_ret(sys6(N, (long)(A), (long)(B), (long)(C), (long)(D), 0, 0))
+#define SYS5(N, A, B, C, D, E) \
+	sys_ret(sys6(N, (long)(A), (long)(B), (long)(C), (long)(D), (long)(E), 0))
+
+static long
+sys_ret(long ret)
+{
+	if (ret < 0 && ret >= -SYS_ERR_MAX)
+	{
+		err = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
+void
+tcctl_nolibc_start(long *sp)
+{
+	// argc, argv, NULL, envp, NULL
+	int argc = sp[0];
+	char **argv = (char **)(sp + 1);
+	environ = argv + argc + 1;
+	_exit(main(argc, argv));
+}
+
+int *
+__errno_location(void)
+{
+	return &err;
+}
+
+// byte loops, volatile so the compiler does not turn them into calls of
+// themselves
+void *
+memset(void *to, int c, size_t n)
+{
+	volatile unsigned char *t = to;
+	while (n--)
+		*t++ = c;
+	return to;
+}
+
+void *
+memcpy(void *to, const void *from, size_t n)
+{
+	volatile unsigned char *t = to;
+	const unsigned char *f = from;
+	while (n--)
+		*t++ = *f++;
+	return to;
+}
+
+void *
+memmove(void *to, const void *from, size_t n)
+{
+	volatile unsigned char *t = to;
+	const unsigned char *f = from;
+	if (t < f)
+		return memcpy(to, from, n);
+	while (n--)
+		t[n] = f[n];
+	return to;
+}
+
+int
+memcmp(const void *s1, const void *s2, size_t n)
+{
+	const unsigned char *a = s1, *b = s2;
+	for (; n--; a++, b++)
+	{
+		if (*a != *b)
+			return *a - *b;
+	}
+	return 0;
+}
+
+static char **
+env_find(const char *name)
+{
+	for (char **e = environ; *e != NULL; e++)
+	{
+		const char *n = name, *v = *e;
+		while (*n != '\0' && *n == *v)
+			n++, v++;
+		if (*n == '\0' && *v == '=')
+			return e;
+	}
+	return NULL;
+}
+
+char *
+getenv(const char *name)
+{
+	char **e = env_find(name);
+	if (e == NULL)
+		return NULL;
+
+	char *v = *e;
+	while (*v++ != '=')
+		;
+	return v;
+}
+
+int
+unsetenv(const char *name)
+{
+	char **e;
+	while ((e = env_find(name)) != NULL)
+	{
+		for (; *e != NULL; e++)
+			*e = *(e + 1);
+	}
+	return 0;
+}
+
+void
+_exit(int status)
+{
+	for (;;)
+		sys6(SYS_exit_group, status, 0, 0, 0, 0, 0);
+}
+
+ssize_t
+read(int fd, void *buf, size_t n)
+{
+	return SYS3(SYS_read, fd, buf, n);
+}
+
+ssize_t
+write(int fd, const void *buf, size_t n)
+{
+	return SYS3(SYS_write, fd, buf, n);
+}
+
+ssize_t
+pread(int fd, void *buf, size_t n, off_t off)
+{
+#if defined(__arm__)
+	// the 64 bit offset goes in an aligned register pair
+	long long off64 = off;
+	return sys_ret(sys6(SYS_pread64, fd, (long)buf, n, 0, (long)off64, (long)(off64 >> 32)));
+#else
+	return SYS4(SYS_pread64, fd, buf, n, off);
+#endif
+}
+
+int
+open(const char *path, int flags, ...)
+{
+	va_list ap;
+	va_start(ap, flags);
+	mode_t mode = flags & O_CREAT ? va_arg(ap, mode_t) : 0;
+	va_end(ap);
+	return SYS4(SYS_openat, AT_FDCWD, path, flags, mode);
+}
+
+int
+close(int fd)
+{
+	return SYS1(SYS_close, fd);
+}
+
+off_t
+lseek(int fd, off_t off, int whence)
+{
+	return SYS3(SYS_lseek, fd, off, whence);
+}
+
+int
+fsync(int fd)
+{
+	return SYS1(SYS_fsync, fd);
+}
+
+int
+ftruncate(int fd, off_t len)
+{
+	return SYS2(SYS_ftruncate, fd, len);
+}
+
+int
+fstat(int fd, struct stat *st)
+{
+	// statx has the same layout everywhere, struct stat does not
+	struct statx stx;
+	if (SYS5(SYS_statx, fd, "", AT_EMPTY_PATH, STATX_BASIC_STATS, &stx) == -1)
+		return -1;
+
+	memset(st, 0, sizeof(*st));
+	st->st_mode = stx.stx_mode;
+	st->st_ino = stx.stx_ino;
+	st->st_size = stx.stx_size;
+	return 0;
+}
+
+int
+fcntl(int fd, int cmd, ...)
+{
+	va_list ap;
+	va_start(ap, cmd);
+	long arg = va_arg(ap, long);
+	va_end(ap);
+	return SYS3(SYS_fcntl, fd, cmd, arg);
+}
+
+int
+ioctl(int fd, unsigned long req, ...)
+{
+	va_list ap;
+	va_start(ap, req);
+	void *arg = va_arg(ap, void *);
+	va_end(ap);
+	return SYS3(SYS_ioctl, fd, req, arg);
+}
+
+ssize_t
+readlink(const char *path, char *buf, size_t n)
+{
+	return SYS4(SYS_readlinkat, AT_FDCWD, path, buf, n);
+}
+
+int
+unlink(const char *path)
+{
+	return SYS3(SYS_unlinkat, AT_FDCWD, path, 0);
+}
+
+int
+rename(const char *from, const char *to)
+{
+#if defined(SYS_renameat)
+	return SYS4(SYS_renameat, AT_FDCWD, from, AT_FDCWD, to);
+#else
+	return SYS5(SYS_renameat2, AT_FDCWD, from, AT_FDCWD, to, 0);
+#endif
+}
+
+void *
+mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off)
+{
+#if defined(__arm__)
+	long ret = sys6(SYS_mmap2, (long)addr, len, prot, flags, fd, off / 4096);
+#else
+	long ret = sys6(SYS_mmap, (long)addr, len, prot, flags, fd, off);
+#endif
+	return (void *)sys_ret(ret);
+}
+
+int
+munmap(void *addr, size_t len)
+{
+	return SYS2(SYS_munmap, addr, len);
+}
+
+int
+msync(void *addr, size_t len, int flags)
+{
+	return SYS3(SYS_msync, addr, len, flags);
+}
+
+int
+memfd_create(const char *name, unsigned int flags)
+{
+	return SYS2(SYS_memfd_create, name, flags);
+}
+
+int
+select(int nfds, fd_set *rfds, fd_set *wfds, fd_set *efds, struct timeval *tv)
+{
+	struct ktimespec ts;
+	if (tv != NULL)
+	{
+		ts.sec = tv->tv_sec;
+		ts.nsec = tv->tv_usec * 1000;
+	}
+	return sys_ret(sys6(SYS_pselect6, nfds, (long)rfds, (long)wfds, (long)efds,
+		tv != NULL ? (long)&ts : 0, 0));
+}
+
+int
+clock_gettime(clockid_t clk, struct timespec *ts)
+{
+	return SYS2(SYS_clock_gettime, clk, ts);
+}
+
+int
+gettimeofday(struct timeval *tv, void *tz)
+{
+	struct timespec ts;
+	if (clock_gettime(CLOCK_REALTIME, &ts) == -1)
+		return -1;
+
+	tv->tv_sec = ts.tv_sec;
+	tv->tv_usec = ts.tv_nsec / 1000;
+	return 0;
+}
+
+int
+inotify_init1(int flags)
+{
+	return SYS1(SYS_inotify_init1, flags);
+}
+
+int
+inotify_add_watch(int fd, const char *path, unsigned int mask)
+{
+	return SYS3(SYS_inotify_add_watch, fd, path, mask);
+}
+
+int
+inotify_rm_watch(int fd, int wd)
+{
+	return SYS2(SYS_inotify_rm_watch, fd, wd);
+}
+
+int
+socket(int domain, int type, int proto)
+{
+	return SYS3(SYS_socket, domain, type, proto);
+}
+
+int
+bind(int fd, const struct sockaddr *addr, socklen_t len)
+{
+	return SYS3(SYS_bind, fd, addr, len);
+}
+
+int
+setsockopt(int fd, int level, int name, const void *val, socklen_t len)
+{
+	return SYS5(SYS_setsockopt, fd, level, name, val, len);
+}
+
+int
+getsockopt(int fd, int level, int name, void *val, socklen_t *len)
+{
+	return SYS5(SYS_getsockopt, fd, level, name, val, len);
+}
+
+ssize_t
+sendto(int fd, const void *buf, size_t n, int flags, const struct sockaddr *addr, socklen_t len)
+{
+	return sys_ret(sys6(SYS_sendto, fd, (long)buf, n, flags, (long)addr, len));
+}
+
+ssize_t
+recvmsg(int fd, struct msghdr *msg, int flags)
+{
+	return SYS3(SYS_recvmsg, fd, msg, flags);
+}
+
+pid_t
+getpid(void)
+{
+	return SYS0(SYS_getpid);
+}
+
+pid_t
+fork(void)
+{
+	return SYS5(SYS_clone, SIGCHLD, 0, 0, 0, 0);
+}
+
+pid_t
+waitpid(pid_t pid, int *status, int options)
+{
+	return SYS4(SYS_wait4, pid, status, options, 0);
+}
+
+int
+execv(const char *path, char *const argv[])
+{
+	return SYS3(SYS_execve, path, argv, environ);
+}
+
+int
+raise(int sig)
+{
+	return SYS2(SYS_kill, getpid(), sig);
+}
+
+int
+sigaction(int sig, const struct sigaction *act, struct sigaction *old)
+{
+	struct ksigaction kact = { .handler = NULL }, kold = { .handler = NULL };
+	if (act != NULL)
+	{
+		kact.handler = act->sa_handler;
+		kact.flags = act->sa_flags;
+		memcpy(kact.mask, &act->sa_mask, KSIGSET_LEN);
+#if defined(__x86_64__)
+		void tcctl_sigreturn(void);
+		kact.flags |= SA_RESTORER_FLAG;
+		kact.restorer = tcctl_sigreturn;
+#endif
+	}
+
+	if (SYS4(SYS_rt_sigaction, sig, act != NULL ? &kact : NULL,
+		old != NULL ? &kold : NULL, KSIGSET_LEN) == -1)
+		return -1;
+
+	if (old != NULL)
+	{
+		memset(old, 0, sizeof(*old));
+		old->sa_handler = kold.handler;
+		old->sa_flags = kold.flags;
+		memcpy(&old->sa_mask, kold.mask, KSIGSET_LEN);
+	}
+	return 0;
+}
+
+__sighandler_t
+signal(int sig, __sighandler_t handler)
+{
+	struct sigaction act = { .sa_handler = handler, .sa_flags = SA_RESTART }, old;
+	if (sigaction(sig, &act, &old) == -1)
+		return SIG_ERR;
+	return old.sa_handler;
+}
@@ -0,0 +1,296 @@
+#include "libtcctl.h"
+
+void
+tcctl_replay_init(struct tcctl_replay *rp, struct tcctl_ctx *ctx)
+{
+	struct tcctl_replay empty = { .now = 0 };
+	*rp = empty;
+	rp->ctx = ctx;
+}
+
+void
+tcctl_replay_io(struct tcctl_replay *rp, struct tcctl_io *io)
+{
+	io->user = rp;
+	io->sensor_open = tcctl_replay_sensor_open;
+	io->sensor_read = tcctl_replay_sensor_read;
+	io->output_write = tcctl_replay_output_write;
+	io->clock_ms = tcctl_replay_clock_ms;
+	io->load_read = NULL;
+	io->conf_check = NULL;
+	io->tach_read = tcctl_replay_tach_read;
+}
+
+int
+tcctl_replay_sample(
+		struct tcctl_replay *rp,
+		unsigned int zone_id,
+		unsigned long long ms,
+		unsigned int temp
+)
+{
+	struct tcctl_zone *zone = &rp->ctx->zones[zone_id];
+	struct tcctl_replay_zone *rz = &rp->zones[zone_id];
+
+	// the state since the last sample held until this one
+	if (rz->started && ms > rz->since && ms - rz->since <= REPLAY_GAP_MS)
+	{
+		unsigned long long dt = ms - rz->since;
+		rz->total_ms += dt;
+		if (zone->is_on)
+			rz->on_ms += dt;
+		if (zone->stat.last_temp >= zone->stat.trig_temp)
+			rz->above_ms += dt;
+	}
+	rz->started = 1;
+	rz->since = ms;
+	rz->samples++;
+
+	enum tcctl_phase phase = zone->stat.phase;
+	int is_on = zone->is_on;
+
+	// decide on the sample itself, as the daemon did when recording
+	rp->now = ms;
+	rp->temp = temp;
+	zone->stat.last_temp = temp;
+	if (!tcctl_update(rp->ctx, zone_id))
+		return 0;
+
+	if (zone->is_on != is_on)
+		rz->switches++;
+	if (zone->stat.phase != phase)
+	{
+		rz->transitions++;
+		if (rp->trace)
+			tcctl_replay_trace(rp, zone_id);
+	}
+	return 1;
+}
+
+int
+tcctl_replay_parse(
+		struct tcctl_replay *rp,
+		const char *line,
+		unsigned long long *ms,
+		unsigned int *temp,
+		int *zone_id
+)
+{
+	struct tcctl_ctx *ctx = rp->ctx;
+	unsigned int day;
+	const char *p;
+	int len;
+
+	*zone_id = -1;
+	if (str_eq(line, REPLAY_TICK_MARK, sizeof(REPLAY_TICK_MARK) - 1))
+	{
+		// tick> d0 00:00:01.000 main 041 IDLE off
+		p = line + sizeof(REPLAY_TICK_MARK) - 1;
+		if ((len = uint_scan(&day, p)) == 0 || p[len] != ' ')
+			return -1;
+		p += len + 1;
+		if ((len = time_read_ms(ms, p)) == -1 || p[len] != ' ')
+			return -1;
+		p += len + 1;
+		*ms += day * 86400000ULL;
+
+		const char *name = p;
+		while (*p != ' ' && *p != '\0')
+			p++;
+		if (*p++ != ' ')
+			return -1;
+		for (unsigned int i = 0; i < ctx->zones_num; i++)
+		{
+			const char *zone_name = ctx->zones[i].conf.name;
+			if (
+				str_eq(zone_name, name, p - 1 - name) &&
+				str_len(zone_name, ZONE_NAME_MAX_LEN) == p - 1 - name
+			)
+				*zone_id = i;
+		}
+	}
+	else if ((p = str_find(line, REPLAY_TEMP_MARK, MSG_MAX_LEN)) != NULL)
+	{
+		// info> [12:00:01.000] current temperature: 041 (tcctl_kill_sig)
+		const char *t = str_find(line, "[", MSG_MAX_LEN);
+		if (t == NULL || t > p || time_read_ms(ms, t + 1) == -1)
+			return -1;
+		// the log only has the time of day
+		if (*ms + 43200000ULL < rp->last_wall)
+			rp->day += 86400000ULL;
+		rp->last_wall = *ms;
+		*ms += rp->day;
+		p += sizeof(REPLAY_TEMP_MARK) - 1;
+	}
+	else
+		return -1;
+
+	if (uint_scan(temp, p) == 0)
+		return -1;
+	return 1;
+}
+
+int
+tcctl_replay_line(struct tcctl_replay *rp, const char *line)
+{
+	unsigned long long ms;
+	unsigned int temp;
+	int zone_id;
+
+	if (tcctl_replay_parse(rp, line, &ms, &temp, &zone_id) == -1)
+		return -1;
+
+	// a sample without a known zone drives all of them
+	for (unsigned int i = 0; i < rp->ctx->zones_num; i++)
+	{
+		if (zone_id != -1 && zone_id != i)
+			continue;
+		if (!tcctl_replay_sample(rp, i, ms, temp))
+			return 0;
+	}
+	return 1;
+}
+
+int
+tcctl_replay_text(struct tcctl_replay *rp, const char *buf, size_t len)
+{
+	const char *p = buf, *end = buf + len;
+	while (p < end)
+	{
+		char line[MSG_MAX_LEN] = ZERO_STR;
+		size_t i = 0;
+		for (; p < end && *p != '\n'; p++)
+		{
+			if (i < MSG_MAX_LEN - 1)
+				line[i++] = *p;
+		}
+		p++;
+
+		if (tcctl_replay_line(rp, line) == 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+int
+tcctl_replay_bin(struct tcctl_replay *rp, const char *buf, size_t len)
+{
+	size_t rec_len = tcctl_rec_len(buf, len);
+	if (rec_len == 0)
+	{
+		LOG_ERROR("not a tcctl capture", NULL);
+		return 0;
+	}
+
+	// fields past rec_len are never touched
+	const char *p = buf + REC_MAGIC_LEN, *end = buf + len;
+	for (; p + rec_len <= end; p += rec_len)
+	{
+		const struct tcctl_rec *rec = (const struct tcctl_rec *)p;
+		if (rec->zone >= rp->ctx->zones_num)
+			continue;
+		rp->rpm = rec_len > REC_V1_LEN ? rec->rpm : 0;
+		rp->has_rpm = rec_len > REC_V1_LEN;
+		if (!tcctl_replay_sample(rp, rec->zone, rec->ms, rec->temp))
+			return 0;
+	}
+
+	if (p != end)
+		LOG_WARN("capture ends with a partial record", NULL);
+	return 1;
+}
+
+unsigned long long
+tcctl_replay_clock_ms(void *user)
+{
+	struct tcctl_replay *rp = user;
+	return rp->now;
+}
+
+int
+tcctl_replay_sensor_open(void *user, unsigned int zone, unsigned int sensor, const char *path)
+{
+	return 1;
+}
+
+int
+tcctl_replay_sensor_read(void *user, unsigned int zone, unsigned int sensor, unsigned int *temp)
+{
+	struct tcctl_replay *rp = user;
+	*temp = rp->temp * 1000;
+	return 1;
+}
+
+int
+tcctl_replay_tach_read(void *user, unsigned int zone, unsigned int *rpm)
+{
+	// text traces and old captures have no fan speed
+	struct tcctl_replay *rp = user;
+	*rpm = rp->rpm;
+	return rp->has_rpm;
+}
+
+int
+tcctl_replay_output_write(void *user, unsigned int zone, int is_on)
+{
+	return 1;
+}
+
+void
+tcctl_replay_trace(struct tcctl_replay *rp, unsigned int zone_id)
+{
+	struct tcctl_zone *zone = &rp->ctx->zones[zone_id];
+	char line[MSG_MAX_LEN];
+	char *p = line;
+
+	// replay> d0 00:00:01.000 main 041 RUN on
+	p += str_copy("replay> d", p, MSG_MAX_LEN);
+	p += uint_write(rp->now / 86400000, p);
+	*p++ = ' ';
+	p += time_write_ms(rp->now, p);
+	*p++ = ' ';
+	p += str_copy(zone->conf.name, p, ZONE_NAME_MAX_LEN);
+	*p++ = ' ';
+	p += uint_write_pad(rp->temp, p, 3);
+	*p++ = ' ';
+	p += str_copy(tcctl_phase_name(zone->stat.phase), p, ENTRY_NAME_MAX_LEN);
+	p += str_copy(zone->is_on ? " on" : " off", p, ENTRY_NAME_MAX_LEN);
+	if (zone->conf.tach_pin.uint != -1)
+	{
+		*p++ = ' ';
+		p += uint_write(zone->rpm, p);
+		p += str_copy("rpm", p, ENTRY_NAME_MAX_LEN);
+	}
+	*p++ = '\n';
+	*p = '\0';
+	tcctl_stdout_write(line);
+}
+
+void
+tcctl_replay_report(struct tcctl_replay *rp)
+{
+	char buf[ENTRY_LINE_MAX_LEN];
+
+	for (unsigned int i = 0; i < rp->ctx->zones_num; i++)
+	{
+		struct tcctl_replay_zone *rz = &rp->zones[i];
+		unsigned long long total = rz->total_ms;
+
+		LOG_INFO("replay zone: ", rp->ctx->zones[i].conf.name);
+		buf[uint_write(rz->samples, buf)] = '\0';
+		LOG_INFO("samples: ", buf);
+		buf[uint_write(total / 1000, buf)] = '\0';
+		LOG_INFO("covered seconds: ", buf);
+		buf[uint_write(rz->transitions, buf)] = '\0';
+		LOG_INFO("phase transitions: ", buf);
+		buf[uint_write(rz->switches, buf)] = '\0';
+		LOG_INFO("fan switches: ", buf);
+		buf[uint_write(total ? rz->on_ms * 100 / total : 0, buf)] = '\0';
+		LOG_INFO("fan duty %: ", buf);
+		buf[uint_write(rz->above_ms / 1000, buf)] = '\0';
+		LOG_INFO("seconds above trig_temp: ", buf);
+		buf[uint_write(total ? rz->above_ms * 100 / total : 0, buf)] = '\0';
+		LOG_INFO("time above trig_temp %: ", buf);
+	}
+}
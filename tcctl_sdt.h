@@ -0,0 +1,90 @@
+#ifndef _TCCTL_SDT_H_
+#define _TCCTL_SDT_H_
+
+// static probes in the systemtap sdt note format, without <sys/sdt.h> so the
+// tiny build has them too. a probe is one nop in the code and an entry in the
+// .note.stapsdt section, bpftrace and perf find it as usdt:BIN:tcctl:NAME and
+// patch the nop only while attached. -DTCCTL_NO_PROBES drops them
+
+#define PROBE_PROVIDER "tcctl"
+
+#if defined(TCCTL_NO_PROBES) || !defined(__GNUC__) || !defined(__ELF__)
+
+// the arguments still count as used, no warnings for probe only values
+#define PROBE1(NAME, A1) do { (void)(A1); } while (0)
+#define PROBE2(NAME, A1, A2) do { (void)(A1); (void)(A2); } while (0)
+#define PROBE3(NAME, A1, A2, A3) do { PROBE2(NAME, A1, A2); (void)(A3); } while (0)
+#define PROBE4(NAME, A1, A2, A3, A4) do { PROBE3(NAME, A1, A2, A3); (void)(A4); } while (0)
+#define PROBE6(NAME, A1, A2, A3, A4, A5, A6) \
+	do { PROBE4(NAME, A1, A2, A3, A4); (void)(A5); (void)(A6); } while (0)
+
+#else
+
+#if __SIZEOF_POINTER__ == 8
+#define PROBE_ADDR ".8byte"
+#else
+#define PROBE_ADDR ".4byte"
+#endif
+
+// arm has no offsettable memory operand the tools can read
+#ifdef __arm__
+#define PROBE_CONSTRAINT "g"
+#else
+#define PROBE_CONSTRAINT "nor"
+#endif
+
+// an argument is SIZE@OPERAND, the size negative if it is signed. %n prints
+// the constant bare and negated, so it goes in with the other sign
+#define PROBE_SIGNED(V) ((__typeof__(V))-1 < 1)
+#define PROBE_ARG(N, V) \
+	[s##N] "n" ((PROBE_SIGNED(V) ? 1 : -1) * (int)sizeof(V)), \
+	[a##N] PROBE_CONSTRAINT (V)
+#define PROBE_FMT(N) "%n[s" #N "]@%[a" #N "]"
+
+// the base section lets the tools undo prelink, one per binary
+#define PROBE_ASM(NAME, FMT, ...) \
+	__asm__ __volatile__ ( \
+		"990:\tnop\n" \
+		"\t.pushsection .note.stapsdt,\"?\",\"note\"\n" \
+		"\t.balign 4\n" \
+		"\t.4byte 992f-991f, 994f-993f, 3\n" \
+		"991:\t.asciz \"stapsdt\"\n" \
+		"992:\t.balign 4\n" \
+		"993:\t" PROBE_ADDR " 990b\n" \
+		"\t" PROBE_ADDR " _.stapsdt.base\n" \
+		"\t" PROBE_ADDR " 0\n" \
+		"\t.asciz \"" PROBE_PROVIDER "\"\n" \
+		"\t.asciz \"" #NAME "\"\n" \
+		"\t.asciz \"" FMT "\"\n" \
+		"994:\t.balign 4\n" \
+		"\t.popsection\n" \
+		"\t.ifndef _.stapsdt.base\n" \
+		"\t.pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+		"\t.weak _.stapsdt.base\n" \
+		"\t.hidden _.stapsdt.base\n" \
+		"_.stapsdt.base:\t.space 1\n" \
+		"\t.size _.stapsdt.base, 1\n" \
+		"\t.popsection\n" \
+		"\t.endif\n" \
+		:: __VA_ARGS__ \
+	)
+
+#define PROBE1(NAME, A1) PROBE_ASM(NAME, PROBE_FMT(1), PROBE_ARG(1, A1))
+#define PROBE2(NAME, A1, A2) \
+	PROBE_ASM(NAME, PROBE_FMT(1) " " PROBE_FMT(2), \
+		PROBE_ARG(1, A1), PROBE_ARG(2, A2))
+#define PROBE3(NAME, A1, A2, A3) \
+	PROBE_ASM(NAME, PROBE_FMT(1) " " PROBE_FMT(2) " " PROBE_FMT(3), \
+		PROBE_ARG(1, A1), PROBE_ARG(2, A2), PROBE_ARG(3, A3))
+#define PROBE4(NAME, A1, A2, A3, A4) \
+	PROBE_ASM(NAME, PROBE_FMT(1) " " PROBE_FMT(2) " " PROBE_FMT(3) " " PROBE_FMT(4), \
+		PROBE_ARG(1, A1), PROBE_ARG(2, A2), PROBE_ARG(3, A3), PROBE_ARG(4, A4))
+#define PROBE6(NAME, A1, A2, A3, A4, A5, A6) \
+	PROBE_ASM(NAME, PROBE_FMT(1) " " PROBE_FMT(2) " " PROBE_FMT(3) " " \
+			PROBE_FMT(4) " " PROBE_FMT(5) " " PROBE_FMT(6), \
+		PROBE_ARG(1, A1), PROBE_ARG(2, A2), PROBE_ARG(3, A3), \
+		PROBE_ARG(4, A4), PROBE_ARG(5, A5), PROBE_ARG(6, A6))
+
+#endif
+
+#endif//_TCCTL_SDT_H_
@@ -0,0 +1,289 @@
+#include "libtcctl.h"
+
+void
+tcctl_model_reset(struct tcctl_model *model)
+{
+	model->ambient = MODEL_AMBIENT_DEFAULT;
+	model->temp = model->ambient;
+	model->heat = MODEL_HEAT_DEFAULT;
+	model->cool = MODEL_COOL_DEFAULT;
+	model->tau_off = MODEL_TAU_OFF_DEFAULT;
+	model->tau_on = MODEL_TAU_ON_DEFAULT;
+	model->load = 0;
+}
+
+void
+tcctl_model_step(struct tcctl_model *model, int fan_on, unsigned int dt_ms)
+{
+	long long rise = (long long)model->heat * model->load / 1000;
+	if (fan_on)
+		rise = rise * model->cool / 1000;
+	long long eq = model->ambient + rise;
+	unsigned int tau = fan_on ? model->tau_on : model->tau_off;
+
+	// explicit euler, steps kept short against the time constant
+	while (dt_ms > 0)
+	{
+		unsigned int dt = dt_ms < MODEL_STEP_MS ? dt_ms : MODEL_STEP_MS;
+		if (dt >= tau)
+			model->temp = eq;
+		else
+			model->temp += (eq - model->temp) * dt / tau;
+		dt_ms -= dt;
+	}
+}
+
+void
+tcctl_sim_init(struct tcctl_sim *sim, struct tcctl_ctx *ctx, unsigned int speed)
+{
+	struct tcctl_sim empty = { .now = 0 };
+	*sim = empty;
+	sim->ctx = ctx;
+	sim->speed = speed;
+	sim->seed = SIM_SEED_DEFAULT;
+	sim->end = SIM_TIME_DEFAULT * 1000ULL;
+	sim->trace = 1;
+	sim->real_start = time_mono_ms();
+
+	for (unsigned int i = 0; i < ZONES_MAX; i++)
+		tcctl_model_reset(&sim->zones[i].model);
+}
+
+void
+tcctl_sim_io(struct tcctl_sim *sim, struct tcctl_io *io)
+{
+	io->user = sim;
+	io->sensor_open = tcctl_sim_sensor_open;
+	io->sensor_read = tcctl_sim_sensor_read;
+	io->output_write = tcctl_sim_output_write;
+	io->clock_ms = tcctl_sim_clock_ms;
+	io->load_read = tcctl_sim_load_read;
+	io->conf_check = NULL;
+	io->tach_read = tcctl_sim_tach_read;
+}
+
+void
+tcctl_sim_script(struct tcctl_sim *sim, const char *script, size_t len)
+{
+	sim->script = script;
+	sim->script_end = script + len;
+	for (unsigned int i = 0; i < ZONES_MAX; i++)
+		sim->zones[i].script = script;
+}
+
+int
+tcctl_sim_advance(struct tcctl_sim *sim, unsigned long long deadline)
+{
+	// as fast as possible, jump straight to the next tick
+	if (sim->speed == 0 && deadline > sim->now)
+		sim->now = deadline;
+
+	return tcctl_sim_clock_ms(sim) < sim->end;
+}
+
+unsigned long long
+tcctl_sim_clock_ms(void *user)
+{
+	struct tcctl_sim *sim = user;
+	if (sim->speed == 0)
+		return sim->now;
+	return (time_mono_ms() - sim->real_start) * sim->speed;
+}
+
+unsigned int
+tcctl_sim_rand(struct tcctl_sim *sim)
+{
+	sim->seed = sim->seed * 1103515245 + 12345;
+	return sim->seed >> 16;
+}
+
+int
+tcctl_sim_sensor_open(void *user, unsigned int zone, unsigned int sensor, const char *path)
+{
+	return 1;
+}
+
+int
+tcctl_sim_script_read(
+		struct tcctl_sim *sim,
+		struct tcctl_sim_zone *sz,
+		unsigned long long now,
+		unsigned int *temp
+)
+{
+	// one line per second, the last one holds
+	while (sz->script_sec < now / 1000)
+	{
+		const char *p = sz->script;
+		while (p < sim->script_end && *p != '\n')
+			p++;
+		if (p + 1 >= sim->script_end)
+			break;
+		sz->script = p + 1;
+		sz->script_sec++;
+	}
+
+	char line[TEMP_BUF_MAX_LEN] = ZERO_STR;
+	for (size_t i = 0; i < TEMP_BUF_MAX_LEN - 1; i++)
+	{
+		if (sz->script + i >= sim->script_end || sz->script[i] == '\n')
+			break;
+		line[i] = sz->script[i];
+	}
+
+	return uint_read(temp, line) != -1;
+}
+
+void
+tcctl_sim_model_advance(struct tcctl_sim *sim, struct tcctl_sim_zone *sz, unsigned long long now)
+{
+	// integrate up to now, load takes a new level every period
+	unsigned long long period = sim->loads ? 1000 : SIM_LOAD_PERIOD_MS;
+	while (sz->step_ms < now)
+	{
+		unsigned long long sec = sz->step_ms / 1000;
+		if (sz->step_ms % period == 0 && sim->loads == NULL)
+			sz->model.load = tcctl_sim_rand(sim) % 1001;
+		else if (sz->step_ms % period == 0 && sec < sim->loads_num)
+			sz->model.load = sim->loads[sec];
+
+		unsigned long long to = (sz->step_ms / period + 1) * period;
+		if (to > now)
+			to = now;
+		tcctl_model_step(&sz->model, sz->fan, to - sz->step_ms);
+		sz->step_ms = to;
+	}
+}
+
+int
+tcctl_sim_sensor_read(void *user, unsigned int zone, unsigned int sensor, unsigned int *temp)
+{
+	struct tcctl_sim *sim = user;
+	struct tcctl_sim_zone *sz = &sim->zones[zone];
+	unsigned long long now = tcctl_sim_clock_ms(sim);
+
+	if (sim->script != NULL)
+	{
+		if (!tcctl_sim_script_read(sim, sz, now, temp))
+			return 0;
+	}
+	else
+	{
+		tcctl_sim_model_advance(sim, sz, now);
+		*temp = sz->model.temp > 0 ? sz->model.temp : 0;
+	}
+
+	if (*temp / 1000 > sz->max_temp)
+		sz->max_temp = *temp / 1000;
+	return 1;
+}
+
+int
+tcctl_sim_load_read(void *user, struct tcctl_load *load)
+{
+	// the model load of the first zone, always at full clock
+	struct tcctl_sim *sim = user;
+	load->util = sim->zones[0].model.load;
+	load->freq = 1000;
+	load->khz = 0;
+	return sim->script == NULL;
+}
+
+int
+tcctl_sim_output_write(void *user, unsigned int zone, int is_on)
+{
+	struct tcctl_sim *sim = user;
+	struct tcctl_sim_zone *sz = &sim->zones[zone];
+	unsigned long long now = tcctl_sim_clock_ms(sim);
+
+	// the old fan state holds up to now
+	if (sim->script == NULL)
+		tcctl_sim_model_advance(sim, sz, now);
+
+	if (is_on != sz->fan)
+	{
+		if (sz->fan)
+			sz->on_ms += now - sz->fan_since;
+		sz->fan = is_on;
+		sz->fan_since = now;
+		sz->switches++;
+	}
+
+	if (sim->trace)
+		tcctl_sim_trace(sim, zone, now);
+	return 1;
+}
+
+int
+tcctl_sim_tach_read(void *user, unsigned int zone, unsigned int *rpm)
+{
+	// a good fan is up to speed by the next tick, a stalled one never turns
+	struct tcctl_sim *sim = user;
+	int stalled = sim->stall_at != 0 && tcctl_sim_clock_ms(sim) >= sim->stall_at;
+	*rpm = sim->zones[zone].fan && !stalled ? SIM_FAN_RPM : 0;
+	return 1;
+}
+
+void
+tcctl_sim_trace(struct tcctl_sim *sim, unsigned int zone, unsigned long long now)
+{
+	struct tcctl_zone *z = &sim->ctx->zones[zone];
+	char line[MSG_MAX_LEN];
+	char *p = line;
+
+	// tick> d0 00:00:01.000 main 41 IDLE off, and 2400rpm with a tach
+	p += str_copy("tick> d", p, MSG_MAX_LEN);
+	p += uint_write(now / 86400000, p);
+	*p++ = ' ';
+	p += time_write_ms(now, p);
+	*p++ = ' ';
+	p += str_copy(z->conf.name, p, ZONE_NAME_MAX_LEN);
+	*p++ = ' ';
+	p += uint_write_pad(z->stat.last_temp, p, 3);
+	*p++ = ' ';
+	p += str_copy(tcctl_phase_name(z->stat.phase), p, ENTRY_NAME_MAX_LEN);
+	p += str_copy(z->is_on ? " on" : " off", p, ENTRY_NAME_MAX_LEN);
+	if (z->conf.tach_pin.uint != -1)
+	{
+		*p++ = ' ';
+		p += uint_write(z->rpm, p);
+		p += str_copy("rpm", p, ENTRY_NAME_MAX_LEN);
+	}
+	*p++ = '\n';
+	*p = '\0';
+	tcctl_stdout_write(line);
+}
+
+void
+tcctl_sim_report(struct tcctl_sim *sim)
+{
+	char buf[ENTRY_LINE_MAX_LEN];
+	unsigned long long now = tcctl_sim_clock_ms(sim);
+
+	for (unsigned int i = 0; i < sim->ctx->zones_num; i++)
+	{
+		struct tcctl_sim_zone *sz = &sim->zones[i];
+		unsigned long long on_ms = sz->on_ms;
+		if (sz->fan)
+			on_ms += now - sz->fan_since;
+
+		LOG_INFO("sim zone: ", sim->ctx->zones[i].conf.name);
+		buf[uint_write(now ? on_ms * 100 / now : 0, buf)] = '\0';
+		LOG_INFO("fan duty %: ", buf);
+		buf[uint_write(sz->switches, buf)] = '\0';
+		LOG_INFO("fan switches: ", buf);
+		buf[uint_write(sz->max_temp, buf)] = '\0';
+		LOG_INFO("max temperature: ", buf);
+
+		// what the engine made of the model
+		struct tcctl_zone *zone = &sim->ctx->zones[i];
+		buf[uint_write(tcctl_stat_get(sim->ctx, i, STAT_TAU_OFF), buf)] = '\0';
+		LOG_INFO("fit tau off s: ", buf);
+		buf[uint_write(tcctl_stat_get(sim->ctx, i, STAT_TAU_ON), buf)] = '\0';
+		LOG_INFO("fit tau on s: ", buf);
+		buf[uint_write(tcctl_fit_eq(&zone->fit, 0), buf)] = '\0';
+		LOG_INFO("fit eq off mC: ", buf);
+		buf[uint_write(tcctl_fit_eq(&zone->fit, 1), buf)] = '\0';
+		LOG_INFO("fit eq on mC: ", buf);
+	}
+}
@@ -0,0 +1,133 @@
+#include "libtcctl.h"
+
+// a zone of the snapshot by name, NULL if it is not in there
+const struct tcctl_snap_zone *
+tcctl_snap_zone(const struct tcctl_snap *snap, const char *name)
+{
+	for (unsigned int i = 0; i < snap->zones_num && i < ZONES_MAX; i++)
+	{
+		if (str_eq(snap->zones[i].name, name, ZONE_NAME_MAX_LEN))
+			return &snap->zones[i];
+	}
+
+	return NULL;
+}
+
+unsigned long long
+tcctl_snap_left(unsigned long long until, unsigned long long now)
+{
+	return until > now ? until - now : 0;
+}
+
+void
+tcctl_snap_take(struct tcctl_ctx *ctx, struct tcctl_snap *snap, unsigned long long wall_ms)
+{
+	unsigned long long now = ctx->io.clock_ms(ctx->io.user);
+
+	str_copy(SNAP_MAGIC, snap->magic, SNAP_MAGIC_LEN + 1);
+	snap->version = SNAP_VERSION;
+	snap->wall_ms = wall_ms;
+	snap->zones_num = ctx->zones_num;
+	for (unsigned int i = 0; i < ctx->zones_num; i++)
+	{
+		struct tcctl_zone *zone = &ctx->zones[i];
+		struct tcctl_snap_zone *sz = &snap->zones[i];
+
+		sz->name[str_copy(zone->conf.name, sz->name, ZONE_NAME_MAX_LEN)] = '\0';
+		sz->conf_low_temp = zone->conf.low_temp.uint;
+		sz->conf_trig_temp = zone->conf.trig_temp.uint;
+		sz->stat = zone->stat;
+		sz->is_on = zone->is_on;
+		sz->run_left = zone->run_until ? tcctl_snap_left(zone->run_until, now) : 0;
+		sz->hint_load = zone->hint_load;
+		sz->hint_start_in = tcctl_snap_left(zone->hint_start, now);
+		sz->hint_end_in = tcctl_snap_left(zone->hint_end, now);
+		sz->fit_dt = zone->fit.dt;
+		sz->rls[0] = zone->fit.rls[0];
+		sz->rls[1] = zone->fit.rls[1];
+	}
+
+	// last, a snapshot torn by a crash does not match it
+	snap->hash = tcctl_snap_hash(snap);
+}
+
+unsigned long long
+tcctl_snap_hash(const struct tcctl_snap *snap)
+{
+	const char *body = (const char *)&snap->wall_ms;
+	return str_hash(body, (const char *)(snap + 1) - body);
+}
+
+int
+tcctl_snap_valid(const struct tcctl_snap *snap, unsigned long long wall_ms)
+{
+	if (
+		!str_eq(snap->magic, SNAP_MAGIC, SNAP_MAGIC_LEN) ||
+		snap->version != SNAP_VERSION || snap->zones_num > ZONES_MAX ||
+		snap->hash != tcctl_snap_hash(snap)
+	)
+	{
+		LOG_WARN("no usable state snapshot, cold start", NULL);
+		return 0;
+	}
+
+	if (wall_ms < snap->wall_ms || wall_ms - snap->wall_ms > SNAP_MAX_AGE_MS)
+	{
+		LOG_WARN("state snapshot too old, cold start", NULL);
+		return 0;
+	}
+
+	return 1;
+}
+
+unsigned int
+tcctl_snap_restore(struct tcctl_ctx *ctx, const struct tcctl_snap *snap, unsigned long long wall_ms)
+{
+	unsigned long long now = ctx->io.clock_ms(ctx->io.user);
+	unsigned long long age = wall_ms - snap->wall_ms;
+	unsigned int restored = 0;
+
+	for (unsigned int i = 0; i < ctx->zones_num; i++)
+	{
+		struct tcctl_zone *zone = &ctx->zones[i];
+		const struct tcctl_snap_zone *sz = tcctl_snap_zone(snap, zone->conf.name);
+		if (sz == NULL)
+			continue;
+
+		// the first tick decides on the last temperature, not on 0
+		unsigned int low_temp = zone->stat.low_temp, trig_temp = zone->stat.trig_temp;
+		zone->stat = sz->stat;
+		zone->is_on = sz->is_on;
+		// a stall is found again by the tach, not carried over
+		if (zone->stat.phase == FAIL)
+			zone->stat.phase = RUN;
+		if (
+			sz->conf_low_temp != zone->conf.low_temp.uint ||
+			sz->conf_trig_temp != zone->conf.trig_temp.uint
+		)
+		{
+			zone->stat.low_temp = low_temp;
+			zone->stat.trig_temp = trig_temp;
+		}
+
+		// whatever ran out while down is over
+		zone->run_until = sz->run_left > age ? now + sz->run_left - age : 0;
+		zone->hint_load = sz->hint_end_in > age ? sz->hint_load : 0;
+		zone->hint_start = now + tcctl_snap_left(sz->hint_start_in, age);
+		zone->hint_end = now + tcctl_snap_left(sz->hint_end_in, age);
+
+		// fits of another tick length would be thrown away anyway
+		if (sz->fit_dt == zone->conf.update_delay.uint * 1000ULL)
+		{
+			zone->fit.dt = sz->fit_dt;
+			zone->fit.rls[0] = sz->rls[0];
+			zone->fit.rls[1] = sz->rls[1];
+			zone->fit.started = 0;
+		}
+
+		LOG_INFO("zone state restored: ", zone->conf.name);
+		restored++;
+	}
+
+	return restored;
+}
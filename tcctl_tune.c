@@ -0,0 +1,216 @@
+#include "libtcctl.h"
+
+void
+tcctl_tune_init(struct tcctl_tune *tune, const struct tcctl_conf *base)
+{
+	struct tcctl_tune empty = { .limit = 0 };
+	*tune = empty;
+	tune->base = *base;
+	tune->limit = base->trig_temp.uint;
+
+	tune->range[0][0] = TUNE_LOW_MIN_DEFAULT;
+	tune->range[0][1] = TUNE_LOW_MAX_DEFAULT;
+	tune->range[1][0] = TUNE_TRIG_MIN_DEFAULT;
+	tune->range[1][1] = TUNE_TRIG_MAX_DEFAULT;
+	tune->range[2][0] = TUNE_HYST_MIN_DEFAULT;
+	tune->range[2][1] = TUNE_HYST_MAX_DEFAULT;
+}
+
+unsigned int
+tcctl_tune_cands(struct tcctl_tune *tune)
+{
+	tune->cands_num = 1;
+	for (unsigned int i = 0; i < TUNE_PARAMS; i++)
+	{
+		if (tune->range[i][1] < tune->range[i][0])
+			tune->range[i][1] = tune->range[i][0];
+		tune->cands_num *= tune->range[i][1] - tune->range[i][0] + 1;
+	}
+
+	return tune->cands_num;
+}
+
+int
+tcctl_tune_cand(struct tcctl_tune *tune, unsigned int idx, struct tcctl_tune_cand *cand)
+{
+	unsigned int vals[TUNE_PARAMS];
+	for (unsigned int i = 0; i < TUNE_PARAMS; i++)
+	{
+		unsigned int span = tune->range[i][1] - tune->range[i][0] + 1;
+		vals[i] = tune->range[i][0] + idx % span;
+		idx /= span;
+	}
+
+	cand->low_temp = vals[0];
+	cand->trig_temp = vals[1];
+	cand->hyst_dec_temp = vals[2];
+
+	// the rest of the grid can not work with the phases
+	return cand->low_temp <= cand->trig_temp &&
+		cand->hyst_dec_temp < cand->trig_temp;
+}
+
+void
+tcctl_tune_eval(struct tcctl_tune_work *work, unsigned int idx)
+{
+	struct tcctl_tune *tune = work->tune;
+	struct tcctl_tune_score *score = &tune->scores[idx];
+	struct tcctl_ctx *ctx = &work->ctx;
+	struct tcctl_sim *sim = &work->sim;
+	struct tcctl_zone *zone = &ctx->zones[0];
+	struct tcctl_sim_zone *sz = &sim->zones[0];
+	struct tcctl_io io;
+	unsigned long long on_ms = 0, total_ms = 0, over_ms = 0;
+
+	score->valid = tcctl_tune_cand(tune, idx, &score->cand);
+	score->front = 0;
+	score->peak = 0;
+	score->switches = 0;
+	if (!score->valid)
+		return;
+
+	unsigned long long step = tune->base.update_delay.uint * 1000ULL;
+	if (step < MODEL_STEP_MS)
+		step = MODEL_STEP_MS;
+
+	for (unsigned int s = 0; s < tune->srcs_num; s++)
+	{
+		const struct tcctl_tune_src *src = &tune->srcs[s];
+
+		// fresh board and engine on the same memory every run
+		tcctl_sim_init(sim, ctx, 0);
+		sim->trace = 0;
+		sim->loads = src->loads;
+		sim->loads_num = src->loads_num;
+		tcctl_sim_io(sim, &io);
+		tcctl_ctx_init(ctx, &io);
+
+		zone->conf = tune->base;
+		zone->conf.low_temp.uint = score->cand.low_temp;
+		zone->conf.trig_temp.uint = score->cand.trig_temp;
+		zone->conf.hyst_dec_temp.uint = score->cand.hyst_dec_temp;
+		zone->conf.sensor.uint = 1;
+		tcctl_stat_update(&zone->stat, &zone->conf);
+		ctx->zones_num = 1;
+
+		for (sim->now = 0; sim->now < src->end; sim->now += step)
+		{
+			tcctl_update(ctx, 0);
+			if (zone->stat.last_temp >= tune->limit)
+				over_ms += step;
+		}
+
+		on_ms += sz->on_ms + (sz->fan ? sim->now - sz->fan_since : 0);
+		total_ms += sim->now;
+		score->switches += sz->switches;
+		if (sz->max_temp > score->peak)
+			score->peak = sz->max_temp;
+	}
+
+	score->over_s = over_ms / 1000;
+	score->duty = total_ms ? on_ms * 100 / total_ms : 0;
+}
+
+void
+tcctl_tune_run(struct tcctl_tune_work *work)
+{
+	struct tcctl_tune *tune = work->tune;
+	for (;;)
+	{
+		unsigned int idx = __atomic_fetch_add(&tune->next, 1, __ATOMIC_RELAXED);
+		if (idx >= tune->cands_num)
+			break;
+		tcctl_tune_eval(work, idx);
+	}
+}
+
+int
+tcctl_tune_dominates(const struct tcctl_tune_score *a, const struct tcctl_tune_score *b)
+{
+	if (
+		a->peak > b->peak || a->over_s > b->over_s ||
+		a->switches > b->switches || a->duty > b->duty
+	)
+		return 0;
+	return a->peak < b->peak || a->over_s < b->over_s ||
+		a->switches < b->switches || a->duty < b->duty;
+}
+
+unsigned int
+tcctl_tune_front(struct tcctl_tune *tune)
+{
+	unsigned int num = 0;
+	for (unsigned int i = 0; i < tune->cands_num; i++)
+	{
+		struct tcctl_tune_score *score = &tune->scores[i];
+		if (!score->valid)
+			continue;
+
+		score->front = 1;
+		for (unsigned int j = 0; j < tune->cands_num && score->front; j++)
+		{
+			if (tune->scores[j].valid && tcctl_tune_dominates(&tune->scores[j], score))
+				score->front = 0;
+		}
+		num += score->front;
+	}
+
+	return num;
+}
+
+unsigned long long
+tcctl_tune_cost(const struct tcctl_tune_score *score, unsigned long long total_s)
+{
+	// fan time and wear weigh alike: duty % plus switches per hour
+	return score->duty * total_s + score->switches * 3600ULL;
+}
+
+int
+tcctl_tune_pick(struct tcctl_tune *tune, unsigned int max_over)
+{
+	unsigned long long total_s = 0;
+	for (unsigned int s = 0; s < tune->srcs_num; s++)
+		total_s += tune->srcs[s].end / 1000;
+
+	// cheapest point that stays under the limit long enough,
+	// the coolest front point if none does
+	int best = -1, coolest = -1;
+	for (unsigned int i = 0; i < tune->cands_num; i++)
+	{
+		struct tcctl_tune_score *score = &tune->scores[i];
+		if (!score->front)
+			continue;
+
+		if (
+			coolest == -1 ||
+			score->over_s < tune->scores[coolest].over_s ||
+			(
+				score->over_s == tune->scores[coolest].over_s &&
+				score->peak < tune->scores[coolest].peak
+			)
+		)
+			coolest = i;
+
+		if (score->over_s * 100ULL > max_over * total_s)
+			continue;
+		if (
+			best == -1 ||
+			tcctl_tune_cost(score, total_s) < tcctl_tune_cost(&tune->scores[best], total_s)
+		)
+			best = i;
+	}
+
+	return best != -1 ? best : coolest;
+}
+
+unsigned short
+tcctl_tune_load(unsigned int temp)
+{
+	// a recorded temperature taken as the fan-off equilibrium
+	int rise = (int)temp * 1000 - MODEL_AMBIENT_DEFAULT;
+	if (rise <= 0)
+		return 0;
+	if (rise >= MODEL_HEAT_DEFAULT)
+		return 1000;
+	return rise * 1000LL / MODEL_HEAT_DEFAULT;
+}
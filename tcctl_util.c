@@ -0,0 +1,627 @@
+#include "libtcctl.h"
+#include <unistd.h>
+#include <sys/time.h>
+
+static int stdout_fd = STDOUT_FILENO, log_fd;
+
+void
+tcctl_log_set(int log, int out)
+{
+	log_fd = log;
+	stdout_fd = out;
+}
+
+void 
+tcctl_log_writeln(const char **msgs, size_t cnt)
+{
+	for (size_t i = 0; i < cnt; i++)
+	{
+		const char *msg = *(msgs+i);
+		if (msg == NULL) continue;
+		size_t msg_len = str_len(msg, MSG_MAX_LEN);
+		if (log_fd)
+			write(log_fd, msg, msg_len);
+		write(stdout_fd, msg, msg_len);
+	}
+	if (log_fd)
+		write(log_fd, "\n", 1);
+	write(stdout_fd, "\n", 1);
+	if (log_fd)
+		fsync(log_fd);
+}
+
+void 
+tcctl_log_info(const char *msg, const char *val, const char *src, int warn)
+{
+	const char *header = warn ? "warn>" : "info>";
+	char time_buf[TIME_BUF_LEN] = ZERO_STR;
+	time_write(time_buf);
+	const char *msg_buf[] = 
+	{ 
+		header, " [", time_buf , "] ", msg, val, " (", src, ")" 
+	};
+	tcctl_log_writeln(msg_buf, 9);
+}
+
+void 
+tcctl_log_error(const char *msg, const char *val, const char *src, const char *loc)
+{
+	char time_buf[TIME_BUF_LEN] = ZERO_STR;
+	time_write(time_buf);
+	const char *msg_buf[] = 
+	{ 
+		"!err>", " [", time_buf, "] ", msg, val, " (", src, "/:", loc, ")" 
+	};
+	tcctl_log_writeln(msg_buf, 11);
+}
+
+void
+tcctl_stdout_write(const char *msg)
+{
+	write(stdout_fd, msg, str_len(msg, MSG_MAX_LEN));
+}
+
+int
+str_eq(const char *s1, const char *s2, size_t max_len)
+{
+	for (size_t i = 0; i < max_len; i++)
+	{
+		if (*s1 != *s2) 
+			return 0;
+		if (*s1 == '\0' || *s2 == '\0') 
+			break;
+		s1++;
+		s2++;
+	}
+
+	return 1;
+}
+
+size_t
+str_copy(const char *from, char *to, size_t max_len)
+{
+	size_t len = 0;
+	while (*from != '\0' && len < max_len - 1)
+	{
+		*to++ = *from++;
+		len++;
+	}
+
+	return len;
+}
+
+size_t 
+str_set(char c, char *to, size_t max_len)
+{
+	size_t len = 0;
+	while (*to != '\0' && len < max_len - 1)
+	{
+		*to++ = c;
+		len++;
+	}
+	
+	*to = '\0';
+	return len;
+}
+
+size_t
+str_len(const char *s, size_t max_len)
+{
+	size_t len = 0;
+	while (*s++ != '\0' && len < max_len - 1)
+		len++;
+
+	return len;
+}
+
+size_t
+str_zlen(const char *s, size_t max_len)
+{
+	return str_len(s, max_len) + 1;
+}
+
+size_t 
+str_join(char *to, char *s, size_t max_len)
+{
+	size_t len = str_len(to, max_len);
+	char *p = to+len;
+	while (*s != '\0' && len < max_len - 1)
+	{
+		*p++ = *s++;
+		len++;
+	}
+
+	*p = '\0';
+	return len + 1;
+}
+
+const char *
+str_find(const char *str, const char *word, size_t max_len)
+{
+	size_t len = str_len(word, max_len);
+	for (; *str != '\0'; str++)
+	{
+		if (str_eq(str, word, len))
+			return str;
+	}
+
+	return NULL;
+}
+
+unsigned long long
+str_hash(const char *str, size_t len)
+{
+	// 64 bit FNV-1a
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < len; i++)
+	{
+		hash ^= (unsigned char)str[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+int
+uint_scan(unsigned int *val, const char *str)
+{
+	// leading digits only, quiet on anything else
+	unsigned int num = 0;
+	int places = 0;
+	while (str[places] >= '0' && str[places] <= '9')
+		num = num * 10 + (str[places++] - '0');
+
+	*val = num;
+	return places;
+}
+
+int
+uint_read(unsigned int *val, const char *str)
+{
+	const char *p = str;
+	unsigned short places = 0;
+	unsigned int mult = 1;
+	
+	while (*p != '\0' && *p != '\n')
+	{
+		if (*p >= '0' && *p <= '9')
+		{
+			mult *= 10;
+			places++;
+			p++;
+			continue;
+		}
+
+		if (*p == ' ' || *p == '_')
+		{
+			places++;
+			p++;
+			continue;
+		}
+
+		LOG_WARN("read malformed uint: ", str);
+		return -1;
+	}
+
+	unsigned int num = 0;
+	for (size_t i = 0; i < places; i++)
+	{
+		char c = *(str+i);
+		if (c >= '0' && c <= '9')
+		{
+			mult /= 10;
+			num += (c - '0') * mult;
+		}
+	}
+
+	*val = num;
+	return places;
+}
+
+int
+uint_write(unsigned int val, char *str)
+{
+	unsigned short places = 0;
+	unsigned int num = val;
+	do
+	{
+		num /= 10;
+		places++;
+	}
+	while (num > 0);
+
+	uint_write_pad(val, str, places);
+	return places;
+}
+
+int
+uint_write_pad(unsigned int val, char *str, size_t len)
+{
+	unsigned short places = 0;
+	char *p = str+len-1;
+	while (p >= str)
+	{
+		int d = val % 10;
+		*p-- = d + '0';
+		val /= 10;
+		places++;
+	}
+
+	return places;
+}
+
+int
+boolean_read(int *val, const char *str)
+{
+	int set_true = str_eq(str, "true", 4);
+	int set_false = str_eq(str, "false", 5);
+
+	if (!set_true && !set_false)
+	{
+		LOG_WARN("read malformed boolean: ", str);
+		return -1;
+	}
+
+	*val = set_true;
+	return set_true ? 4 : 5;
+}
+
+int
+boolean_write(int val, char *str)
+{
+	return str_copy(val ? "true" : "false", str, 6);
+}
+
+int
+path_read(char *path, const char *str, size_t max_len)
+{
+	size_t len = 0;
+	while (str[len] != '\0' && str[len] != '\n' && !CONF_IS_WSPACE(str[len]))
+	{
+		if (len == max_len - 1)
+		{
+			LOG_WARN("path too long: ", str);
+			return -1;
+		}
+		path[len] = str[len];
+		len++;
+	}
+
+	if (len == 0)
+	{
+		LOG_WARN("read empty path", NULL);
+		return -1;
+	}
+
+	path[len] = '\0';
+	return len;
+}
+
+int
+keyword_read(unsigned int *val, const char *str, const char **words, size_t cnt)
+{
+	for (size_t i = 0; i < cnt; i++)
+	{
+		// the whole value, pull-downXYZ is not pull-down
+		size_t len = str_len(words[i], ENTRY_NAME_MAX_LEN);
+		if (str_eq(str, words[i], len) && (CONF_IS_WSPACE(str[len]) || CONF_IS_EOL(str[len])))
+		{
+			*val = i;
+			return len;
+		}
+	}
+
+	LOG_WARN("read malformed keyword: ", str);
+	return -1;
+}
+
+int 
+time_write(char *str)
+{
+	struct timeval time;
+	gettimeofday(&time, NULL);
+	return time_write_ms(time.tv_sec * 1000ULL + time.tv_usec / 1000, str);
+}
+
+int
+time_write_ms(unsigned long long ms, char *str)
+{
+	unsigned int s = ms / 1000 % 86400;
+	unsigned int tusecs = ms % 1000;
+	unsigned int tsecs = s % 60;
+	unsigned int tmins = s / 60 % 60;
+	unsigned int thrs = s / 3600;
+	// unsigned int ddays = ms / 86400000;
+
+	char *p = str;
+
+	p+=uint_write_pad(thrs, p, 2);
+	*p++ = ':';
+	p+=uint_write_pad(tmins, p, 2);
+	*p++ = ':';
+	p+=uint_write_pad(tsecs, p, 2);
+	*p++ = '.';
+	p+=uint_write_pad(tusecs, p, 3);
+
+	return p-str;
+}
+
+int
+time_read_ms(unsigned long long *ms, const char *str)
+{
+	// HH:MM:SS.mmm as written by time_write_ms
+	unsigned int parts[4];
+	const char *p = str;
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		int len = uint_scan(&parts[i], p);
+		if (len == 0)
+			return -1;
+		p += len;
+		if (i < 3 && *p++ != (i == 2 ? '.' : ':'))
+			return -1;
+	}
+
+	*ms = ((parts[0] * 60 + parts[1]) * 60 + parts[2]) * 1000ULL + parts[3];
+	return p - str;
+}
+
+time_t
+time_mono(void)
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec;
+}
+
+unsigned long long
+time_mono_ms(void)
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000ULL + time.tv_nsec / 1000000;
+}
+
+unsigned long long
+time_real_ms(void)
+{
+	struct timespec time;
+	clock_gettime(CLOCK_REALTIME, &time);
+	return time.tv_sec * 1000ULL + time.tv_nsec / 1000000;
+}
+
+unsigned long long
+time_mono_us(void)
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000000ULL + time.tv_nsec / 1000;
+}
+
+#define TIMER_PARENT(I) (((I) - 1) / 2)
+#define TIMER_CHILD(I) ((I) * 2 + 1)
+
+void
+timer_swap(struct timer_heap *heap, unsigned int a, unsigned int b)
+{
+	struct timer t = heap->nodes[a];
+	heap->nodes[a] = heap->nodes[b];
+	heap->nodes[b] = t;
+}
+
+void
+timer_sift(struct timer_heap *heap, unsigned int i)
+{
+	struct timer *nodes = heap->nodes;
+	while (i > 0 && nodes[i].deadline < nodes[TIMER_PARENT(i)].deadline)
+	{
+		timer_swap(heap, i, TIMER_PARENT(i));
+		i = TIMER_PARENT(i);
+	}
+
+	for (;;)
+	{
+		unsigned int min = i;
+		unsigned int child = TIMER_CHILD(i);
+		if (child < heap->num && nodes[child].deadline < nodes[min].deadline)
+			min = child;
+		if (child + 1 < heap->num && nodes[child + 1].deadline < nodes[min].deadline)
+			min = child + 1;
+		if (min == i)
+			break;
+		timer_swap(heap, i, min);
+		i = min;
+	}
+}
+
+unsigned int
+timer_find(struct timer_heap *heap, unsigned int id)
+{
+	unsigned int i = 0;
+	while (i < heap->num && heap->nodes[i].id != id)
+		i++;
+	return i;
+}
+
+int
+timer_set(struct timer_heap *heap, unsigned int id, unsigned long long deadline)
+{
+	unsigned int i = timer_find(heap, id);
+	if (i == heap->num)
+	{
+		if (heap->num == TIMERS_MAX)
+			return 0;
+		heap->num++;
+	}
+
+	heap->nodes[i].id = id;
+	heap->nodes[i].deadline = deadline;
+	timer_sift(heap, i);
+	return 1;
+}
+
+int
+timer_del(struct timer_heap *heap, unsigned int id)
+{
+	unsigned int i = timer_find(heap, id);
+	if (i == heap->num)
+		return 0;
+
+	heap->nodes[i] = heap->nodes[--heap->num];
+	if (i < heap->num)
+		timer_sift(heap, i);
+	return 1;
+}
+
+int
+timer_top(struct timer_heap *heap, struct timer *top)
+{
+	if (heap->num == 0)
+		return 0;
+	*top = heap->nodes[0];
+	return 1;
+}
+
+static const char *errno_msgs[] = 
+{
+	"EPERM operation not permitted",
+        "ENOENT no such file or directory",
+        "ESRCH no such process",
+        "EINTR interrupted system call",
+        "EIO i/o error",
+        "ENXIO no such device or address",
+        "E2BIG argument list too long",
+        "ENOEXEC exec format error",
+        "EBADF bad file descriptor",
+        "ECHILD no child process",
+        "EAGAIN resource temporarily unavailable",
+        "ENOMEM out of memory",
+        "EACCES permission denied",
+        "EFAULT bad address",
+        "ENOTBLK block device required",
+        "EBUSY resource busy",
+        "EEXIST file exists",
+        "EXDEV cross-device link",
+        "ENODEV no such device",
+        "ENOTDIR not a directory",
+        "EISDIR is a directory",
+        "EINVAL invalid argument",
+        "ENFILE too many open files in system",
+        "EMFILE no file descriptors available",
+        "ENOTTY not a tty",
+        "ETXTBSY text file busy",
+        "EFBIG file too large",
+        "ENOSPC no space left on device",
+        "ESPIPE invalid seek",
+        "EROFS read-only file system",
+        "EMLINK too many links",
+        "EPIPE broken pipe",
+        "EDOM domain error",
+        "ERANGE result not representable",
+        "EDEADLK resource deadlock would occur",
+        "ENAMETOOLONG filename too long",
+        "ENOLCK no locks available",
+        "ENOSYS function not implemented",
+        "ENOTEMPTY directory not empty",
+        "ELOOP symbolic link loop",
+        "EWOULDBLOCK resource temporarily unavailable",
+        "ENOMSG no message of desired type",
+        "EIDRM identifier removed",
+        "ECHRNG no error information",
+        "EL2NSYNC no error information",
+        "EL3HLT no error information",
+        "EL3RST no error information",
+        "ELNRNG no error information",
+        "EUNATCH no error information",
+        "ENOCSI no error information",
+        "EL2HLT no error information",
+        "EBADE no error information",
+        "EBADR no error information",
+        "EXFULL no error information",
+        "ENOANO no error information",
+        "EBADRQC no error information",
+        "EBADSLT no error information",
+        "EDEADLOCK resource deadlock would occur",
+        "EBFONT no error information",
+        "ENOSTR device not a stream",
+        "ENODATA no data available",
+        "ETIME device timeout",
+        "ENOSR out of streams resources",
+        "ENONET no error information",
+        "ENOPKG no error information",
+        "EREMOTE no error information",
+        "ENOLINK link has been severed",
+        "EADV no error information",
+        "ESRMNT no error information",
+        "ECOMM no error information",
+        "EPROTO protocol error",
+        "EMULTIHOP multihop attempted",
+        "EDOTDOT no error information",
+        "EBADMSG bad message",
+        "EOVERFLOW value too large for data type",
+        "ENOTUNIQ no error information",
+        "EBADFD file descriptor in bad state",
+        "EREMCHG no error information",
+        "ELIBACC no error information",
+        "ELIBBAD no error information",
+        "ELIBSCN no error information",
+        "ELIBMAX no error information",
+        "ELIBEXEC no error information",
+        "EILSEQ illegal byte sequence",
+        "ERESTART no error information",
+        "ESTRPIPE no error information",
+        "EUSERS no error information",
+        "ENOTSOCK not a socket",
+        "EDESTADDRREQ destination address required",
+        "EMSGSIZE message too large",
+        "EPROTOTYPE protocol wrong type for socket",
+        "ENOPROTOOPT protocol not available",
+        "EPROTONOSUPPORT protocol not supported",
+        "ESOCKTNOSUPPORT socket type not supported",
+        "EOPNOTSUPP not supported",
+        "ENOTSUP not supported",
+        "EPFNOSUPPORT protocol family not supported",
+        "EAFNOSUPPORT address family not supported by protocol",
+        "EADDRINUSE address in use",
+        "EADDRNOTAVAIL address not available",
+        "ENETDOWN network is down",
+        "ENETUNREACH network unreachable",
+        "ENETRESET connection reset by network",
+        "ECONNABORTED connection aborted",
+        "ECONNRESET connection reset by peer",
+        "ENOBUFS no buffer space available",
+        "EISCONN socket is connected",
+        "ENOTCONN socket not connected",
+        "ESHUTDOWN cannot send after socket shutdown",
+        "ETOOMANYREFS no error information",
+        "ETIMEDOUT operation timed out",
+        "ECONNREFUSED connection refused",
+        "EHOSTDOWN host is down",
+        "EHOSTUNREACH host is unreachable",
+        "EALREADY operation already in progress",
+        "EINPROGRESS operation in progress",
+        "ESTALE stale file handle",
+        "EUCLEAN no error information",
+        "ENOTNAM no error information",
+        "ENAVAIL no error information",
+        "EISNAM no error information",
+        "EREMOTEIO remote i/o error",
+        "EDQUOT quota exceeded",
+        "ENOMEDIUM no medium found",
+        "EMEDIUMTYPE wrong medium type",
+        "ECANCELED operation canceled",
+        "ENOKEY no error information",
+        "EKEYEXPIRED no error information",
+        "EKEYREVOKED no error information",
+        "EKEYREJECTED no error information",
+        "EOWNERDEAD previous owner died",
+        "ENOTRECOVERABLE state not recoverable",
+        "ERFKILL no error information",
+        "EHWPOISON no error information"
+};
+
+const char *
+errno_msg(int err)
+{
+	return errno_msgs[err - 1];	
+}